@@ -0,0 +1,309 @@
+// Runs bus scenarios against the emulated LW14 on virtual time and prints the
+// cost of each as JSON or CSV, to compare versions of the adapter and the
+// commissioning.
+//
+//   bench [json|csv]
+#include "commissioning.h"
+#include "i2c_trace.h"
+#include "inventory.h"
+#include "lw14_impl.h"
+#include "simlw14.h"
+#include "startup_scan.h"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+using namespace libdali;
+
+namespace {
+
+struct Measurement {
+  std::string name;
+  uint64_t operations;
+  // Virtual time from start to end of the scenario.
+  uint64_t time_us;
+  // Virtual time frames occupied the DALI bus.
+  uint64_t bus_time_us;
+  size_t forward_frames;
+  size_t i2c_transactions;
+  // Host CPU time of the whole scenario, including the emulation.
+  uint64_t cpu_us;
+
+  double per_second() const {
+    return this->time_us == 0 ? 0.0 : this->operations * 1e6 / this->time_us;
+  }
+};
+
+// Emulated LW14 with `gear_count` addressed gear.
+struct Setup {
+  SimBus dali;
+  SimLW14 lw14;
+  LW14Adapter bus;
+  explicit Setup(size_t gear_count)
+      : dali(gear_count), lw14(dali), bus(&lw14) {}
+};
+
+// Runs prepare(setup) unmeasured, then f(setup) which returns the number of
+// operations it did.
+template <typename P, typename F>
+Measurement measure(const std::string &name, size_t gear_count, P &&prepare,
+                    F &&f) {
+  Setup setup(gear_count);
+  prepare(setup);
+  auto start_bus_time_us = setup.dali.bus_time_us;
+  auto start_frames = setup.dali.forward_frames;
+  auto start_cpu = std::clock();
+  uint64_t operations = 0;
+  auto cost = setup.lw14.measure([&] { operations = f(setup); });
+  auto cpu = std::clock() - start_cpu;
+  return Measurement{
+      .name = name,
+      .operations = operations,
+      .time_us = cost.time_us,
+      .bus_time_us = setup.dali.bus_time_us - start_bus_time_us,
+      .forward_frames = setup.dali.forward_frames - start_frames,
+      .i2c_transactions = cost.i2c_transactions,
+      .cpu_us = static_cast<uint64_t>(cpu) * 1000000 / CLOCKS_PER_SEC,
+  };
+}
+
+template <typename F>
+Measurement measure(const std::string &name, size_t gear_count, F &&f) {
+  return measure(name, gear_count, [](Setup &) {}, f);
+}
+
+void fail(const std::string &scenario, ErrorCode err) {
+  std::cerr << scenario << ": " << err << "\n";
+  std::exit(1);
+}
+
+// The inventory as restored after a restart.
+void restore(Inventory &inventory, const Inventory &stored) {
+  for (uint8_t block = 0; block < Inventory::BLOCKS; block++) {
+    inventory.load(block, stored.record(block));
+  }
+}
+
+// What the esphome bus does after start, without blocking its loop. Returns
+// the number of gear scanned.
+uint64_t startup_scan(LW14Adapter *bus, const Inventory &stored) {
+  Inventory inventory;
+  restore(inventory, stored);
+  std::bitset<Inventory::SHORT_ADDRESSES> lights;
+  lights.set();
+  StartupScan scan(bus, &inventory);
+  scan.start(lights);
+  uint64_t results = 0;
+  while (!scan.done()) {
+    if (scan.poll()) {
+      results++;
+    }
+    bus->delay_microseconds(std::max<uint32_t>(scan.poll_delay_us(), 100));
+  }
+  return results;
+}
+
+// The startup scan replayed from a trace recorded on the emulated LW14: the
+// cost of the adapter and the scan without the emulation.
+Measurement replay_startup_scan(const std::string &name,
+                                const Inventory &stored) {
+  Setup setup(64);
+  setup.dali.assign_short_addresses();
+  RecordingI2C recorder(&setup.lw14);
+  LW14Adapter recorded_bus(&recorder);
+  startup_scan(&recorded_bus, stored);
+
+  ReplayI2C replay(recorder.trace());
+  LW14Adapter bus(&replay);
+  auto start_cpu = std::clock();
+  auto operations = startup_scan(&bus, stored);
+  auto cpu = std::clock() - start_cpu;
+  if (replay.diverged()) {
+    fail(name, ErrorCode::I2C_ERROR);
+  }
+  return Measurement{
+      .name = name,
+      .operations = operations,
+      .time_us = replay.now_us(),
+      .bus_time_us = setup.dali.bus_time_us,
+      .forward_frames = setup.dali.forward_frames,
+      .i2c_transactions = replay.transactions(),
+      .cpu_us = static_cast<uint64_t>(cpu) * 1000000 / CLOCKS_PER_SEC,
+  };
+}
+
+std::vector<Measurement> run_scenarios() {
+  std::vector<Measurement> results;
+  constexpr uint64_t FRAMES = 200;
+
+  results.push_back(measure("direct_arc", 1, [](Setup &s) {
+    s.dali.assign_short_addresses();
+    auto address = Address::from_short_address(0);
+    for (uint64_t i = 0; i < FRAMES; i++) {
+      if (auto err = DirectArc(&s.bus, address, static_cast<uint8_t>(i))) {
+        fail("direct_arc", err);
+      }
+    }
+    return FRAMES;
+  }));
+
+  // The same through the adapter instantiated for the concrete transport.
+  results.push_back(measure("direct_arc_static", 1, [](Setup &s) {
+    s.dali.assign_short_addresses();
+    LW14AdapterT<SimLW14> bus(&s.lw14);
+    auto address = Address::from_short_address(0);
+    for (uint64_t i = 0; i < FRAMES; i++) {
+      if (auto err = DirectArc(&bus, address, static_cast<uint8_t>(i))) {
+        fail("direct_arc_static", err);
+      }
+    }
+    return FRAMES;
+  }));
+
+  results.push_back(measure("query_actual_level", 1, [](Setup &s) {
+    s.dali.assign_short_addresses();
+    auto address = Address::from_short_address(0);
+    for (uint64_t i = 0; i < FRAMES; i++) {
+      if (auto level = QueryActualLevel(&s.bus, address); !level) {
+        fail("query_actual_level", level.error());
+      }
+    }
+    return FRAMES;
+  }));
+
+  results.push_back(measure("query_actual_level_static", 1, [](Setup &s) {
+    s.dali.assign_short_addresses();
+    LW14AdapterT<SimLW14> bus(&s.lw14);
+    auto address = Address::from_short_address(0);
+    for (uint64_t i = 0; i < FRAMES; i++) {
+      if (auto level = QueryActualLevel(&bus, address); !level) {
+        fail("query_actual_level_static", level.error());
+      }
+    }
+    return FRAMES;
+  }));
+
+  for (size_t gear_count : {1, 16, 64}) {
+    auto name = "commissioning_" + std::to_string(gear_count);
+    results.push_back(measure(name, gear_count, [&](Setup &s) {
+      Commissioning commissioning(&s.bus);
+      if (auto err = commissioning.run(CommissioningMode::FULL)) {
+        fail(name, err);
+      }
+      return static_cast<uint64_t>(commissioning.added());
+    }));
+  }
+
+  // What every dali light does in Output::setup_state().
+  results.push_back(measure("light_setup_64", 64, [](Setup &s) {
+    s.dali.assign_short_addresses();
+    for (uint8_t i = 0; i < 64; i++) {
+      auto address = Address::from_short_address(i);
+      if (auto err = SelectDimmingCurve(&s.bus, address, 0)) {
+        fail("light_setup_64", err);
+      }
+      if (auto level = QueryActualLevel(&s.bus, address); !level) {
+        fail("light_setup_64", level.error());
+      }
+    }
+    return uint64_t{64};
+  }));
+
+  // The same with the inventory stored by an earlier start.
+  Inventory stored;
+  results.push_back(measure(
+      "light_setup_64_inventory", 64,
+      [&](Setup &s) {
+        s.dali.assign_short_addresses();
+        for (uint8_t i = 0; i < 64; i++) {
+          stored.query(&s.dali, i);
+        }
+      },
+      [&](Setup &s) {
+        Inventory inventory;
+        restore(inventory, stored);
+        std::bitset<Inventory::SHORT_ADDRESSES> lights;
+        lights.set();
+        RegisterCacheScope cache(&s.bus);
+        if (auto err = inventory.validate(&s.bus, lights)) {
+          fail("light_setup_64_inventory", err);
+        }
+        // The dimming curve is known, only the level is queried.
+        for (uint8_t i = 0; i < 64; i++) {
+          auto address = Address::from_short_address(i);
+          if (auto level = QueryActualLevel(&s.bus, address); !level) {
+            fail("light_setup_64_inventory", level.error());
+          }
+        }
+        return uint64_t{64};
+      }));
+
+  results.push_back(measure(
+      "startup_scan_64_inventory", 64,
+      [&](Setup &s) { s.dali.assign_short_addresses(); },
+      [&](Setup &s) { return startup_scan(&s.bus, stored); }));
+  results.push_back(
+      replay_startup_scan("startup_scan_64_inventory_replay", stored));
+
+  // Half of the short addresses are in use.
+  results.push_back(measure("presence_scan_64", 32, [](Setup &s) {
+    s.dali.assign_short_addresses();
+    for (uint8_t i = 0; i < 64; i++) {
+      auto present =
+          QueryControlGearPresent(&s.bus, Address::from_short_address(i));
+      if (!present) {
+        fail("presence_scan_64", present.error());
+      }
+    }
+    return uint64_t{64};
+  }));
+
+  return results;
+}
+
+void print_json(const std::vector<Measurement> &results) {
+  std::cout << "{\"scenarios\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto &m = results[i];
+    std::cout << "  {\"name\": \"" << m.name << "\""
+              << ", \"operations\": " << m.operations
+              << ", \"time_us\": " << m.time_us
+              << ", \"per_second\": " << m.per_second()
+              << ", \"bus_time_us\": " << m.bus_time_us
+              << ", \"forward_frames\": " << m.forward_frames
+              << ", \"i2c_transactions\": " << m.i2c_transactions
+              << ", \"cpu_us\": " << m.cpu_us << "}"
+              << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  std::cout << "]}\n";
+}
+
+void print_csv(const std::vector<Measurement> &results) {
+  std::cout << "name,operations,time_us,per_second,bus_time_us,"
+               "forward_frames,i2c_transactions,cpu_us\n";
+  for (const auto &m : results) {
+    std::cout << m.name << "," << m.operations << "," << m.time_us << ","
+              << m.per_second() << "," << m.bus_time_us << ","
+              << m.forward_frames << "," << m.i2c_transactions << ","
+              << m.cpu_us << "\n";
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string format = argc > 1 ? argv[1] : "json";
+  if (format != "json" && format != "csv") {
+    std::cerr << argv[0] << " [json|csv]\n";
+    return 1;
+  }
+  auto results = run_scenarios();
+  if (format == "json") {
+    print_json(results);
+  } else {
+    print_csv(results);
+  }
+  return 0;
+}
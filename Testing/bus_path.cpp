@@ -0,0 +1,46 @@
+// What firmware typically does with the bus, compiled once through the
+// runtime interfaces and once with a concrete transport to compare the code
+// size of both paths:
+//
+//   cmake --build build --target bus_path_size
+#include "lw14_impl.h"
+
+using namespace libdali;
+
+#if BUS_PATH_STATIC
+// Register access of the firmware, defined elsewhere and called directly.
+class Transport final : public I2CInterface {
+public:
+  I2CResult write_register(uint8_t i2c_register, uint8_t *data,
+                           size_t len) override;
+  I2CResult read_register(uint8_t i2c_register, uint8_t *data,
+                          size_t len) override;
+  void delay_microseconds(uint32_t us) override;
+  uint32_t millis() override;
+};
+using Bus = LW14AdapterT<Transport>;
+template class libdali::LW14AdapterT<Transport>;
+#else
+using Bus = BusInterface;
+// The adapter is part of the size in both cases.
+template class libdali::LW14AdapterT<I2CInterface>;
+#endif
+
+ErrorCode bus_path(Bus *bus, uint8_t short_address, uint8_t level) {
+  auto address = Address::from_short_address(short_address);
+  if (auto err = SetExtendedFadeTime(bus, address, extended_fade_time(500))) {
+    return err;
+  }
+  if (auto err = DirectArc(bus, address, level)) {
+    return err;
+  }
+  auto actual = QueryActualLevel(bus, address);
+  if (!actual) {
+    return actual.error();
+  }
+  auto status = QueryStatus(bus, address);
+  if (!status) {
+    return status.error();
+  }
+  return MemoryBank0GTIN(bus, address).error();
+}
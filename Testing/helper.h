@@ -13,7 +13,7 @@ public:
   uint32_t last_timeout_ms;
   virtual libdali::ErrorCode DaliCommand(uint8_t address, uint8_t data,
                                          uint8_t *reply, size_t reply_length,
-                                         uint32_t timeout_ms) override {
+                                         uint32_t timeout_ms = 150) override {
     this->last_address = address;
     this->last_data = data;
     for (size_t i = 0; i<reply_length && i<this->next_reply_length; i++) {
@@ -26,4 +26,6 @@ public:
   virtual void delay_microseconds(uint32_t delay) override {
     this->last_delay = delay;
   };
+  virtual uint32_t now_ms() override { return 0; }
 };
+
@@ -0,0 +1,323 @@
+#include "simbus.h"
+
+uint8_t SimGear::status() const {
+  uint8_t status = 0;
+  status |= this->lamp_failure ? 0x02 : 0;
+  status |= this->actual_level > 0 ? 0x04 : 0;
+  status |= this->reset_state ? 0x20 : 0;
+  status |= this->short_address == SIM_NO_SHORT_ADDRESS ? 0x40 : 0;
+  status |= this->power_failure ? 0x80 : 0;
+  return status;
+}
+
+SimBus::SimBus(size_t gear_count, uint32_t seed) : rng_(seed) {
+  this->gear.resize(gear_count);
+  for (size_t i = 0; i < gear_count; i++) {
+    auto &g = this->gear[i];
+    g.random_address = this->rng_() & 0xffffff;
+    g.bank0[0x00] = g.bank0.size() - 1; // last accessible location
+    g.bank0[0x02] = 0;                  // last accessible memory bank
+    // GTIN
+    for (size_t j = 0; j < 6; j++) {
+      g.bank0[0x03 + j] = static_cast<uint8_t>(0x10 + j);
+    }
+    // Identification number
+    uint64_t id = 1000000 + i;
+    for (size_t j = 0; j < 8; j++) {
+      g.bank0[0x0b + j] = static_cast<uint8_t>(id >> ((7 - j) * 8));
+    }
+  }
+}
+
+void SimBus::assign_short_addresses() {
+  for (size_t i = 0; i < this->gear.size(); i++) {
+    this->gear[i].short_address = static_cast<uint8_t>(i);
+  }
+}
+
+bool SimBus::addressed_(const SimGear &g, uint8_t address) const {
+  if ((address & 0xfe) == 0xfe) { // broadcast
+    return true;
+  }
+  if ((address & 0xfe) == 0xfc) { // broadcast unaddressed
+    return g.short_address == SIM_NO_SHORT_ADDRESS;
+  }
+  if ((address & 0x80) == 0) {
+    return g.short_address == ((address >> 1) & 0x3f);
+  }
+  if ((address & 0xe0) == 0x80) { // group
+    return g.groups & (1 << ((address >> 1) & 0x0f));
+  }
+  return false;
+}
+
+// Returns true if the frame is the repetition of the previous one, as
+// required for configuration commands.
+bool SimBus::send_twice_(uint8_t address, uint8_t data) {
+  bool second = this->twice_ && address == this->last_address_ &&
+                data == this->last_data_ &&
+                this->now_us - this->last_us_ <= SIM_SEND_TWICE_US;
+  this->twice_ = !second;
+  this->last_address_ = address;
+  this->last_data_ = data;
+  this->last_us_ = this->now_us;
+  return second;
+}
+
+SimBackward SimBus::process(uint8_t address, uint8_t data) {
+  this->forward_frames++;
+  auto second = this->send_twice_(address, data);
+  bool special = address >= 0xa1 && address <= 0xcb && (address & 0x01);
+  bool config = special ? (address == 0xa5 || address == 0xa7)
+                        : ((address & 0x01) && data >= 0x20 && data <= 0x81);
+  if (config && !second) {
+    return {};
+  }
+
+  size_t replies = 0;
+  uint8_t value = 0;
+  for (auto &g : this->gear) {
+    std::optional<uint8_t> reply;
+    if (special) {
+      reply = this->special_(g, address, data);
+    } else if (!this->addressed_(g, address)) {
+      continue;
+    } else if ((address & 0x01) == 0) {
+      // DirectArc, MASK stops fading.
+      if (data != libdali::DA_MASK) {
+        g.actual_level = data;
+        g.power_failure = false;
+        g.reset_state = false;
+      }
+    } else {
+      reply = this->command_(g, data);
+    }
+    if (reply.has_value()) {
+      replies++;
+      value = *reply;
+    }
+  }
+
+  if (replies == 0) {
+    return {};
+  }
+  this->backward_frames++;
+  if (replies > 1) {
+    this->collisions++;
+    return SimBackward{.kind = SimBackward::COLLISION, .value = 0};
+  }
+  return SimBackward{.kind = SimBackward::REPLY, .value = value};
+}
+
+std::optional<uint8_t> SimBus::command_(SimGear &g, uint8_t command) {
+  if ((command & 0xf0) == 0x10) { // GO TO SCENE
+    auto level = g.scenes[command & 0x0f];
+    if (level != libdali::DA_MASK) {
+      g.actual_level = level;
+      g.power_failure = false;
+      g.reset_state = false;
+    }
+    return std::nullopt;
+  }
+  if ((command & 0xe0) == 0x40) {
+    // STORE DTR AS SCENE, REMOVE FROM SCENE
+    g.scenes[command & 0x0f] = (command & 0x10) ? libdali::DA_MASK : g.dtr0;
+    return std::nullopt;
+  }
+  if ((command & 0xf0) == 0xb0) { // QUERY SCENE LEVEL
+    return g.scenes[command & 0x0f];
+  }
+  if ((command & 0xe0) == 0x60) {
+    // ADD TO GROUP, REMOVE FROM GROUP
+    uint16_t group = 1 << (command & 0x0f);
+    g.groups = (command & 0x10) ? (g.groups & ~group) : (g.groups | group);
+    return std::nullopt;
+  }
+  switch (command) {
+  case 0x00: // OFF
+    g.actual_level = 0;
+    break;
+  case 0x05: // RECALL MAX LEVEL
+    g.actual_level = 254;
+    break;
+  case 0x06: // RECALL MIN LEVEL
+    g.actual_level = 1;
+    break;
+  case 0x20: // RESET
+    g.actual_level = 254;
+    g.reset_state = true;
+    break;
+  case 0x21: // STORE ACTUAL LEVEL IN DTR0
+    g.dtr0 = g.actual_level;
+    break;
+  case 0x2e: // SET FADE TIME
+    g.fade_time = g.dtr0 > 15 ? 15 : g.dtr0;
+    break;
+  case 0x30: // SET EXTENDED FADE TIME
+    g.extended_fade_time = g.dtr0 > 0x4f ? 0 : g.dtr0;
+    break;
+  case 0x80: // SET SHORT ADDRESS
+    if (g.dtr0 == libdali::DA_MASK) {
+      g.short_address = SIM_NO_SHORT_ADDRESS;
+    } else if ((g.dtr0 & 0x81) == 0x01) {
+      g.short_address = (g.dtr0 >> 1) & 0x3f;
+    }
+    break;
+  case 0x90: // QUERY STATUS
+    return g.status();
+  case 0x91: // QUERY CONTROL GEAR PRESENT
+    return 0xff;
+  case 0x98: // QUERY CONTENT DTR0
+    return g.dtr0;
+  case 0x99: // QUERY DEVICE TYPE
+    return 6;
+  case 0x9c: // QUERY CONTENT DTR1
+    return g.dtr1;
+  case 0xa0: // QUERY ACTUAL LEVEL
+    return g.actual_level;
+  case 0xa5: // QUERY FADE TIME/FADE RATE
+    return static_cast<uint8_t>((g.fade_time << 4) | 7);
+  case 0xa8: // QUERY EXTENDED FADE TIME
+    return g.extended_fade_time;
+  case 0xc0: // QUERY GROUPS 0-7
+    return static_cast<uint8_t>(g.groups);
+  case 0xc1: // QUERY GROUPS 8-15
+    return static_cast<uint8_t>(g.groups >> 8);
+  case 0xc2: // QUERY RANDOM ADDRESS (H)
+    if (g.dali1) {
+      return std::nullopt;
+    }
+    return (g.random_address >> 16) & 0xff;
+  case 0xc3: // QUERY RANDOM ADDRESS (M)
+    if (g.dali1) {
+      return std::nullopt;
+    }
+    return (g.random_address >> 8) & 0xff;
+  case 0xc4: // QUERY RANDOM ADDRESS (L)
+    if (g.dali1) {
+      return std::nullopt;
+    }
+    return g.random_address & 0xff;
+  case 0xc5: { // READ MEMORY LOCATION
+    if (g.dtr1 != 0 || g.dtr0 >= g.bank0.size()) {
+      return std::nullopt;
+    }
+    if (g.bank0_silent.test(g.dtr0++)) {
+      return std::nullopt;
+    }
+    return g.bank0[g.dtr0 - 1];
+  }
+  case 0xe3: // SELECT DIMMING CURVE
+    g.dimming_curve = g.dtr0;
+    break;
+  case 0xed: // QUERY GEAR TYPE
+    return 0x01;
+  case 0xee: // QUERY DIMMING CURVE
+    return g.dimming_curve;
+  case 0xef: // QUERY POSSIBLE OPERATING MODES
+    return 0x01;
+  case 0xfc: // QUERY OPERATING MODE
+    return g.dimming_curve == 1 ? 0x10 : 0x00;
+  }
+  return std::nullopt;
+}
+
+std::optional<uint8_t> SimBus::special_(SimGear &g, uint8_t address,
+                                        uint8_t data) {
+  bool initialised = g.initialised(this->now_us);
+  bool selected = initialised && g.random_address == g.search_address;
+  switch (address) {
+  case 0xa1: // TERMINATE
+    g.initialised_until = 0;
+    break;
+  case 0xa3: // DTR0
+    g.dtr0 = data;
+    break;
+  case 0xa5: // INITIALISE
+    if (data == 0x00 ||
+        (data == 0xff && g.short_address == SIM_NO_SHORT_ADDRESS) ||
+        ((data & 0x81) == 0x01 && ((data >> 1) & 0x3f) == g.short_address)) {
+      g.initialised_until = this->now_us + SIM_INITIALISE_US;
+      g.withdrawn = false;
+    }
+    break;
+  case 0xa7: // RANDOMISE
+    if (initialised) {
+      g.random_address = this->rng_() & 0xffffff;
+    }
+    break;
+  case 0xa9: // COMPARE
+    if (initialised && !g.withdrawn &&
+        g.random_address <= g.search_address) {
+      return 0xff;
+    }
+    break;
+  case 0xab: // WITHDRAW
+    if (selected) {
+      g.withdrawn = true;
+    }
+    break;
+  case 0xb1: // SEARCHADDRH
+  case 0xb3: // SEARCHADDRM
+  case 0xb5: { // SEARCHADDRL
+    if (initialised) {
+      auto shift = (0xb5 - address) * 4;
+      g.search_address &= ~(0xffu << shift);
+      g.search_address |= static_cast<uint32_t>(data) << shift;
+    }
+    break;
+  }
+  case 0xb7: // PROGRAM SHORT ADDRESS
+    if (selected) {
+      g.short_address =
+          data == libdali::DA_MASK ? SIM_NO_SHORT_ADDRESS : (data >> 1) & 0x3f;
+    }
+    break;
+  case 0xb9: // VERIFY SHORT ADDRESS
+    if (initialised && g.short_address == ((data >> 1) & 0x3f)) {
+      return 0xff;
+    }
+    break;
+  case 0xbb: // QUERY SHORT ADDRESS
+    if (selected) {
+      return g.short_address == SIM_NO_SHORT_ADDRESS
+                 ? libdali::DA_MASK
+                 : static_cast<uint8_t>((g.short_address << 1) | 0x01);
+    }
+    break;
+  case 0xc3: // DTR1
+    g.dtr1 = data;
+    break;
+  case 0xc5: // DTR2
+    g.dtr2 = data;
+    break;
+  }
+  return std::nullopt;
+}
+
+libdali::ErrorCode SimBus::DaliCommand(uint8_t address, uint8_t data,
+                                       uint8_t *reply, size_t reply_length,
+                                       uint32_t /*timeout_ms*/) {
+  auto start = this->now_us;
+  this->now_us += SIM_FORWARD_FRAME_US;
+  auto backward = this->process(address, data);
+  if (backward.kind == SimBackward::NONE) {
+    this->now_us += SIM_REPLY_WINDOW_US;
+  } else {
+    this->now_us +=
+        SIM_BACKWARD_DELAY_US + SIM_BACKWARD_FRAME_US + SIM_SETTLING_US;
+  }
+  this->bus_time_us += this->now_us - start;
+
+  if (backward.kind == SimBackward::COLLISION) {
+    return libdali::ErrorCode::FRAME_ERROR;
+  }
+  if (reply_length == 0) {
+    return libdali::ErrorCode::OK;
+  }
+  if (backward.kind == SimBackward::NONE) {
+    return libdali::ErrorCode::TIMEOUT;
+  }
+  reply[0] = backward.value;
+  return libdali::ErrorCode::OK;
+}
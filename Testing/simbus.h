@@ -0,0 +1,102 @@
+#pragma once
+#include "dali.h"
+#include <array>
+#include <bitset>
+#include <random>
+#include <vector>
+
+// DALI bus timing, derived from the bit time Te = 416.67us.
+constexpr uint64_t sim_te_us(uint64_t te) { return te * 416667 / 1000; }
+constexpr uint64_t SIM_FORWARD_FRAME_US = sim_te_us(38);
+// Start of a backward frame after the forward frame, spec allows 7-22 Te.
+constexpr uint64_t SIM_BACKWARD_DELAY_US = sim_te_us(12);
+constexpr uint64_t SIM_BACKWARD_FRAME_US = sim_te_us(22);
+// A backward frame has to start within this window after the forward frame.
+constexpr uint64_t SIM_REPLY_WINDOW_US = sim_te_us(22);
+// Minimum idle time before the next forward frame.
+constexpr uint64_t SIM_SETTLING_US = sim_te_us(22);
+// Gear accepts addressing commands for 15 minutes after INITIALISE.
+constexpr uint64_t SIM_INITIALISE_US = 15ull * 60 * 1000 * 1000;
+// Configuration commands have to be repeated within 100ms.
+constexpr uint64_t SIM_SEND_TWICE_US = 100 * 1000;
+
+constexpr uint8_t SIM_NO_SHORT_ADDRESS = 0xff;
+
+// State of one virtual control gear.
+struct SimGear {
+  uint32_t random_address = 0xffffff;
+  uint32_t search_address = 0xffffff;
+  uint8_t short_address = SIM_NO_SHORT_ADDRESS;
+  uint8_t dtr0 = 0, dtr1 = 0, dtr2 = 0;
+  uint8_t actual_level = 254;
+  uint8_t dimming_curve = 0;
+  uint8_t fade_time = 0, extended_fade_time = 0;
+  // Bit n for group n.
+  uint16_t groups = 0;
+  // Level per scene, MASK if not part of the scene.
+  std::array<uint8_t, 16> scenes = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                    0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                    0xff, 0xff, 0xff, 0xff};
+  bool lamp_failure = false;
+  bool power_failure = true;
+  bool reset_state = true;
+  // Initialisation state, entered by INITIALISE.
+  uint64_t initialised_until = 0;
+  bool withdrawn = false;
+  std::array<uint8_t, 0x1b> bank0 = {};
+  // Locations of bank 0 that are not implemented and do not answer, the
+  // reserved location 0x01 of DALI-2 gear.
+  std::bitset<0x1b> bank0_silent{1 << 0x01};
+  // DALI-1 gear does not answer the queries added by DALI-2, like QUERY
+  // RANDOM ADDRESS.
+  bool dali1 = false;
+
+  bool initialised(uint64_t now) const { return now < initialised_until; }
+  uint8_t status() const;
+};
+
+// Outcome of a forward frame on the bus.
+struct SimBackward {
+  enum kind_t { NONE, REPLY, COLLISION };
+  kind_t kind = NONE;
+  uint8_t value = 0;
+};
+
+// Simulated DALI bus with a population of control gear on a virtual clock.
+// Commands take the time they would take on a real bus, without sleeping.
+class SimBus : public libdali::BusInterface {
+public:
+  explicit SimBus(size_t gear_count, uint32_t seed = 1);
+
+  // Give the gear the short addresses 0..N-1.
+  void assign_short_addresses();
+  // Apply a forward frame to all gear, without advancing the clock.
+  SimBackward process(uint8_t address, uint8_t data);
+
+  libdali::ErrorCode DaliCommand(uint8_t address, uint8_t data, uint8_t *reply,
+                                 size_t reply_length,
+                                 uint32_t timeout_ms = 150) override;
+  void delay_microseconds(uint32_t us) override { this->now_us += us; }
+  uint32_t now_ms() override { return static_cast<uint32_t>(now_us / 1000); }
+
+  std::vector<SimGear> gear;
+  // Virtual time, advanced by frames and delays.
+  uint64_t now_us = 0;
+  // Time frames occupied the bus.
+  uint64_t bus_time_us = 0;
+  size_t forward_frames = 0;
+  size_t backward_frames = 0;
+  size_t collisions = 0;
+
+protected:
+  bool addressed_(const SimGear &g, uint8_t address) const;
+  bool send_twice_(uint8_t address, uint8_t data);
+  std::optional<uint8_t> command_(SimGear &g, uint8_t command);
+  std::optional<uint8_t> special_(SimGear &g, uint8_t address, uint8_t data);
+
+  std::mt19937 rng_;
+  // Last frame, for send twice configuration commands.
+  uint8_t last_address_ = 0, last_data_ = 0;
+  uint64_t last_us_ = 0;
+  bool twice_ = false;
+};
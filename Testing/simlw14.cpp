@@ -0,0 +1,139 @@
+#include "simlw14.h"
+
+namespace {
+constexpr uint8_t REGISTER_STATUS = 0x00;
+constexpr uint8_t REGISTER_COMMAND = 0x01;
+constexpr uint8_t REGISTER_CONFIG = 0x02;
+constexpr uint8_t REGISTER_SIGNATURE = 0xf0;
+constexpr uint8_t REGISTER_ADDRESS = 0xfe;
+} // namespace
+
+void SimLW14::transaction_(size_t bytes) {
+  this->i2c_transactions++;
+  this->bus.now_us += bytes * this->i2c_byte_us;
+}
+
+void SimLW14::inject_telegram(uint8_t value) {
+  if (this->valid_reply_) {
+    this->overrun_ = true;
+  }
+  this->valid_reply_ = true;
+  this->telegram_[0] = value;
+  this->telegram_length_ = 1;
+}
+
+void SimLW14::inject_forward(uint8_t address, uint8_t data) {
+  this->inject_telegram(address);
+  this->telegram_[1] = data;
+  this->telegram_length_ = 2;
+}
+
+// Deliver the backward frame once it has been received completely.
+void SimLW14::update_() {
+  if (!this->frame_ || this->delivered_ ||
+      this->bus.now_us < this->frame_end_us_) {
+    return;
+  }
+  this->delivered_ = true;
+  if (this->backward_.kind == SimBackward::COLLISION) {
+    this->frame_error_ = true;
+  } else if (this->backward_.kind == SimBackward::REPLY) {
+    this->inject_telegram(this->backward_.value);
+  }
+}
+
+uint8_t SimLW14::status() {
+  this->update_();
+  auto now = this->bus.now_us;
+  bool busy = this->force_busy;
+  bool reply_timeframe = false;
+  if (this->frame_) {
+    busy |= now < this->forward_end_us_;
+    // Receiving the backward frame.
+    busy |= this->backward_.kind != SimBackward::NONE &&
+            now >= this->forward_end_us_ + SIM_BACKWARD_DELAY_US &&
+            now < this->frame_end_us_;
+    reply_timeframe = now >= this->forward_end_us_ &&
+                      now < this->forward_end_us_ + SIM_REPLY_WINDOW_US;
+  }
+
+  uint8_t status = 0;
+  // Byte count of the received telegram.
+  status |= this->valid_reply_ ? this->telegram_length_ : 0;
+  status |= reply_timeframe ? 0x04 : 0;
+  status |= this->valid_reply_ ? 0x08 : 0;
+  status |= this->frame_error_ ? 0x10 : 0;
+  status |= this->overrun_ ? 0x20 : 0;
+  status |= busy ? 0x40 : 0;
+  status |= this->force_bus_error ? 0x80 : 0;
+  return status;
+}
+
+libdali::I2CResult SimLW14::write_register(uint8_t i2c_register, uint8_t *data,
+                                           size_t len) {
+  this->transaction_(2 + len);
+  switch (i2c_register) {
+  case REGISTER_COMMAND: {
+    if (len != 2) {
+      return libdali::I2CResult::ERROR;
+    }
+    auto now = this->bus.now_us;
+    auto start = now;
+    if (this->frame_) {
+      if (now < this->frame_end_us_) {
+        this->writes_while_busy++;
+      }
+      // The LW14 keeps the settling time between frames.
+      auto idle = this->frame_end_us_ + SIM_SETTLING_US;
+      start = idle > now ? idle : now;
+    }
+    this->frame_ = true;
+    this->forward_end_us_ = start + SIM_FORWARD_FRAME_US;
+    this->backward_ = this->bus.process(data[0], data[1]);
+    this->frame_end_us_ =
+        this->forward_end_us_ +
+        (this->backward_.kind == SimBackward::NONE
+             ? SIM_REPLY_WINDOW_US
+             : SIM_BACKWARD_DELAY_US + SIM_BACKWARD_FRAME_US);
+    this->bus.bus_time_us += this->frame_end_us_ - start;
+    this->delivered_ = false;
+    this->frame_error_ = false;
+    return libdali::I2CResult::OK;
+  }
+  case REGISTER_CONFIG:
+    this->config = data[0];
+    return libdali::I2CResult::OK;
+  }
+  return libdali::I2CResult::ERROR;
+}
+
+libdali::I2CResult SimLW14::read_register(uint8_t i2c_register, uint8_t *data,
+                                          size_t len) {
+  this->transaction_(3 + len);
+  if (len == 0) {
+    return libdali::I2CResult::ERROR;
+  }
+  switch (i2c_register) {
+  case REGISTER_STATUS:
+    data[0] = this->status();
+    return libdali::I2CResult::OK;
+  case REGISTER_COMMAND:
+    this->update_();
+    for (size_t i = 0; i < len && i < this->telegram_.size(); i++) {
+      data[i] = this->telegram_[i];
+    }
+    this->valid_reply_ = false;
+    this->overrun_ = false;
+    return libdali::I2CResult::OK;
+  case REGISTER_CONFIG:
+    data[0] = this->config;
+    return libdali::I2CResult::OK;
+  case REGISTER_SIGNATURE:
+    data[0] = 0x14;
+    return libdali::I2CResult::OK;
+  case REGISTER_ADDRESS:
+    data[0] = libdali::LW14_DEFAULT_ADDRESS;
+    return libdali::I2CResult::OK;
+  }
+  return libdali::I2CResult::ERROR;
+}
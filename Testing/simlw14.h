@@ -0,0 +1,69 @@
+#pragma once
+#include "lw14.h"
+#include "simbus.h"
+
+// Register level emulation of the LW14 on top of a SimBus. Shares the virtual
+// clock of the SimBus, I2C transactions and frames advance it by their
+// duration. Lets LW14Adapter run without hardware.
+class SimLW14 final : public libdali::I2CInterface {
+public:
+  explicit SimLW14(SimBus &bus) : bus(bus) {}
+
+  libdali::I2CResult write_register(uint8_t i2c_register, uint8_t *data,
+                                    size_t len) override;
+  libdali::I2CResult read_register(uint8_t i2c_register, uint8_t *data,
+                                   size_t len) override;
+  void delay_microseconds(uint32_t us) override { this->bus.now_us += us; }
+  uint32_t millis() override {
+    return static_cast<uint32_t>(this->bus.now_us / 1000);
+  }
+
+  // A telegram received from another master, waiting in the COMMAND register.
+  void inject_telegram(uint8_t value);
+  // The forward frame of another master, reported as a two byte telegram.
+  // The gear of the SimBus do not see it.
+  void inject_forward(uint8_t address, uint8_t data);
+  uint8_t status();
+
+  // Virtual time and I2C transactions used by f().
+  struct Cost {
+    uint64_t time_us;
+    size_t i2c_transactions;
+  };
+  template <typename F> Cost measure(F &&f) {
+    auto start_us = this->bus.now_us;
+    auto start_transactions = this->i2c_transactions;
+    f();
+    return Cost{.time_us = this->bus.now_us - start_us,
+                .i2c_transactions = this->i2c_transactions - start_transactions};
+  }
+
+  SimBus &bus;
+  // Time of one byte on the I2C bus, 100kHz by default.
+  uint64_t i2c_byte_us = 90;
+  size_t i2c_transactions = 0;
+  // Commands written while a frame was still on the bus.
+  size_t writes_while_busy = 0;
+  // Keep the bus busy, e.g. another master sending.
+  bool force_busy = false;
+  // Report a bus error, e.g. missing bus power.
+  bool force_bus_error = false;
+  uint8_t config = 0;
+
+protected:
+  void update_();
+  void transaction_(size_t bytes);
+
+  // Current frame, times in virtual microseconds.
+  bool frame_ = false;
+  uint64_t forward_end_us_ = 0;
+  uint64_t frame_end_us_ = 0;
+  SimBackward backward_;
+  bool delivered_ = true;
+  // Telegram register state.
+  bool valid_reply_ = false;
+  bool frame_error_ = false;
+  bool overrun_ = false;
+  std::array<uint8_t, 2> telegram_{};
+  uint8_t telegram_length_ = 0;
+};
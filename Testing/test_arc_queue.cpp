@@ -0,0 +1,253 @@
+#include <catch2/catch_test_macros.hpp>
+#include "arc_queue.h"
+
+TEST_CASE("Arc queue") {
+  libdali::ArcQueue queue;
+
+  SECTION("latest level wins") {
+    REQUIRE(queue.push(3, 10));
+    REQUIRE(queue.push(3, 20));
+    REQUIRE(queue.push(3, 30));
+    auto entry = queue.pop();
+    REQUIRE(entry);
+    REQUIRE(static_cast<int>(entry->short_address) == 3);
+    REQUIRE(static_cast<int>(entry->level) == 30);
+    REQUIRE(!queue.pop());
+    REQUIRE(queue.empty());
+  }
+
+  SECTION("skip known level") {
+    queue.set_level(3, 30);
+    REQUIRE(!queue.push(3, 30));
+    REQUIRE(!queue.pop());
+
+    REQUIRE(queue.push(3, 40));
+    REQUIRE(!queue.push(3, 30));
+    REQUIRE(!queue.pop());
+  }
+
+  SECTION("skip last sent level") {
+    REQUIRE(queue.push(3, 30));
+    auto entry = queue.pop();
+    REQUIRE(entry);
+    queue.sent(*entry, libdali::ErrorCode::OK);
+    REQUIRE(!queue.push(3, 30));
+    REQUIRE(static_cast<int>(queue.level(3).value_or(0)) == 30);
+  }
+
+  SECTION("failed frame is resent") {
+    REQUIRE(queue.push(3, 30));
+    auto entry = queue.pop();
+    REQUIRE(entry);
+    queue.sent(*entry, libdali::ErrorCode::TIMEOUT);
+    REQUIRE(!queue.level(3));
+    REQUIRE(queue.push(3, 30));
+  }
+
+  SECTION("retry keeps a newer level") {
+    REQUIRE(queue.push(3, 30));
+    REQUIRE(queue.push(4, 30));
+    auto first = queue.pop();
+    auto second = queue.pop();
+    queue.sent(*first, libdali::ErrorCode::BUS_BUSY);
+    queue.sent(*second, libdali::ErrorCode::BUS_BUSY);
+    REQUIRE(queue.push(4, 40));
+    queue.retry(*first);
+    queue.retry(*second);
+    auto entry = queue.pop();
+    REQUIRE(static_cast<int>(entry->short_address) == 3);
+    REQUIRE(static_cast<int>(entry->level) == 30);
+    entry = queue.pop();
+    REQUIRE(static_cast<int>(entry->short_address) == 4);
+    REQUIRE(static_cast<int>(entry->level) == 40);
+    REQUIRE(queue.empty());
+  }
+
+  SECTION("retry does not undo a newer level sent since the failure") {
+    REQUIRE(queue.push(3, 30));
+    auto failed = queue.pop();
+    queue.sent(*failed, libdali::ErrorCode::BUS_BUSY);
+    // A newer level is sent while the retry waits for its backoff.
+    REQUIRE(queue.push(3, 40));
+    auto newer = queue.pop();
+    REQUIRE(static_cast<int>(newer->level) == 40);
+    queue.sent(*newer, libdali::ErrorCode::OK);
+    REQUIRE(!queue.retry(*failed));
+    REQUIRE(queue.empty());
+    REQUIRE(static_cast<int>(queue.level(3).value_or(0)) == 40);
+  }
+
+  SECTION("group retry skips members with a newer level") {
+    queue.add_group_member(2, 3);
+    queue.add_group_member(2, 4);
+    REQUIRE(queue.push_group(2, 30));
+    auto failed = queue.pop();
+    queue.sent(*failed, libdali::ErrorCode::BUS_BUSY);
+    REQUIRE(queue.push(4, 40));
+    auto newer = queue.pop();
+    queue.sent(*newer, libdali::ErrorCode::OK);
+    REQUIRE(queue.retry(*failed));
+    auto entry = queue.pop();
+    REQUIRE(static_cast<int>(entry->short_address) == 3);
+    REQUIRE(static_cast<int>(entry->level) == 30);
+    REQUIRE(queue.empty());
+  }
+
+  SECTION("DirectArc mapping of mask") {
+    REQUIRE(queue.push(3, 255));
+    REQUIRE(static_cast<int>(queue.pop()->level) == 254);
+  }
+
+  SECTION("round robin") {
+    REQUIRE(queue.push(5, 1));
+    REQUIRE(queue.push(1, 1));
+    REQUIRE(static_cast<int>(queue.pop()->short_address) == 1);
+    REQUIRE(queue.push(1, 2));
+    REQUIRE(static_cast<int>(queue.pop()->short_address) == 5);
+    REQUIRE(static_cast<int>(queue.pop()->short_address) == 1);
+  }
+}
+
+TEST_CASE("Arc queue broadcast collapse") {
+  libdali::ArcQueue queue;
+  queue.set_broadcast_collapse(true);
+  for (uint8_t short_address = 0; short_address < 4; short_address++) {
+    queue.add_gear(short_address);
+    queue.set_level(short_address, 100);
+  }
+
+  SECTION("all lights to the same level") {
+    for (uint8_t short_address = 0; short_address < 4; short_address++) {
+      REQUIRE(queue.push(short_address, 0));
+    }
+    auto entry = queue.pop();
+    REQUIRE(entry);
+    REQUIRE(static_cast<int>(entry->short_address) ==
+            libdali::ArcQueue::BROADCAST);
+    REQUIRE(static_cast<int>(entry->address().dacp()) == 0xfe);
+    REQUIRE(static_cast<int>(entry->level) == 0);
+    REQUIRE(!queue.pop());
+    for (uint8_t short_address = 0; short_address < 4; short_address++) {
+      REQUIRE(static_cast<int>(queue.level(short_address).value_or(1)) == 0);
+    }
+  }
+
+  SECTION("lights already at the level") {
+    REQUIRE(queue.push(0, 0));
+    REQUIRE(queue.push(1, 0));
+    queue.set_level(2, 0);
+    queue.set_level(3, 0);
+    REQUIRE(static_cast<int>(queue.pop()->short_address) ==
+            libdali::ArcQueue::BROADCAST);
+  }
+
+  SECTION("different levels") {
+    REQUIRE(queue.push(0, 0));
+    REQUIRE(queue.push(1, 0));
+    REQUIRE(queue.push(2, 0));
+    REQUIRE(static_cast<int>(queue.pop()->short_address) == 0);
+  }
+
+  SECTION("failed broadcast") {
+    for (uint8_t short_address = 0; short_address < 4; short_address++) {
+      REQUIRE(queue.push(short_address, 0));
+    }
+    auto entry = queue.pop();
+    queue.sent(*entry, libdali::ErrorCode::BUS_ERROR);
+    REQUIRE(!queue.level(0));
+    REQUIRE(!queue.level(3));
+  }
+}
+
+TEST_CASE("Arc queue fade") {
+  libdali::ArcQueue queue;
+  queue.set_broadcast_collapse(true);
+  for (uint8_t short_address = 0; short_address < 2; short_address++) {
+    queue.add_gear(short_address);
+    queue.set_level(short_address, 100);
+  }
+
+  SECTION("entry carries the fade") {
+    REQUIRE(queue.push(0, 0, 0x21));
+    REQUIRE(queue.push(0, 10, 0x13));
+    auto entry = queue.pop();
+    REQUIRE(static_cast<int>(entry->level) == 10);
+    REQUIRE(static_cast<int>(entry->fade) == 0x13);
+  }
+
+  SECTION("broadcast only with the same fade") {
+    REQUIRE(queue.push(0, 0, 0x21));
+    REQUIRE(queue.push(1, 0, 0x21));
+    auto entry = queue.pop();
+    REQUIRE(static_cast<int>(entry->short_address) ==
+            libdali::ArcQueue::BROADCAST);
+    REQUIRE(static_cast<int>(entry->fade) == 0x21);
+
+    REQUIRE(queue.push(0, 50, 0x21));
+    REQUIRE(queue.push(1, 50, 0));
+    REQUIRE(static_cast<int>(queue.pop()->short_address) == 0);
+  }
+}
+
+TEST_CASE("Arc queue groups") {
+  libdali::ArcQueue queue;
+  for (uint8_t short_address = 0; short_address < 4; short_address++) {
+    queue.add_gear(short_address);
+    queue.set_level(short_address, 100);
+  }
+  queue.add_group_member(2, 1);
+  queue.add_group_member(2, 2);
+
+  SECTION("one entry for the group") {
+    REQUIRE(queue.push_group(2, 0));
+    auto entry = queue.pop();
+    REQUIRE(entry);
+    REQUIRE(static_cast<int>(entry->address().dacp()) == 0x84);
+    REQUIRE(queue.targets(*entry) == std::bitset<libdali::ArcQueue::SIZE>(6));
+    REQUIRE(!queue.pop());
+    REQUIRE(static_cast<int>(queue.level(1).value_or(1)) == 0);
+    REQUIRE(static_cast<int>(queue.level(2).value_or(1)) == 0);
+    REQUIRE(static_cast<int>(queue.level(3).value_or(1)) == 100);
+  }
+
+  SECTION("skip members already at the level") {
+    REQUIRE(!queue.push_group(2, 100));
+    REQUIRE(queue.empty());
+  }
+
+  SECTION("group replaces levels queued before") {
+    REQUIRE(queue.push(1, 50));
+    REQUIRE(queue.push_group(2, 0));
+    REQUIRE(static_cast<int>(queue.pop()->short_address) ==
+            (libdali::ArcQueue::GROUP | 2));
+    REQUIRE(!queue.pop());
+  }
+
+  SECTION("levels queued after the group follow it") {
+    REQUIRE(queue.push_group(2, 0));
+    REQUIRE(queue.push(1, 50));
+    REQUIRE(static_cast<int>(queue.pop()->short_address) ==
+            (libdali::ArcQueue::GROUP | 2));
+    auto entry = queue.pop();
+    REQUIRE(static_cast<int>(entry->short_address) == 1);
+    REQUIRE(static_cast<int>(entry->level) == 50);
+  }
+
+  SECTION("group without known members") {
+    REQUIRE(queue.push_group(5, 100));
+    auto entry = queue.pop();
+    REQUIRE(entry);
+    REQUIRE(static_cast<int>(entry->short_address) ==
+            (libdali::ArcQueue::GROUP | 5));
+    REQUIRE(static_cast<int>(entry->level) == 100);
+    REQUIRE(queue.push_group(5, 100));
+  }
+
+  SECTION("failed group frame is resent") {
+    REQUIRE(queue.push_group(2, 0));
+    auto entry = queue.pop();
+    queue.sent(*entry, libdali::ErrorCode::TIMEOUT);
+    REQUIRE(!queue.level(1));
+    REQUIRE(queue.push_group(2, 0));
+  }
+}
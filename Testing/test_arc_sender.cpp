@@ -0,0 +1,164 @@
+#include <catch2/catch_test_macros.hpp>
+#include "arc_sender.h"
+#include "simlw14.h"
+#include <utility>
+
+using namespace libdali;
+
+// Polls the sender until the entry was sent.
+static ErrorCode run(SimBus &dali, ArcSender &sender) {
+  while (true) {
+    if (auto result = sender.poll()) {
+      return *result;
+    }
+    dali.now_us += 1000;
+  }
+}
+
+TEST_CASE("Extended fade time") {
+  REQUIRE(static_cast<int>(extended_fade_time(0)) == 0);
+  REQUIRE(static_cast<int>(extended_fade_time(100)) == 0x10);
+  REQUIRE(static_cast<int>(extended_fade_time(1600)) == 0x1f);
+  REQUIRE(static_cast<int>(extended_fade_time(2000)) == 0x21);
+  REQUIRE(static_cast<int>(extended_fade_time(90000)) == 0x38);
+  REQUIRE(static_cast<int>(extended_fade_time(3600000)) == 0x4f);
+  for (uint32_t ms : {100u, 700u, 1000u, 5000u, 60000u, 960000u}) {
+    REQUIRE(extended_fade_time_ms(extended_fade_time(ms)) == ms);
+  }
+}
+
+TEST_CASE("Arc sender") {
+  SimBus dali(2);
+  dali.assign_short_addresses();
+  dali.gear[0].fade_time = 3;
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  ArcSender sender(&bus, &inventory);
+  std::bitset<Inventory::SHORT_ADDRESSES> gear0("01"), lights("11");
+  auto fade = extended_fade_time(2000);
+
+  sender.send(ArcQueue::Entry{.short_address = 0, .level = 100, .fade = fade},
+              gear0);
+  REQUIRE(sender.busy());
+  REQUIRE(!run(dali, sender));
+  REQUIRE(!sender.busy());
+
+  SECTION("programs the fade time once") {
+    REQUIRE(static_cast<int>(sender.frames()) == 7);
+    REQUIRE(static_cast<int>(dali.gear[0].fade_time) == 0);
+    REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == fade);
+    REQUIRE(static_cast<int>(dali.gear[0].actual_level) == 100);
+    REQUIRE(static_cast<int>(inventory.gear(0).extended_fade_time) == fade);
+    REQUIRE(static_cast<int>(inventory.gear(0).level) == 100);
+
+    sender.send(ArcQueue::Entry{.short_address = 0, .level = 50, .fade = fade},
+                gear0);
+    REQUIRE(!run(dali, sender));
+    REQUIRE(static_cast<int>(sender.frames()) == 1);
+    REQUIRE(static_cast<int>(dali.gear[0].actual_level) == 50);
+  }
+
+  SECTION("reprograms a changed fade") {
+    sender.send(ArcQueue::Entry{.short_address = 0, .level = 50, .fade = 0},
+                gear0);
+    REQUIRE(!run(dali, sender));
+    REQUIRE(static_cast<int>(sender.frames()) == 4);
+    REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == 0);
+  }
+
+  SECTION("keeps a short fade for changes without fade") {
+    auto short_fade = extended_fade_time(ArcSender::SHORT_FADE_MS);
+    sender.send(
+        ArcQueue::Entry{.short_address = 0, .level = 50, .fade = short_fade},
+        gear0);
+    REQUIRE(!run(dali, sender));
+    REQUIRE(static_cast<int>(sender.frames()) == 4);
+
+    sender.send(ArcQueue::Entry{.short_address = 0, .level = 20, .fade = 0},
+                gear0);
+    REQUIRE(!run(dali, sender));
+    REQUIRE(static_cast<int>(sender.frames()) == 1);
+    REQUIRE(static_cast<int>(dali.gear[0].actual_level) == 20);
+    REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == short_fade);
+    REQUIRE(static_cast<int>(inventory.gear(0).extended_fade_time) ==
+            short_fade);
+  }
+
+  SECTION("broadcast programs all lights") {
+    sender.send(ArcQueue::Entry{.short_address = ArcQueue::BROADCAST,
+                                .level = 0,
+                                .fade = fade},
+                lights);
+    REQUIRE(!run(dali, sender));
+    REQUIRE(static_cast<int>(sender.frames()) == 7);
+    for (uint8_t i = 0; i < 2; i++) {
+      REQUIRE(static_cast<int>(dali.gear[i].extended_fade_time) == fade);
+      REQUIRE(static_cast<int>(inventory.gear(i).extended_fade_time) == fade);
+      REQUIRE(static_cast<int>(inventory.gear(i).level) == 0);
+    }
+  }
+
+  SECTION("failure forgets the fade time") {
+    lw14.force_bus_error = true;
+    sender.send(ArcQueue::Entry{.short_address = 0, .level = 50, .fade = 0},
+                gear0);
+    REQUIRE(run(dali, sender));
+    REQUIRE(static_cast<int>(inventory.gear(0).extended_fade_time) == DA_MASK);
+  }
+}
+
+TEST_CASE("Arc sender with late polls") {
+  SimBus dali(1);
+  dali.assign_short_addresses();
+  dali.gear[0].fade_time = 3;
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  ArcSender sender(&bus, &inventory);
+  std::bitset<Inventory::SHORT_ADDRESSES> gear0("01");
+  auto fade = extended_fade_time(2000);
+  // Polls the sender, `late` decides by the frames sent so far whether the
+  // next poll comes 150ms late.
+  auto run_late = [&](auto late) {
+    while (true) {
+      if (auto result = sender.poll()) {
+        return *result;
+      }
+      dali.now_us += late(dali.forward_frames) ? 150000 : 1000;
+    }
+  };
+
+  SECTION("a pair that was not finished in time is sent again") {
+    sender.send(
+        ArcQueue::Entry{.short_address = 0, .level = 100, .fade = fade},
+        gear0);
+    bool delayed = false;
+    REQUIRE(!run_late([&](size_t frames) {
+      // After the first SET FADE TIME.
+      return frames == 2 && !std::exchange(delayed, true);
+    }));
+    REQUIRE(static_cast<int>(sender.pair_repeats()) == 1);
+    REQUIRE(dali.forward_frames == 7 + 2);
+    REQUIRE(static_cast<int>(dali.gear[0].fade_time) == 0);
+    REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == fade);
+    REQUIRE(static_cast<int>(inventory.gear(0).extended_fade_time) == fade);
+  }
+
+  SECTION("the fade stays unknown if the pair is always late") {
+    sender.send(
+        ArcQueue::Entry{.short_address = 0, .level = 100, .fade = fade},
+        gear0);
+    // After every first SET FADE TIME.
+    REQUIRE(!run_late([](size_t frames) {
+      return frames == 2 || frames == 4 || frames == 6;
+    }));
+    REQUIRE(static_cast<int>(sender.pair_repeats()) ==
+            ArcSender::MAX_PAIR_REPEATS);
+    REQUIRE(static_cast<int>(dali.gear[0].fade_time) == 3);
+    REQUIRE(static_cast<int>(dali.gear[0].actual_level) == 100);
+    REQUIRE(static_cast<int>(inventory.gear(0).level) == 100);
+    REQUIRE(static_cast<int>(inventory.gear(0).extended_fade_time) ==
+            DA_MASK);
+  }
+}
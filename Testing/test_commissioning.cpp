@@ -0,0 +1,98 @@
+#include <catch2/catch_test_macros.hpp>
+#include "commissioning.h"
+#include "simbus.h"
+#include <set>
+
+using namespace libdali;
+
+TEST_CASE("Full commissioning") {
+  SimBus bus(16);
+  bus.assign_short_addresses();
+  Commissioning commissioning(&bus);
+  REQUIRE(!commissioning.run(CommissioningMode::FULL));
+  REQUIRE(commissioning.added() == 16);
+  REQUIRE(commissioning.unassigned() == 0);
+
+  std::set<uint8_t> short_addresses;
+  for (const auto &g : bus.gear) {
+    short_addresses.insert(g.short_address);
+    REQUIRE(commissioning.gear(g.short_address).random_address ==
+            g.random_address);
+  }
+  REQUIRE(short_addresses.size() == 16);
+  REQUIRE(*short_addresses.rbegin() == 15);
+}
+
+TEST_CASE("Incremental commissioning") {
+  SimBus bus(51);
+  bus.assign_short_addresses();
+  // A replaced gear and a new gear at the end of the line.
+  bus.gear[3].short_address = SIM_NO_SHORT_ADDRESS;
+  bus.gear[50].short_address = SIM_NO_SHORT_ADDRESS;
+
+  Commissioning commissioning(&bus);
+  REQUIRE(!commissioning.run(CommissioningMode::INCREMENTAL));
+  REQUIRE(commissioning.added() == 2);
+
+  SECTION("keeps existing short addresses") {
+    for (size_t i = 0; i < 50; i++) {
+      if (i != 3) {
+        REQUIRE(bus.gear[i].short_address == i);
+        REQUIRE(!commissioning.gear(i).added);
+        REQUIRE(commissioning.gear(i).random_address ==
+                bus.gear[i].random_address);
+      }
+    }
+  }
+
+  SECTION("fills the free short addresses") {
+    std::set<uint8_t> added{bus.gear[3].short_address,
+                            bus.gear[50].short_address};
+    REQUIRE(added == std::set<uint8_t>{3, 50});
+    REQUIRE(commissioning.gear(3).added);
+    REQUIRE(commissioning.gear(50).added);
+  }
+
+  SECTION("is faster than a full commissioning") {
+    SimBus full_bus(51);
+    Commissioning full(&full_bus);
+    REQUIRE(!full.run(CommissioningMode::FULL));
+    REQUIRE(bus.bus_time_us * 4 < full_bus.bus_time_us);
+  }
+}
+
+TEST_CASE("Incremental commissioning of a full line") {
+  SimBus bus(65);
+  bus.assign_short_addresses();
+  bus.gear[64].short_address = SIM_NO_SHORT_ADDRESS;
+  Commissioning commissioning(&bus);
+  REQUIRE(!commissioning.run(CommissioningMode::INCREMENTAL));
+  REQUIRE(commissioning.added() == 0);
+  REQUIRE(commissioning.unassigned() == 1);
+}
+
+TEST_CASE("Incremental commissioning with duplicate short address") {
+  SimBus bus(4);
+  bus.assign_short_addresses();
+  bus.gear[3].short_address = 1;
+  Commissioning commissioning(&bus);
+  REQUIRE(!commissioning.run(CommissioningMode::INCREMENTAL));
+  REQUIRE(commissioning.gear(1).conflict);
+  REQUIRE(commissioning.added() == 0);
+}
+
+TEST_CASE("Incremental commissioning with DALI-1 gear") {
+  SimBus bus(4);
+  bus.assign_short_addresses();
+  bus.gear[1].dali1 = true;
+  bus.gear[3].short_address = SIM_NO_SHORT_ADDRESS;
+  Commissioning commissioning(&bus);
+  REQUIRE(!commissioning.run(CommissioningMode::INCREMENTAL));
+  REQUIRE(commissioning.gear(1).present);
+  REQUIRE(!commissioning.gear(1).random_address);
+  REQUIRE(!commissioning.gear(1).conflict);
+  // The short address of the DALI-1 gear is not given away.
+  REQUIRE(commissioning.added() == 1);
+  REQUIRE(bus.gear[1].short_address == 1);
+  REQUIRE(bus.gear[3].short_address == 3);
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch_test_macros.hpp>
+#include "co_dali.h"
+#include "simlw14.h"
+#include <set>
+
+using namespace libdali;
+
+// A coroutine lambda would refer to its captures after the lambda is gone.
+static Task<ErrorCode> query_level(CoBus &bus, Address address,
+                                   uint8_t *level) {
+  co_return co_await bus.command(address.command(), QueryActualLevel.command,
+                                 level, 1);
+}
+
+// Polls until all started tasks wait for nothing, like CoBus::run().
+static void run_all(CoBus &bus, LW14Adapter &adapter) {
+  while (bus.poll()) {
+    if (auto wait = bus.poll_delay_us()) {
+      adapter.delay_microseconds(wait);
+    }
+  }
+}
+
+TEST_CASE("Coroutine transactions") {
+  SimBus dali(3);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter adapter(&lw14);
+  CoBus bus(&adapter);
+  auto address0 = Address::from_short_address(0);
+  auto address1 = Address::from_short_address(1);
+
+  SECTION("DTR0 and configuration command") {
+    auto task = co::DTR0ConfigCommand(bus, SetExtendedFadeTime, address0, 0x21);
+    REQUIRE(!bus.run(task));
+    REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == 0x21);
+    REQUIRE(static_cast<int>(dali.gear[1].extended_fade_time) == 0);
+    REQUIRE(!bus.locked());
+  }
+
+  SECTION("read memory like the blocking command") {
+    auto task = co::ReadMemory(bus, MemoryBank0GTIN, address1);
+    auto &gtin = bus.run(task);
+    REQUIRE(gtin);
+    auto blocking = MemoryBank0GTIN(&adapter, address1);
+    REQUIRE(blocking);
+    REQUIRE(static_cast<uint64_t>(*gtin) == static_cast<uint64_t>(*blocking));
+  }
+
+  SECTION("sequences of different transactions do not interleave") {
+    auto curve = co::DTR0Command(bus, SelectDimmingCurve, address0, 1);
+    auto fade = co::DTR0ConfigCommand(bus, SetExtendedFadeTime, address1, 0x21);
+    uint8_t level = 0;
+    auto query = query_level(bus, address1, &level);
+    curve.start();
+    fade.start();
+    query.start();
+    // The query does not need the lock and goes in between.
+    while (!query.done()) {
+      bus.poll();
+      REQUIRE(!fade.done());
+      adapter.delay_microseconds(bus.poll_delay_us());
+    }
+    run_all(bus, adapter);
+    REQUIRE(!query.result());
+    REQUIRE(static_cast<int>(level) == 254);
+    REQUIRE(!curve.result());
+    REQUIRE(!fade.result());
+    REQUIRE(static_cast<int>(dali.gear[0].dimming_curve) == 1);
+    REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == 0);
+    REQUIRE(static_cast<int>(dali.gear[1].dimming_curve) == 0);
+    REQUIRE(static_cast<int>(dali.gear[1].extended_fade_time) == 0x21);
+  }
+
+  SECTION("frames are awaited without allocating") {
+    auto before = FramePool::allocations();
+    auto version = co::ReadMemory(bus, MemoryBank0FirmwareVersion, address1);
+    REQUIRE(bus.run(version));
+    auto short_read = FramePool::allocations() - before;
+    before = FramePool::allocations();
+    auto gtin = co::ReadMemory(bus, MemoryBank0GTIN, address1);
+    REQUIRE(bus.run(gtin));
+    // Four more frames, the same coroutine frames.
+    REQUIRE(FramePool::allocations() - before == short_read);
+  }
+
+  SECTION("destroyed transaction") {
+    auto heap = FramePool::heap_allocations();
+    {
+      auto task = co::ReadMemory(bus, MemoryBank0GTIN, address1);
+      task.start();
+      bus.poll();
+      REQUIRE(bus.locked());
+    }
+    // Lock and queue are free again, the frame in flight is collected.
+    REQUIRE(!bus.locked());
+    auto task = co::DTR0Command(bus, SelectDimmingCurve, address0, 1);
+    REQUIRE(!bus.run(task));
+    REQUIRE(static_cast<int>(dali.gear[0].dimming_curve) == 1);
+    REQUIRE(FramePool::heap_allocations() == heap);
+  }
+}
+
+TEST_CASE("Coroutine addressing of new gear") {
+  SimBus dali(6, 3);
+  dali.gear[0].short_address = 0;
+  dali.gear[3].short_address = 2;
+  SimLW14 lw14(dali);
+  LW14Adapter adapter(&lw14);
+  CoBus bus(&adapter);
+
+  std::bitset<Inventory::SHORT_ADDRESSES> used;
+  used.set(0);
+  used.set(2);
+  uint8_t level = 0;
+  auto addressing = co::AddressNewGear(bus, used);
+  auto query = query_level(bus, Address::from_short_address(2), &level);
+  addressing.start();
+  query.start();
+  // The query gets its frame in while the search runs.
+  while (!query.done()) {
+    bus.poll();
+    REQUIRE(!addressing.done());
+    adapter.delay_microseconds(bus.poll_delay_us());
+  }
+  REQUIRE(!query.result());
+  REQUIRE(static_cast<int>(level) == 254);
+  run_all(bus, adapter);
+
+  auto &added = addressing.result();
+  REQUIRE(added);
+  REQUIRE(static_cast<int>(*added) == 4);
+  std::set<uint8_t> addresses;
+  for (const auto &g : dali.gear) {
+    addresses.insert(g.short_address);
+  }
+  REQUIRE(addresses == std::set<uint8_t>{0, 1, 2, 3, 4, 5});
+  REQUIRE(dali.gear[0].short_address == 0);
+  REQUIRE(dali.gear[3].short_address == 2);
+  REQUIRE(!bus.locked());
+}
@@ -1,7 +1,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include "helper.h"
 
-TEST_CASE("- Direct Arc Control") {
+TEST_CASE("Direct Arc Control") {
     Testbus bus;
     const auto address = libdali::Address::from_short_address(10);
 
@@ -130,3 +130,82 @@ TEST_CASE("252: Query operating mode") {
         REQUIRE(!result);
     }
 }
+
+TEST_CASE("Group addressing") {
+    Testbus bus;
+    const auto group = libdali::Address::from_group(5);
+    REQUIRE(static_cast<int>(group.dacp()) == 0x8a);
+    REQUIRE(static_cast<int>(group.command()) == 0x8b);
+    REQUIRE(static_cast<int>(libdali::Address::from_group(15).command()) ==
+            0x9f);
+
+    const auto address = libdali::Address::from_short_address(10);
+    SECTION("Command 101: ADD TO GROUP 5") {
+        REQUIRE(!libdali::AddToGroup(&bus, address, 5));
+        REQUIRE(static_cast<int>(bus.last_address) == 0x15);
+        REQUIRE(static_cast<int>(bus.last_data) == 0x65);
+    }
+    SECTION("Command 117: REMOVE FROM GROUP 5") {
+        REQUIRE(!libdali::RemoveFromGroup(&bus, address, 5));
+        REQUIRE(static_cast<int>(bus.last_data) == 0x75);
+    }
+    SECTION("Command 193: QUERY GROUPS 8-15") {
+        uint8_t next_reply = 0x81;
+        bus.next_reply = &next_reply;
+        bus.next_reply_length = 1;
+        auto result = libdali::QueryGroupsH(&bus, address);
+        REQUIRE(result);
+        REQUIRE(static_cast<int>(bus.last_data) == 0xc1);
+        REQUIRE(static_cast<int>(*result) == 0x81);
+    }
+}
+
+TEST_CASE("Scenes") {
+    Testbus bus;
+    const auto address = libdali::Address::from_group(1);
+
+    SECTION("Command 19: GO TO SCENE 3") {
+        REQUIRE(!libdali::GoToScene(&bus, address, 3));
+        REQUIRE(static_cast<int>(bus.last_address) == 0x83);
+        REQUIRE(static_cast<int>(bus.last_data) == 0x13);
+    }
+    SECTION("Command 67: STORE DTR AS SCENE 3") {
+        REQUIRE(!libdali::StoreDTRAsScene(&bus, address, 3));
+        REQUIRE(static_cast<int>(bus.last_data) == 0x43);
+    }
+    SECTION("Command 83: REMOVE FROM SCENE 3") {
+        REQUIRE(!libdali::RemoveFromScene(&bus, address, 3));
+        REQUIRE(static_cast<int>(bus.last_data) == 0x53);
+    }
+    SECTION("Command 179: QUERY SCENE LEVEL 3") {
+        uint8_t next_reply = 0x80;
+        bus.next_reply = &next_reply;
+        bus.next_reply_length = 1;
+        auto result = libdali::QuerySceneLevel(&bus, address, 3);
+        REQUIRE(result);
+        REQUIRE(static_cast<int>(bus.last_data) == 0xb3);
+        REQUIRE(static_cast<int>(*result) == 0x80);
+    }
+}
+
+TEST_CASE("Register cache after a failed frame") {
+  Testbus bus;
+  libdali::RegisterCacheScope cache(&bus);
+  REQUIRE(!libdali::DataTransferRegister(&bus, 1));
+  REQUIRE(!libdali::DataTransferRegister1(&bus, 2));
+  REQUIRE(!libdali::SearchAddrs(&bus, libdali::SearchAddr(0x123456)));
+
+  bus.next_error_code = libdali::ErrorCode::BUS_ERROR;
+  REQUIRE(libdali::DataTransferRegister(&bus, 3));
+  // All registers are sent again, not only DTR0.
+  REQUIRE(!bus.shadow.dtr0);
+  REQUIRE(!bus.shadow.dtr1);
+  REQUIRE(!bus.shadow.search_h);
+  REQUIRE(!bus.shadow.search_m);
+  REQUIRE(!bus.shadow.search_l);
+
+  bus.next_error_code = libdali::ErrorCode::OK;
+  bus.last_address = 0;
+  REQUIRE(!libdali::DataTransferRegister1(&bus, 2));
+  REQUIRE(static_cast<int>(bus.last_address) == libdali::DA_DTR1);
+}
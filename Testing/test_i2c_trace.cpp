@@ -0,0 +1,136 @@
+#include <catch2/catch_test_macros.hpp>
+#include "i2c_trace.h"
+#include "simlw14.h"
+#include "startup_scan.h"
+
+using namespace libdali;
+
+namespace {
+
+// Level and status of all gear, as the esphome bus collects them.
+std::vector<ScanResult> scan(LW14Adapter *bus, Inventory *inventory) {
+  std::bitset<Inventory::SHORT_ADDRESSES> lights;
+  lights.set();
+  StartupScan startup(bus, inventory);
+  startup.start(lights);
+  std::vector<ScanResult> results;
+  while (!startup.done()) {
+    if (auto result = startup.poll()) {
+      results.push_back(*result);
+    }
+    if (auto wait = startup.poll_delay_us()) {
+      bus->delay_microseconds(wait);
+    }
+  }
+  return results;
+}
+
+bool same(const std::vector<ScanResult> &a, const std::vector<ScanResult> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].short_address != b[i].short_address ||
+        a[i].present != b[i].present || a[i].level != b[i].level ||
+        a[i].status != b[i].status) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+TEST_CASE("I2C trace") {
+  SimBus dali(8);
+  dali.assign_short_addresses();
+  dali.gear[3].actual_level = 0x42;
+  SimLW14 lw14(dali);
+  RecordingI2C recorder(&lw14);
+
+  SECTION("replay of a startup scan") {
+    LW14Adapter bus(&recorder);
+    Inventory inventory;
+    auto recorded = scan(&bus, &inventory);
+    REQUIRE(recorder.truncated() == 0);
+    // Four bytes per status read plus the clock reads and delays between.
+    REQUIRE(recorder.trace().size() < 8 * lw14.i2c_transactions);
+
+    ReplayI2C replay(recorder.trace());
+    REQUIRE(replay.valid());
+    LW14Adapter replayed_bus(&replay);
+    Inventory replayed_inventory;
+    auto replayed = scan(&replayed_bus, &replayed_inventory);
+    REQUIRE(!replay.diverged());
+    REQUIRE(replay.done());
+    REQUIRE(replay.transactions() == lw14.i2c_transactions);
+    REQUIRE(same(recorded, replayed));
+    REQUIRE(replayed[3].level == 0x42);
+    // The virtual clock follows the recording.
+    REQUIRE(replay.millis() == lw14.millis());
+  }
+
+  SECTION("I2C errors are replayed") {
+    uint8_t data = 0;
+    REQUIRE(recorder.read_register(0x55, &data, 1) == I2CResult::ERROR);
+    ReplayI2C replay(recorder.trace());
+    REQUIRE(replay.read_register(0x55, &data, 1) == I2CResult::ERROR);
+    REQUIRE(!replay.diverged());
+  }
+
+  SECTION("different frames diverge") {
+    LW14Adapter bus(&recorder);
+    REQUIRE(!DirectArc(&bus, Address::from_short_address(1), 100));
+    ReplayI2C replay(recorder.trace());
+    LW14Adapter replayed_bus(&replay);
+    REQUIRE(DirectArc(&replayed_bus, Address::from_short_address(1), 50) ==
+            ErrorCode::I2C_ERROR);
+    REQUIRE(replay.diverged());
+    REQUIRE(replay.divergence_offset() > I2CTrace::HEADER_SIZE);
+    // Nothing is replayed after the divergence.
+    uint8_t status;
+    REQUIRE(replay.read_register(0x00, &status, 1) == I2CResult::ERROR);
+  }
+
+  SECTION("end of the trace diverges") {
+    ReplayI2C replay(recorder.trace());
+    uint8_t status;
+    REQUIRE(replay.read_register(0x00, &status, 1) == I2CResult::ERROR);
+    REQUIRE(replay.diverged());
+  }
+
+  SECTION("delays and clock reads are replayed leniently") {
+    uint8_t status;
+    recorder.millis();
+    recorder.delay_microseconds(25000);
+    recorder.read_register(0x00, &status, 1);
+    ReplayI2C replay(recorder.trace());
+    // Neither the clock read nor the delay are repeated.
+    REQUIRE(replay.read_register(0x00, &status, 1) == I2CResult::OK);
+    REQUIRE(!replay.diverged());
+    REQUIRE(replay.millis() >= 25);
+  }
+
+  SECTION("size limit") {
+    recorder.set_max_bytes(64);
+    LW14Adapter bus(&recorder);
+    Inventory inventory;
+    scan(&bus, &inventory);
+    REQUIRE(recorder.trace().size() <= 64);
+    REQUIRE(recorder.truncated() > 0);
+  }
+
+  SECTION("unknown header") {
+    REQUIRE(!ReplayI2C({'L', 'W', 'T', 0}).valid());
+    REQUIRE(!ReplayI2C({}).valid());
+  }
+
+  SECTION("truncated record") {
+    uint8_t status;
+    recorder.read_register(0x00, &status, 1);
+    auto trace = recorder.trace();
+    REQUIRE(ReplayI2C(trace).valid());
+    trace.pop_back();
+    REQUIRE(!ReplayI2C(trace).valid());
+  }
+}
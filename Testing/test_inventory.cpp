@@ -0,0 +1,104 @@
+#include <catch2/catch_test_macros.hpp>
+#include "inventory.h"
+#include "simbus.h"
+
+using namespace libdali;
+
+static std::bitset<Inventory::SHORT_ADDRESSES> first(size_t n) {
+  std::bitset<Inventory::SHORT_ADDRESSES> mask;
+  for (size_t i = 0; i < n; i++) {
+    mask.set(i);
+  }
+  return mask;
+}
+
+TEST_CASE("Inventory") {
+  SimBus bus(8);
+  bus.assign_short_addresses();
+  bus.gear[5].actual_level = 42;
+  Inventory inventory;
+
+  SECTION("query") {
+    REQUIRE(!inventory.query(&bus, 5));
+    const auto &gear = inventory.gear(5);
+    REQUIRE(gear.present);
+    REQUIRE(gear.identification_number == 1000005);
+    REQUIRE(gear.gtin == 0x101112131415);
+    REQUIRE(gear.gear_type == 0x01);
+    REQUIRE(gear.operating_modes == 0x01);
+    REQUIRE(static_cast<int>(gear.level) == 42);
+    REQUIRE(inventory.dirty_blocks() == 1);
+
+    REQUIRE(!inventory.query(&bus, 20));
+    REQUIRE(!inventory.gear(20).present);
+  }
+
+  SECTION("stored record of another version") {
+    Inventory::Record record;
+    record.version = Inventory::VERSION + 1;
+    record.present = 1;
+    REQUIRE(!inventory.load(0, record));
+    REQUIRE(!inventory.gear(0).present);
+  }
+
+  SECTION("level and fade are not stored") {
+    REQUIRE(!inventory.query(&bus, 5));
+    inventory.clear_dirty();
+    inventory.set_level(5, 100);
+    inventory.set_extended_fade_time(5, 0x21);
+    REQUIRE(!inventory.dirty());
+    inventory.set_dimming_curve(5, 1);
+    REQUIRE(inventory.dirty_blocks() == 1);
+    // Fits the preferences of an ESP8266.
+    REQUIRE(sizeof(Inventory::Record) <= 144);
+  }
+
+  SECTION("validation") {
+    RegisterCacheScope cache(&bus);
+    REQUIRE(!inventory.validate(&bus, first(10)));
+    REQUIRE(inventory.queried() == 10);
+
+    Inventory restored;
+    for (uint8_t block = 0; block < Inventory::BLOCKS; block++) {
+      REQUIRE(restored.load(block, inventory.record(block)));
+    }
+    REQUIRE(restored.gear(5).identification_number == 1000005);
+    REQUIRE(restored.gear(5).gtin == 0x101112131415);
+    REQUIRE(restored.gear(5).gear_type == 0x01);
+    REQUIRE(!restored.gear(9).present);
+
+    SECTION("of unchanged gear is one frame per gear") {
+      auto frames = bus.forward_frames;
+      REQUIRE(!restored.validate(&bus, first(10)));
+      // Known missing gear is queried again.
+      REQUIRE(restored.queried() == 2);
+      // DTR0 (DTR1 is still cached), one check per gear and DTR0 plus a
+      // timed out read for the missing gear.
+      REQUIRE(bus.forward_frames - frames == 1 + 8 + 2 * 2);
+      REQUIRE(!restored.dirty());
+    }
+
+    SECTION("queries replaced gear") {
+      bus.gear[3].bank0[0x12] ^= 0xff;
+      bus.gear[3].dimming_curve = 1;
+      REQUIRE(!restored.validate(&bus, first(8)));
+      REQUIRE(restored.queried() == 1);
+      REQUIRE(restored.gear(3).identification_number ==
+              (1000003 ^ 0xff));
+      REQUIRE(restored.gear(3).dimming_curve == 1);
+      REQUIRE(restored.dirty());
+    }
+
+    SECTION("notices removed gear") {
+      bus.gear[6].short_address = SIM_NO_SHORT_ADDRESS;
+      REQUIRE(!restored.validate(&bus, first(8)));
+      REQUIRE(!restored.gear(6).present);
+      REQUIRE(restored.dirty());
+    }
+
+    SECTION("leaves no stale DTR0 in the register cache") {
+      REQUIRE(!restored.validate(&bus, first(8)));
+      REQUIRE(!bus.shadow.dtr0.has_value());
+    }
+  }
+}
@@ -0,0 +1,281 @@
+#include <catch2/catch_test_macros.hpp>
+#include "lw14_impl.h"
+#include "simlw14.h"
+
+using namespace libdali;
+
+TEST_CASE("LW14 blocking command") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  const auto address = Address::from_short_address(3);
+
+  SECTION("control command") {
+    auto cost = lw14.measure(
+        [&] { REQUIRE(!DirectArc(&bus, address, 100)); });
+    REQUIRE(static_cast<int>(dali.gear[3].actual_level) == 100);
+    REQUIRE(static_cast<int>(dali.gear[2].actual_level) == 254);
+    // Idle check, write, forward frame plus margin, completion check.
+    REQUIRE(cost.i2c_transactions == 3);
+    REQUIRE(cost.time_us >=
+            dali_te_us(38) + LW14Adapter::DEFAULT_TIMING_MARGIN_US);
+    REQUIRE(cost.time_us < 25000);
+  }
+
+  SECTION("query with reply") {
+    dali.gear[3].actual_level = 0x42;
+    auto level = QueryActualLevel(&bus, address);
+    REQUIRE(level);
+    REQUIRE(static_cast<int>(*level) == 0x42);
+  }
+
+  SECTION("query without reply") {
+    auto cost = lw14.measure([&] {
+      auto level = QueryActualLevel(&bus, Address::from_short_address(10));
+      REQUIRE(level.error() == ErrorCode::TIMEOUT);
+    });
+    // Given up as soon as the reply window closed.
+    REQUIRE(cost.time_us >= SIM_FORWARD_FRAME_US + SIM_REPLY_WINDOW_US);
+    REQUIRE(cost.time_us < 30000);
+  }
+
+  SECTION("timing margin") {
+    bus.set_timing_margin_us(20000);
+    auto cost = lw14.measure(
+        [&] { REQUIRE(!DirectArc(&bus, address, 100)); });
+    REQUIRE(cost.time_us >= dali_te_us(38) + 20000);
+    REQUIRE(cost.time_us < 40000);
+  }
+
+  SECTION("minimum settle time") {
+    bus.set_min_settle_us(50000);
+    auto cost = lw14.measure(
+        [&] { REQUIRE(!DirectArc(&bus, address, 100)); });
+    REQUIRE(cost.time_us >= 50000);
+    REQUIRE(cost.time_us < 60000);
+  }
+
+  SECTION("timeout extends the reply deadline") {
+    const auto missing = Address::from_short_address(10);
+    auto cost = lw14.measure([&] {
+      auto handle =
+          bus.submit(missing.command(), QueryActualLevel.command, 1, 200);
+      REQUIRE(handle);
+      uint8_t reply = 0;
+      std::optional<ErrorCode> result;
+      while (!(result = bus.poll(*handle, &reply))) {
+        // Another master keeps the bus busy after the frame.
+        lw14.force_busy = dali.forward_frames > 0;
+        bus.delay_microseconds(bus.poll_delay_us());
+      }
+      REQUIRE(*result == ErrorCode::TIMEOUT);
+    });
+    REQUIRE(cost.time_us >= 200000);
+    REQUIRE(cost.time_us < 250000);
+  }
+
+  SECTION("scan of all short addresses") {
+    auto cost = lw14.measure([&] {
+      for (uint8_t i = 0; i < 64; i++) {
+        auto present =
+            QueryControlGearPresent(&bus, Address::from_short_address(i));
+        REQUIRE(present);
+        REQUIRE(*present == (i < 4));
+      }
+    });
+    REQUIRE(cost.time_us < 3000000);
+  }
+
+  SECTION("multiple replies") {
+    auto level = QueryActualLevel(&bus, Broadcast);
+    REQUIRE(level.error() == ErrorCode::FRAME_ERROR);
+  }
+
+  SECTION("busy bus") {
+    lw14.force_busy = true;
+    auto cost = lw14.measure([&] {
+      REQUIRE(DirectArc(&bus, address, 100) == ErrorCode::BUS_BUSY);
+    });
+    REQUIRE(cost.time_us >= 250000);
+    REQUIRE(dali.forward_frames == 0);
+  }
+
+  SECTION("bus error") {
+    lw14.force_bus_error = true;
+    REQUIRE(DirectArc(&bus, address, 100) == ErrorCode::BUS_ERROR);
+  }
+
+  SECTION("stale telegram is cleared") {
+    lw14.inject_telegram(0x99);
+    dali.gear[3].actual_level = 0x42;
+    auto level = QueryActualLevel(&bus, address);
+    REQUIRE(level);
+    REQUIRE(static_cast<int>(*level) == 0x42);
+  }
+
+  SECTION("back to back commands keep the bus timing") {
+    REQUIRE(!DirectArc(&bus, address, 1));
+    REQUIRE(!DirectArc(&bus, address, 2));
+    REQUIRE(lw14.writes_while_busy == 0);
+  }
+}
+
+TEST_CASE("LW14 submit and poll") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  const auto address = Address::from_short_address(3);
+
+  SECTION("poll never sleeps") {
+    dali.gear[3].actual_level = 0x10;
+    auto handle = bus.submit(address.command(), 0xa0, 1);
+    REQUIRE(handle);
+    uint8_t reply = 0;
+    std::optional<ErrorCode> result;
+    size_t polls = 0;
+    while (true) {
+      auto start = dali.now_us;
+      result = bus.poll(*handle, &reply);
+      // Only the I2C transactions take time.
+      REQUIRE(dali.now_us - start < 5000);
+      if (result) {
+        break;
+      }
+      polls++;
+      REQUIRE(bus.poll_delay_us() <= 50000);
+      dali.now_us += 1000;
+    }
+    REQUIRE(polls > 1);
+    REQUIRE(!*result);
+    REQUIRE(static_cast<int>(reply) == 0x10);
+    REQUIRE(!bus.poll());
+  }
+
+  SECTION("queued commands complete in order") {
+    auto first = bus.submit(address.dacp(), 1, 0);
+    auto second = bus.submit(address.dacp(), 2, 0);
+    REQUIRE(first);
+    REQUIRE(second);
+    std::optional<ErrorCode> result;
+    while (!(result = bus.poll(*second, nullptr))) {
+      dali.now_us += 1000;
+    }
+    REQUIRE(static_cast<int>(dali.gear[3].actual_level) == 2);
+    REQUIRE(bus.poll(*first, nullptr) == ErrorCode::OK);
+  }
+
+  SECTION("full queue") {
+    for (size_t i = 0; i < LW14Adapter::QUEUE_SIZE; i++) {
+      REQUIRE(bus.submit(address.dacp(), 1, 0));
+    }
+    auto handle = bus.submit(address.dacp(), 1, 0);
+    REQUIRE(handle.error() == ErrorCode::BUS_BUSY);
+  }
+}
+
+TEST_CASE("LW14 metrics") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  const auto address = Address::from_short_address(3);
+
+  SECTION("results and latency per command class") {
+    auto cost = lw14.measure([&] {
+      REQUIRE(!DirectArc(&bus, address, 100));
+      REQUIRE(QueryActualLevel(&bus, address));
+      REQUIRE(QueryActualLevel(&bus, Address::from_short_address(10))
+                  .error() == ErrorCode::TIMEOUT);
+      REQUIRE(!DataTransferRegister(&bus, 5));
+    });
+    const auto &metrics = bus.metrics();
+    REQUIRE(metrics.commands() == 4);
+    REQUIRE(metrics.result(ErrorCode::OK) == 3);
+    REQUIRE(metrics.result(ErrorCode::TIMEOUT) == 1);
+    REQUIRE(metrics.latency_of(CommandClass::CONTROL).count == 1);
+    REQUIRE(metrics.latency_of(CommandClass::QUERY).count == 2);
+    REQUIRE(metrics.latency_of(CommandClass::SPECIAL).count == 1);
+    const auto &control = metrics.latency_of(CommandClass::CONTROL);
+    REQUIRE(control.max_ms >= dali_te_us(38) / 1000);
+    REQUIRE(control.buckets[1] == 1);
+    REQUIRE(metrics.i2c_transactions == cost.i2c_transactions);
+    // Back to back frames wait for the reply window of the previous one.
+    REQUIRE(metrics.busy_waits > 0);
+
+    bus.reset_metrics();
+    REQUIRE(bus.metrics().commands() == 0);
+    REQUIRE(bus.metrics().i2c_transactions == 0);
+  }
+
+  SECTION("busy bus") {
+    lw14.force_busy = true;
+    REQUIRE(DirectArc(&bus, address, 100) == ErrorCode::BUS_BUSY);
+    REQUIRE(bus.metrics().result(ErrorCode::BUS_BUSY) == 1);
+    REQUIRE(bus.metrics().busy_waits == 27);
+  }
+
+  SECTION("full queue") {
+    for (size_t i = 0; i <= LW14Adapter::QUEUE_SIZE; i++) {
+      bus.submit(address.dacp(), 1, 0);
+    }
+    REQUIRE(bus.metrics().queue_full == 1);
+  }
+
+  SECTION("reply longer than the LW14 can hold") {
+    auto handle = bus.submit(address.command(), QueryActualLevel.command,
+                             LW14Adapter::MAX_REPLY_LENGTH + 1);
+    REQUIRE(handle.error() == ErrorCode::INVALID_ARGUMENT);
+    REQUIRE(dali.forward_frames == 0);
+    // The queue is untouched.
+    REQUIRE(bus.submit(address.dacp(), 1, 0));
+  }
+
+  SECTION("stale telegram") {
+    lw14.inject_telegram(0x99);
+    REQUIRE(!DirectArc(&bus, address, 100));
+    REQUIRE(bus.metrics().stale_telegrams == 1);
+  }
+
+  SECTION("overrun while waiting for the reply") {
+    auto handle = bus.submit(address.command(), QueryActualLevel.command, 1);
+    REQUIRE(handle);
+    uint8_t reply = 0;
+    while (!bus.poll(*handle, &reply)) {
+      if (dali.forward_frames > 0 && bus.metrics().overruns == 0) {
+        // Two telegrams of another master before the status is read.
+        lw14.inject_telegram(0x11);
+        lw14.inject_telegram(0x22);
+      }
+      bus.delay_microseconds(bus.poll_delay_us());
+    }
+    REQUIRE(bus.metrics().overruns == 1);
+  }
+
+  SECTION("command classes") {
+    REQUIRE(command_class(address.dacp(), 0) == CommandClass::CONTROL);
+    REQUIRE(command_class(address.command(), 1) == CommandClass::QUERY);
+    REQUIRE(command_class(0xa3, 0) == CommandClass::SPECIAL);
+    REQUIRE(command_class(0xbb, 1) == CommandClass::SPECIAL);
+    REQUIRE(command_class(Address::from_group(2).command(), 0) ==
+            CommandClass::CONTROL);
+    REQUIRE(command_class(0xff, 1) == CommandClass::QUERY);
+  }
+}
+
+TEST_CASE("LW14 with a concrete transport") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14AdapterT<SimLW14> bus(&lw14);
+  const auto address = Address::from_short_address(3);
+
+  auto cost = lw14.measure([&] { REQUIRE(!DirectArc(&bus, address, 100)); });
+  REQUIRE(static_cast<int>(dali.gear[3].actual_level) == 100);
+  REQUIRE(cost.i2c_transactions == 3);
+  auto level = QueryActualLevel(&bus, address);
+  REQUIRE(level);
+  REQUIRE(static_cast<int>(*level) == 100);
+  REQUIRE(bus.metrics().commands() == 2);
+}
@@ -0,0 +1,214 @@
+#include <catch2/catch_test_macros.hpp>
+#include "monitor.h"
+#include "simlw14.h"
+#include <cstring>
+#include <thread>
+
+using namespace libdali;
+
+TEST_CASE("SPSC ring") {
+  SpscRing<uint32_t, 4> ring;
+  uint32_t value = 0;
+
+  SECTION("full and empty") {
+    REQUIRE(!ring.pop(value));
+    for (uint32_t i = 0; i < 4; i++) {
+      REQUIRE(ring.push(i));
+    }
+    REQUIRE(!ring.push(4));
+    REQUIRE(ring.size() == 4);
+    REQUIRE(ring.pop(value));
+    REQUIRE(value == 0);
+    REQUIRE(ring.push(4));
+    for (uint32_t i = 1; i <= 4; i++) {
+      REQUIRE(ring.pop(value));
+      REQUIRE(value == i);
+    }
+    REQUIRE(ring.empty());
+  }
+
+  SECTION("producer and consumer threads") {
+    constexpr uint32_t COUNT = 20000;
+    std::thread producer([&] {
+      for (uint32_t i = 0; i < COUNT;) {
+        if (ring.push(i)) {
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+    uint32_t expected = 0;
+    bool ordered = true;
+    while (expected < COUNT) {
+      if (ring.pop(value)) {
+        ordered &= value == expected;
+        expected++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    producer.join();
+    REQUIRE(ordered);
+    REQUIRE(ring.empty());
+  }
+}
+
+TEST_CASE("Bus monitor") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  BusMonitor monitor;
+  bus.set_monitor(&monitor);
+  MonitorFrame frame;
+
+  SECTION("own frames") {
+    dali.gear[1].actual_level = 0x42;
+    REQUIRE(QueryActualLevel(&bus, Address::from_short_address(1)));
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.own());
+    REQUIRE(!frame.backward());
+    REQUIRE(frame.length == 2);
+    REQUIRE(frame.data[0] == Address::from_short_address(1).command());
+    REQUIRE(frame.data[1] == 0xa0);
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.own());
+    REQUIRE(frame.backward());
+    REQUIRE(frame.length == 1);
+    REQUIRE(frame.data[0] == 0x42);
+    REQUIRE(!monitor.pop(frame));
+  }
+
+  SECTION("frame error") {
+    REQUIRE(QueryControlGearPresent(&bus, Broadcast).error() ==
+            ErrorCode::FRAME_ERROR);
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.flags ==
+            (MonitorFrame::OWN | MonitorFrame::BACKWARD |
+             MonitorFrame::FRAME_ERROR));
+  }
+
+  SECTION("frames of another master while idle") {
+    lw14.inject_forward(Address::from_short_address(2).dacp(), 100);
+    dali.now_us += 1000;
+    REQUIRE(!bus.poll());
+    lw14.inject_telegram(0xff);
+    // At most one status read per millisecond.
+    auto cost = lw14.measure([&] { bus.poll(); });
+    REQUIRE(cost.i2c_transactions == 0);
+    dali.now_us += 1000;
+    bus.poll();
+
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(!frame.own());
+    REQUIRE(!frame.backward());
+    REQUIRE(frame.length == 2);
+    REQUIRE(frame.data[0] == Address::from_short_address(2).dacp());
+    REQUIRE(frame.data[1] == 100);
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.backward());
+    REQUIRE(frame.data[0] == 0xff);
+  }
+
+  SECTION("telegram waiting before a command") {
+    lw14.inject_forward(Broadcast.command(), 0x00);
+    REQUIRE(!DirectArc(&bus, Address::from_short_address(0), 10));
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(!frame.own());
+    REQUIRE(frame.data[1] == 0x00);
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.own());
+    REQUIRE(bus.metrics().stale_telegrams == 1);
+  }
+
+  SECTION("overrun") {
+    lw14.inject_forward(Broadcast.command(), 0x05);
+    lw14.inject_forward(Broadcast.command(), 0x00);
+    dali.now_us += 1000;
+    bus.poll();
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.flags & MonitorFrame::OVERRUN);
+    REQUIRE(monitor.overruns() == 1);
+  }
+
+  SECTION("full ring drops the newest frames") {
+    for (size_t i = 0; i < BusMonitor::CAPACITY + 2; i++) {
+      lw14.inject_forward(Broadcast.dacp(), static_cast<uint8_t>(i));
+      dali.now_us += 1000;
+      bus.poll();
+    }
+    REQUIRE(monitor.waiting() == BusMonitor::CAPACITY);
+    REQUIRE(monitor.dropped() == 2);
+    REQUIRE(monitor.pop(frame));
+    REQUIRE(frame.data[1] == 0);
+  }
+
+  SECTION("monitor off") {
+    bus.set_monitor(nullptr);
+    lw14.inject_forward(Broadcast.dacp(), 100);
+    dali.now_us += 1000;
+    auto cost = lw14.measure([&] { bus.poll(); });
+    REQUIRE(cost.i2c_transactions == 0);
+    REQUIRE(!DirectArc(&bus, Broadcast, 10));
+    REQUIRE(!monitor.pop(frame));
+  }
+}
+
+TEST_CASE("Monitor frame formats") {
+  MonitorFrame frame;
+  frame.time_ms = 12345;
+  frame.length = 2;
+  frame.data = {0xfe, 100, 0};
+  char line[96];
+
+  SECTION("binary") {
+    frame.flags = MonitorFrame::OWN;
+    uint8_t record[MonitorFrame::MAX_ENCODED];
+    REQUIRE(frame.encode(record) == 7);
+    const uint8_t expected[] = {0x39, 0x30, 0, 0, 0x0a, 0xfe, 100};
+    REQUIRE(std::memcmp(record, expected, sizeof(expected)) == 0);
+  }
+
+  SECTION("text") {
+    frame.describe(line, sizeof(line));
+    REQUIRE(std::string(line) ==
+            "    12.345 bus > fe 64     broadcast DAPC 100");
+    frame.data = {Address::from_group(3).command(), 0x13, 0};
+    frame.describe(line, sizeof(line));
+    REQUIRE(std::string(line).ends_with("> 87 13     group 3 GO TO SCENE 3"));
+    frame.data = {0xa3, 0x2a, 0};
+    frame.describe(line, sizeof(line));
+    REQUIRE(std::string(line).ends_with("DTR0 42"));
+    frame.flags = MonitorFrame::OWN | MonitorFrame::BACKWARD;
+    frame.length = 1;
+    frame.describe(line, sizeof(line));
+    REQUIRE(std::string(line).ends_with("own < a3        reply 163"));
+  }
+
+  SECTION("level effects") {
+    auto effect = frame_effect(Address::from_short_address(5).dacp(), 100);
+    REQUIRE(effect.kind == FrameEffect::Kind::LEVEL);
+    REQUIRE(effect.value == 100);
+    REQUIRE(effect.target == 5);
+    effect = frame_effect(Broadcast.command(), 0x00);
+    REQUIRE(effect.kind == FrameEffect::Kind::LEVEL);
+    REQUIRE(effect.value == 0);
+    REQUIRE(effect.target == 0x7f);
+    effect = frame_effect(Address::from_group(2).command(), 0x14);
+    REQUIRE(effect.kind == FrameEffect::Kind::SCENE);
+    REQUIRE(effect.value == 4);
+    REQUIRE(effect.target == 0x42);
+    REQUIRE(frame_effect(Broadcast.command(), 0x05).kind ==
+            FrameEffect::Kind::CHANGED);
+    REQUIRE(frame_effect(Broadcast.dacp(), DA_MASK).kind ==
+            FrameEffect::Kind::CHANGED);
+    REQUIRE(frame_effect(Broadcast.command(), 0xa0).kind ==
+            FrameEffect::Kind::NONE);
+    REQUIRE(frame_effect(Broadcast.command(), 0x2a).kind ==
+            FrameEffect::Kind::NONE);
+    REQUIRE(frame_effect(0xa3, 0x00).kind == FrameEffect::Kind::NONE);
+    REQUIRE(frame_effect(0xfd, 0x00).kind == FrameEffect::Kind::NONE);
+  }
+}
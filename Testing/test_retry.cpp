@@ -0,0 +1,126 @@
+#include <catch2/catch_test_macros.hpp>
+#include "retry.h"
+#include "simbus.h"
+
+using namespace libdali;
+
+namespace {
+
+// Fails the next `failures` frames with `error` before they reach the bus.
+class FlakyBus : public BusInterface {
+public:
+  explicit FlakyBus(SimBus &bus) : bus(bus) {}
+  ErrorCode DaliCommand(uint8_t address, uint8_t data, uint8_t *reply,
+                        size_t reply_length,
+                        uint32_t timeout_ms = 150) override {
+    this->frames++;
+    if (this->failures > 0) {
+      this->failures--;
+      this->bus.now_us += 20000;
+      return this->error;
+    }
+    return this->bus.DaliCommand(address, data, reply, reply_length,
+                                 timeout_ms);
+  }
+  void delay_microseconds(uint32_t us) override {
+    this->bus.delay_microseconds(us);
+  }
+  uint32_t now_ms() override { return this->bus.now_ms(); }
+
+  SimBus &bus;
+  ErrorCode error = ErrorCode::BUS_BUSY;
+  size_t failures = 0;
+  size_t frames = 0;
+};
+
+} // namespace
+
+TEST_CASE("Retry") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  FlakyBus flaky(dali);
+  RetryBus bus(&flaky);
+  const auto address = Address::from_short_address(1);
+
+  SECTION("busy bus is retried with backoff") {
+    flaky.failures = 2;
+    auto start_us = dali.now_us;
+    REQUIRE(!DirectArc(&bus, address, 100));
+    REQUIRE(static_cast<int>(dali.gear[1].actual_level) == 100);
+    REQUIRE(flaky.frames == 3);
+    REQUIRE(bus.stats().retries == 2);
+    REQUIRE(bus.stats().recovered == 1);
+    REQUIRE(bus.stats().failed == 0);
+    // Half of 20ms and of 40ms at least.
+    REQUIRE(dali.now_us - start_us >= 2 * 20000 + 10000 + 20000);
+  }
+
+  SECTION("bounded attempts") {
+    flaky.failures = 10;
+    REQUIRE(DirectArc(&bus, address, 100) == ErrorCode::BUS_BUSY);
+    REQUIRE(flaky.frames == 3);
+    REQUIRE(bus.stats().failed == 1);
+  }
+
+  SECTION("deadline") {
+    flaky.failures = 10;
+    bus.policies().set(ErrorCode::BUS_BUSY,
+                       RetryPolicy{.attempts = 10, .backoff_us = 100000});
+    bus.policies().set_deadline_ms(300);
+    REQUIRE(DirectArc(&bus, address, 100) == ErrorCode::BUS_BUSY);
+    REQUIRE(flaky.frames < 5);
+  }
+
+  SECTION("query without reply is not retried") {
+    flaky.error = ErrorCode::TIMEOUT;
+    flaky.failures = 1;
+    REQUIRE(QueryActualLevel(&bus, address).error() == ErrorCode::TIMEOUT);
+    REQUIRE(flaky.frames == 1);
+    REQUIRE(bus.stats().failed == 0);
+  }
+
+  SECTION("timeout of a command is retried") {
+    flaky.error = ErrorCode::TIMEOUT;
+    flaky.failures = 1;
+    REQUIRE(!DirectArc(&bus, address, 100));
+    REQUIRE(flaky.frames == 2);
+  }
+
+  SECTION("frame error is an answer") {
+    flaky.error = ErrorCode::FRAME_ERROR;
+    flaky.failures = 1;
+    REQUIRE(QueryActualLevel(&bus, address).error() ==
+            ErrorCode::FRAME_ERROR);
+    REQUIRE(flaky.frames == 1);
+  }
+
+  SECTION("configuration commands are never retried") {
+    flaky.failures = 1;
+    REQUIRE(AddToGroup(&bus, address, 3) == ErrorCode::BUS_BUSY);
+    REQUIRE(flaky.frames == 1);
+    REQUIRE(dali.gear[1].groups == 0);
+    // The whole pair is repeated by the caller.
+    flaky.frames = 0;
+    REQUIRE(!AddToGroup(&bus, address, 3));
+    REQUIRE(flaky.frames == 2);
+    REQUIRE(dali.gear[1].groups == 1 << 3);
+  }
+
+  SECTION("idempotent frames") {
+    REQUIRE(idempotent(address.dacp(), 100));
+    REQUIRE(idempotent(address.command(), 0x00));
+    REQUIRE(idempotent(address.command(), 0x13));
+    REQUIRE(idempotent(address.command(), 0xa0));
+    REQUIRE(idempotent(0xa3, 0));
+    REQUIRE(!idempotent(address.command(), 0x01));
+    REQUIRE(!idempotent(address.command(), 0x2e));
+    REQUIRE(!idempotent(address.command(), 0x63));
+    REQUIRE(!idempotent(address.command(), DA_READ_MEMORY_LOCATION));
+    REQUIRE(!idempotent(address.command(), 0xe3));
+    REQUIRE(!idempotent(address.command(), 0xec));
+    REQUIRE(idempotent(address.command(), 0xed));
+    REQUIRE(!idempotent(0xa5, 0));
+    REQUIRE(!idempotent(0xa7, 0));
+    REQUIRE(!idempotent(0xc7, 0));
+  }
+}
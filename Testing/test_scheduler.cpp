@@ -0,0 +1,187 @@
+#include <catch2/catch_test_macros.hpp>
+#include "arc_sender.h"
+#include "scheduler.h"
+#include "simlw14.h"
+#include <string>
+
+using namespace libdali;
+
+namespace {
+
+// Sends sequences of `frames` steps, one step per run(), and logs them.
+class FakeJob : public SchedulerJob {
+public:
+  FakeJob(char name, std::string *log, uint32_t *clock_us)
+      : name_(name), log_(log), clock_us_(clock_us) {}
+
+  bool busy() const override { return this->left_ > 0; }
+  bool run(bool start) override {
+    if (this->left_ == 0) {
+      if (!start || this->sequences == 0) {
+        return false;
+      }
+      this->sequences--;
+      this->left_ = this->frames;
+    }
+    if (this->waiting) {
+      return false;
+    }
+    *this->log_ += this->name_;
+    *this->clock_us_ += this->step_us;
+    this->left_--;
+    return true;
+  }
+
+  // Sequences waiting to be started.
+  int sequences = 0;
+  int frames = 1;
+  uint32_t step_us = 100;
+  // The bus is not ready for the next step.
+  bool waiting = false;
+
+protected:
+  char name_;
+  std::string *log_;
+  uint32_t *clock_us_;
+  int left_ = 0;
+};
+
+// Sends DTR0 0x55 once per sequence, a job that would break the sequence of
+// another one using DTR0.
+class DtrJob : public SchedulerJob {
+public:
+  explicit DtrJob(LW14Adapter *bus) : bus_(bus) {}
+
+  bool busy() const override { return this->handle_.has_value(); }
+  bool run(bool start) override {
+    if (this->handle_.has_value()) {
+      if (!this->bus_->poll(*this->handle_, nullptr).has_value()) {
+        return false;
+      }
+      this->handle_.reset();
+      this->sent++;
+      return true;
+    }
+    if (!start || this->sequences == 0) {
+      return false;
+    }
+    auto handle = this->bus_->submit(0xa3, 0x55, 0);
+    if (!handle) {
+      return false;
+    }
+    this->sequences--;
+    this->handle_ = *handle;
+    return true;
+  }
+
+  int sequences = 0;
+  int sent = 0;
+
+protected:
+  LW14Adapter *bus_;
+  std::optional<CommandHandle> handle_;
+};
+
+class SenderJob : public SchedulerJob {
+public:
+  explicit SenderJob(ArcSender *sender) : sender_(sender) {}
+  bool busy() const override { return this->sender_->busy(); }
+  bool run(bool) override {
+    return this->sender_->busy() && this->sender_->poll().has_value();
+  }
+
+protected:
+  ArcSender *sender_;
+};
+
+} // namespace
+
+TEST_CASE("Scheduler") {
+  std::string log;
+  uint32_t clock_us = 0;
+  auto now_us = [&] { return clock_us; };
+  Scheduler scheduler;
+  FakeJob poll('p', &log, &clock_us), user('u', &log, &clock_us),
+      config('c', &log, &clock_us);
+  // Added out of order on purpose.
+  REQUIRE(scheduler.add(&poll, Priority::POLL));
+  REQUIRE(scheduler.add(&user, Priority::USER));
+  REQUIRE(scheduler.add(&config, Priority::CONFIG));
+
+  SECTION("priority classes") {
+    poll.sequences = 2;
+    config.sequences = 1;
+    user.sequences = 2;
+    scheduler.run(now_us);
+    REQUIRE(log == "uucpp");
+  }
+
+  SECTION("sequences are not interleaved") {
+    poll.sequences = 2;
+    poll.frames = 3;
+    poll.waiting = true;
+    scheduler.run(now_us);
+    REQUIRE(scheduler.owner() == &poll);
+    // Work of a higher priority waits for the sequence, but goes before the
+    // next one.
+    user.sequences = 1;
+    scheduler.run(now_us);
+    REQUIRE(log.empty());
+    poll.waiting = false;
+    scheduler.run(now_us);
+    REQUIRE(log == "pppuppp");
+    REQUIRE(scheduler.owner() == nullptr);
+  }
+
+  SECTION("time budget") {
+    scheduler.set_budget_us(1000);
+    poll.sequences = 30;
+    scheduler.run(now_us);
+    REQUIRE(log.size() == 10);
+    REQUIRE(scheduler.over_budget() == 0);
+    poll.step_us = 1500;
+    scheduler.run(now_us);
+    REQUIRE(log.size() == 11);
+    REQUIRE(scheduler.over_budget() == 1);
+    REQUIRE(scheduler.max_slice_us() == 1500);
+  }
+
+  SECTION("job limit") {
+    REQUIRE(scheduler.add(&poll, Priority::POLL));
+    REQUIRE(!scheduler.add(&poll, Priority::POLL));
+  }
+}
+
+TEST_CASE("Scheduler keeps DTR0 and its command together") {
+  SimBus dali(2);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  ArcSender sender(&bus, &inventory);
+  SenderJob sender_job(&sender);
+  DtrJob dtr_job(&bus);
+  Scheduler scheduler;
+  scheduler.add(&dtr_job, Priority::USER);
+  scheduler.add(&sender_job, Priority::POLL);
+  auto now_us = [&] { return static_cast<uint32_t>(dali.now_us); };
+
+  // DTR0, EXTENDED FADE TIME twice and more, the DTR0 of the other job has
+  // to wait until the level was sent.
+  auto fade = extended_fade_time(2000);
+  sender.send(ArcQueue::Entry{.short_address = 0, .level = 100, .fade = fade},
+              std::bitset<Inventory::SHORT_ADDRESSES>("01"));
+  scheduler.run(now_us);
+  REQUIRE(scheduler.owner() == &sender_job);
+  dtr_job.sequences = 3;
+  while (dtr_job.sent < 3) {
+    if (sender.busy()) {
+      REQUIRE(dtr_job.sent == 0);
+    }
+    scheduler.run(now_us);
+    dali.now_us += 1000;
+  }
+  REQUIRE(static_cast<int>(dali.gear[0].extended_fade_time) == fade);
+  REQUIRE(static_cast<int>(dali.gear[0].actual_level) == 100);
+  REQUIRE(static_cast<int>(dali.gear[0].dtr0) == 0x55);
+}
@@ -0,0 +1,72 @@
+#include <catch2/catch_test_macros.hpp>
+#include "search.h"
+#include "simbus.h"
+#include <algorithm>
+
+using namespace libdali;
+
+// Finds and addresses all gear, returns the COMPARE frames sent.
+static uint32_t commission(SimBus &bus, std::vector<uint32_t> *found = nullptr) {
+  REQUIRE(!Initialise(&bus, InitialiseMode::ALL));
+  REQUIRE(!Randomise(&bus));
+  RandomAddressSearch search(&bus);
+  uint8_t short_address = 0;
+  while (true) {
+    auto result = search.next();
+    REQUIRE(result);
+    if (!result->found) {
+      break;
+    }
+    if (found) {
+      found->push_back(result->random_address);
+    }
+    auto withdrawn = search.withdraw();
+    REQUIRE(withdrawn);
+    REQUIRE(*withdrawn);
+    REQUIRE(!SearchAddrs(&bus, SearchAddr(result->random_address)));
+    REQUIRE(!ProgramShortAddress(&bus, short_address++));
+  }
+  REQUIRE(!Terminate(&bus));
+  return search.compares();
+}
+
+TEST_CASE("Random address search") {
+  SECTION("finds the gear in order of their random address") {
+    SimBus bus(16, 7);
+    std::vector<uint32_t> found;
+    commission(bus, &found);
+    std::vector<uint32_t> expected;
+    for (const auto &g : bus.gear) {
+      expected.push_back(g.random_address);
+    }
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(found == expected);
+    for (const auto &g : bus.gear) {
+      auto position = std::find(expected.begin(), expected.end(),
+                                g.random_address) -
+                      expected.begin();
+      REQUIRE(g.short_address == position);
+    }
+  }
+
+  SECTION("no gear") {
+    SimBus bus(0);
+    REQUIRE(commission(bus) == 1);
+  }
+
+  SECTION("single gear") {
+    SimBus bus(1);
+    // Presence, 24 bisection steps, withdraw check, final presence.
+    REQUIRE(commission(bus) == 1 + 24 + 1 + 1);
+  }
+
+  SECTION("fewer compares than a full binary search per gear") {
+    for (uint32_t seed = 1; seed <= 4; seed++) {
+      SimBus bus(64, seed);
+      auto compares = commission(bus);
+      // The plain search takes 24 steps, a sanity check and a withdraw check
+      // per gear.
+      REQUIRE(compares * 100 < 64 * 26 * 85);
+    }
+  }
+}
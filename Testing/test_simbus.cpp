@@ -0,0 +1,267 @@
+#include <catch2/catch_test_macros.hpp>
+#include "simbus.h"
+#include <set>
+
+using namespace libdali;
+
+// Binary search for the gear with the lowest random address, as done by the
+// CLI initialise operation.
+static std::optional<uint32_t> find_lowest(SimBus &bus) {
+  uint32_t addr = 0;
+  for (uint32_t i = 0; i < 24; i++) {
+    uint32_t bit = 1ul << (23ul - i);
+    REQUIRE(!SearchAddrs(&bus, SearchAddr(addr | bit)));
+    auto compare_result = Compare(&bus);
+    if (!compare_result && compare_result.error() != ErrorCode::FRAME_ERROR) {
+      FAIL(compare_result.error());
+    }
+    if (compare_result && !*compare_result) {
+      addr |= bit;
+    }
+  }
+  if (addr == 0xffffff) {
+    return std::nullopt;
+  }
+  return addr + 1;
+}
+
+TEST_CASE("Simulated bus") {
+  SimBus bus(4);
+  bus.assign_short_addresses();
+
+  SECTION("addressed query") {
+    bus.gear[2].actual_level = 42;
+    auto level = QueryActualLevel(&bus, Address::from_short_address(2));
+    REQUIRE(level);
+    REQUIRE(static_cast<int>(*level) == 42);
+  }
+
+  SECTION("missing gear") {
+    auto level = QueryActualLevel(&bus, Address::from_short_address(10));
+    REQUIRE(level.error() == ErrorCode::TIMEOUT);
+  }
+
+  SECTION("multiple replies") {
+    auto level = QueryActualLevel(&bus, Broadcast);
+    REQUIRE(level.error() == ErrorCode::FRAME_ERROR);
+    REQUIRE(bus.collisions == 1);
+  }
+
+  SECTION("direct arc") {
+    REQUIRE(!DirectArc(&bus, Broadcast, 100));
+    for (const auto &g : bus.gear) {
+      REQUIRE(static_cast<int>(g.actual_level) == 100);
+    }
+  }
+
+  SECTION("memory bank 0") {
+    auto id = MemoryBank0GearIdentificationNumber(&bus,
+                                                  Address::from_short_address(3));
+    REQUIRE(id);
+    REQUIRE(static_cast<uint64_t>(*id) == 1000003);
+  }
+
+  SECTION("configuration commands have to be sent twice") {
+    REQUIRE(!DataTransferRegister(&bus, DA_MASK));
+    auto address = Address::from_short_address(1);
+    REQUIRE(!bus.DaliCommand(address.command(), 0x80, nullptr, 0));
+    REQUIRE(static_cast<int>(bus.gear[1].short_address) == 1);
+    REQUIRE(!StoreDTRAsShortAddress(&bus, address));
+    REQUIRE(bus.gear[1].short_address == SIM_NO_SHORT_ADDRESS);
+  }
+
+  SECTION("virtual time") {
+    auto start = bus.now_us;
+    REQUIRE(!Off(&bus, Broadcast));
+    REQUIRE(bus.now_us - start == SIM_FORWARD_FRAME_US + SIM_REPLY_WINDOW_US);
+    bus.delay_microseconds(1000);
+    REQUIRE(bus.now_us - start ==
+            SIM_FORWARD_FRAME_US + SIM_REPLY_WINDOW_US + 1000);
+    REQUIRE(bus.bus_time_us ==
+            SIM_FORWARD_FRAME_US + SIM_REPLY_WINDOW_US);
+  }
+}
+
+TEST_CASE("Simulated commissioning") {
+  SimBus bus(64);
+
+  REQUIRE(!Terminate(&bus));
+  REQUIRE(!Initialise(&bus, InitialiseMode::ALL));
+  REQUIRE(!Randomise(&bus));
+
+  uint8_t short_address = 0;
+  while (auto addr = find_lowest(bus)) {
+    REQUIRE(!SearchAddrs(&bus, SearchAddr(*addr)));
+    REQUIRE(!ProgramShortAddress(&bus, short_address));
+    REQUIRE(!Withdraw(&bus));
+    short_address++;
+  }
+  REQUIRE(!Terminate(&bus));
+
+  REQUIRE(short_address == 64);
+  std::set<uint8_t> short_addresses;
+  for (const auto &g : bus.gear) {
+    short_addresses.insert(g.short_address);
+  }
+  REQUIRE(short_addresses.size() == 64);
+  REQUIRE(!short_addresses.contains(SIM_NO_SHORT_ADDRESS));
+  // 64 * 25 * 4 frames take minutes on a real bus.
+  REQUIRE(bus.bus_time_us > 2ull * 60 * 1000 * 1000);
+}
+
+TEST_CASE("Shadow registers") {
+  SimBus bus(4);
+  bus.assign_short_addresses();
+
+  SECTION("disabled by default") {
+    REQUIRE(!DataTransferRegister(&bus, 1));
+    REQUIRE(!DataTransferRegister(&bus, 1));
+    REQUIRE(bus.forward_frames == 2);
+  }
+
+  SECTION("unchanged registers are not written") {
+    RegisterCacheScope cache(&bus);
+    REQUIRE(!DataTransferRegister(&bus, 1));
+    REQUIRE(!DataTransferRegister(&bus, 1));
+    REQUIRE(!DataTransferRegister1(&bus, 1));
+    REQUIRE(!DataTransferRegister1(&bus, 1));
+    REQUIRE(bus.forward_frames == 2);
+    REQUIRE(!DataTransferRegister(&bus, 2));
+    REQUIRE(bus.forward_frames == 3);
+    REQUIRE(static_cast<int>(bus.gear[0].dtr0) == 2);
+  }
+
+  SECTION("read memory location increments DTR0") {
+    RegisterCacheScope cache(&bus);
+    auto address = Address::from_short_address(1);
+    auto gtin = MemoryBank0GTIN(&bus, address);
+    REQUIRE(gtin);
+    auto frames = bus.forward_frames;
+    auto gtin2 = MemoryBank0GTIN(&bus, address);
+    REQUIRE(gtin2);
+    REQUIRE(static_cast<uint64_t>(*gtin) == static_cast<uint64_t>(*gtin2));
+    // DTR1 is still known, DTR0 is sent again.
+    REQUIRE(bus.forward_frames - frames == 1 + 6);
+  }
+
+  SECTION("only changed search address bytes are sent") {
+    RegisterCacheScope cache(&bus);
+    REQUIRE(!Initialise(&bus, InitialiseMode::ALL));
+    auto frames = bus.forward_frames;
+    REQUIRE(!SearchAddrs(&bus, SearchAddr(0x123456)));
+    REQUIRE(!SearchAddrs(&bus, SearchAddr(0x123457)));
+    REQUIRE(bus.forward_frames - frames == 4);
+    for (const auto &g : bus.gear) {
+      REQUIRE(g.search_address == 0x123457);
+    }
+    // Gear entering the initialisation state may have any search address.
+    REQUIRE(!Initialise(&bus, InitialiseMode::ALL));
+    frames = bus.forward_frames;
+    REQUIRE(!SearchAddrs(&bus, SearchAddr(0x123457)));
+    REQUIRE(bus.forward_frames - frames == 3);
+  }
+
+  SECTION("cleared when leaving the scope") {
+    {
+      RegisterCacheScope cache(&bus);
+      REQUIRE(!DataTransferRegister(&bus, 1));
+    }
+    bus.gear[0].dtr0 = 5;
+    RegisterCacheScope cache(&bus);
+    REQUIRE(!DataTransferRegister(&bus, 1));
+    REQUIRE(static_cast<int>(bus.gear[0].dtr0) == 1);
+  }
+}
+
+TEST_CASE("Memory bank buffer") {
+  SimBus bus(2);
+  bus.assign_short_addresses();
+  auto address = Address::from_short_address(1);
+
+  SECTION("whole bank up to the last accessible location") {
+    bus.gear[1].bank0[0x00] = 0x12;
+    MemoryBank0 bank0;
+    REQUIRE(!bank0.read(&bus, address, 0));
+    REQUIRE(bank0.length() == 0x13);
+    // DTR1, DTR0 and one frame per location.
+    REQUIRE(bus.forward_frames == 2 + 0x13);
+    auto id = MemoryBank0GearIdentificationNumber(bank0);
+    REQUIRE(id);
+    REQUIRE(static_cast<uint64_t>(*id) == 1000001);
+    REQUIRE(bus.forward_frames == 2 + 0x13);
+  }
+
+  SECTION("locations without answer below the last accessible one") {
+    bus.gear[1].bank0_silent.set(0x0a);
+    MemoryBank0 bank0;
+    REQUIRE(!bank0.read(&bus, address, 0));
+    REQUIRE(bank0.length() == MEMORY_BANK0_SIZE);
+    REQUIRE(bus.forward_frames == 2 + MEMORY_BANK0_SIZE);
+    REQUIRE(MemoryBank0LastAccessibleBank(bank0));
+    REQUIRE(MemoryBank0GTIN(bank0));
+    REQUIRE(MemoryBank0GearIdentificationNumber(bank0));
+    // The firmware version covers location 0x0a.
+    REQUIRE(!MemoryBank0FirmwareVersion(bank0));
+    REQUIRE(!bank0.contains(0, 0x01, 1));
+  }
+
+  SECTION("range") {
+    MemoryBank0 bank0;
+    REQUIRE(!bank0.read(&bus, address, 0, 0x03, 6));
+    REQUIRE(MemoryBank0GTIN(bank0));
+    REQUIRE(!MemoryBank0GearIdentificationNumber(bank0));
+  }
+
+  SECTION("range past the end of the bank") {
+    MemoryBankBuffer<16> buffer;
+    REQUIRE(!buffer.read(&bus, address, 0, 0x18));
+    REQUIRE(buffer.length() == MEMORY_BANK0_SIZE - 0x18);
+  }
+
+  SECTION("missing bank") {
+    MemoryBankBuffer<16> buffer;
+    REQUIRE(buffer.read(&bus, address, 1) == ErrorCode::TIMEOUT);
+    REQUIRE(buffer.length() == 0);
+  }
+
+  SECTION("fewer frames than reading the fields one by one") {
+    auto frames = bus.forward_frames;
+    REQUIRE(MemoryBank0LastAccessibleBank(&bus, address));
+    REQUIRE(MemoryBank0GTIN(&bus, address));
+    REQUIRE(MemoryBank0FirmwareVersion(&bus, address));
+    REQUIRE(MemoryBank0GearIdentificationNumber(&bus, address));
+    auto separate = bus.forward_frames - frames;
+
+    frames = bus.forward_frames;
+    MemoryBank0 bank0;
+    REQUIRE(!bank0.read(&bus, address, 0, 0x02, 0x11));
+    REQUIRE(MemoryBank0LastAccessibleBank(bank0));
+    REQUIRE(MemoryBank0GTIN(bank0));
+    REQUIRE(MemoryBank0FirmwareVersion(bank0));
+    REQUIRE(MemoryBank0GearIdentificationNumber(bank0));
+    REQUIRE((bus.forward_frames - frames) * 5 < separate * 4);
+  }
+}
+
+TEST_CASE("Simulated commissioning frames with shadow registers") {
+  auto commission = [](bool cache_enabled) {
+    SimBus bus(16);
+    std::optional<RegisterCacheScope> cache;
+    if (cache_enabled) {
+      cache.emplace(&bus);
+    }
+    REQUIRE(!Initialise(&bus, InitialiseMode::ALL));
+    REQUIRE(!Randomise(&bus));
+    uint8_t short_address = 0;
+    while (auto addr = find_lowest(bus)) {
+      REQUIRE(!SearchAddrs(&bus, SearchAddr(*addr)));
+      REQUIRE(!ProgramShortAddress(&bus, short_address++));
+      REQUIRE(!Withdraw(&bus));
+    }
+    REQUIRE(short_address == 16);
+    return bus.forward_frames;
+  };
+  auto without = commission(false);
+  auto with = commission(true);
+  REQUIRE(with * 10 < without * 6);
+}
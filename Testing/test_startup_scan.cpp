@@ -0,0 +1,265 @@
+#include <catch2/catch_test_macros.hpp>
+#include "simlw14.h"
+#include "startup_scan.h"
+#include <algorithm>
+#include <vector>
+
+using namespace libdali;
+
+// Polls the scan until it is done, without sleeping in poll().
+static std::vector<ScanResult> run(SimBus &dali, StartupScan &scan) {
+  std::vector<ScanResult> results;
+  while (!scan.done()) {
+    auto start = dali.now_us;
+    if (auto result = scan.poll()) {
+      results.push_back(*result);
+    }
+    REQUIRE(dali.now_us - start < 5000);
+    dali.now_us += 1000;
+  }
+  return results;
+}
+
+// Polls the scan until it is done, the poll after the frame `late_frame` of
+// the scan comes 150ms late.
+static void run_late(SimBus &dali, StartupScan &scan, size_t late_frame) {
+  auto frames = dali.forward_frames;
+  while (!scan.done()) {
+    scan.poll();
+    dali.now_us +=
+        dali.forward_frames - frames == late_frame ? 150000 : 1000;
+  }
+}
+
+TEST_CASE("Startup scan") {
+  SimBus dali(4);
+  dali.assign_short_addresses();
+  dali.gear[1].actual_level = 0;
+  dali.gear[2].actual_level = 42;
+  dali.gear[2].dimming_curve = 1;
+  dali.gear[3].lamp_failure = true;
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  StartupScan scan(&bus, &inventory);
+  std::bitset<Inventory::SHORT_ADDRESSES> lights;
+  for (uint8_t i = 0; i < 6; i++) {
+    lights.set(i);
+  }
+
+  scan.start(lights);
+  auto results = run(dali, scan);
+
+  SECTION("reports all gear in order") {
+    REQUIRE(results.size() == 6);
+    for (uint8_t i = 0; i < 6; i++) {
+      REQUIRE(results[i].short_address == i);
+      REQUIRE(results[i].present == (i < 4));
+    }
+    REQUIRE(static_cast<int>(results[0].level) == 254);
+    REQUIRE(static_cast<int>(results[1].level) == 0);
+    REQUIRE(static_cast<int>(results[2].level) == 42);
+    REQUIRE(QueryStatusResponse(results[3].status).LampFailure);
+  }
+
+  SECTION("fills the inventory and selects the dimming curve") {
+    REQUIRE(inventory.gear(2).present);
+    REQUIRE(inventory.gear(2).identification_number == 1000002);
+    REQUIRE(inventory.gear(2).dimming_curve == StartupScan::DIMMING_CURVE);
+    REQUIRE(dali.gear[2].dimming_curve == StartupScan::DIMMING_CURVE);
+    REQUIRE(static_cast<int>(inventory.gear(2).level) == 42);
+    REQUIRE(!inventory.gear(4).present);
+  }
+
+  SECTION("known gear is only checked") {
+    dali.gear[2].actual_level = 43;
+    auto frames = dali.forward_frames;
+    scan.start(lights);
+    results = run(dali, scan);
+    REQUIRE(results.size() == 6);
+    REQUIRE(static_cast<int>(results[2].level) == 43);
+    // DTR1 and DTR0 once, one check per gear, level and status per gear and
+    // three frames for each missing gear.
+    REQUIRE(dali.forward_frames - frames == 2 + 4 + 2 * 4 + 2 * 3);
+  }
+
+  SECTION("replaced gear is queried again") {
+    dali.gear[1].bank0[0x12] ^= 0xff;
+    scan.start(lights);
+    run(dali, scan);
+    REQUIRE(inventory.gear(1).identification_number == (1000001 ^ 0xff));
+  }
+}
+
+TEST_CASE("Startup scan group membership") {
+  SimBus dali(3);
+  dali.assign_short_addresses();
+  dali.gear[0].groups = 0x0001; // group 0, not managed
+  dali.gear[1].groups = 0x0024; // groups 2 and 5
+  dali.gear[2].groups = 0x0004; // group 2
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  StartupScan scan(&bus, &inventory);
+  std::bitset<Inventory::SHORT_ADDRESSES> lights("111");
+  scan.add_group_member(2, 0);
+  scan.add_group_member(2, 2);
+  scan.add_group_member(5, 1);
+
+  scan.start(lights);
+  run(dali, scan);
+  REQUIRE(dali.gear[0].groups == 0x0005);
+  REQUIRE(dali.gear[1].groups == 0x0020);
+  REQUIRE(dali.gear[2].groups == 0x0004);
+
+  SECTION("correct membership is not written again") {
+    auto frames = dali.forward_frames;
+    scan.start(lights);
+    run(dali, scan);
+    // Check, groups, level and status per gear and DTR1 and DTR0 once.
+    REQUIRE(dali.forward_frames - frames == 2 + 3 * (1 + 2 + 2));
+  }
+
+  SECTION("a late repeat is sent again") {
+    dali.gear[1].groups = 0x0024;
+    auto frames = dali.forward_frames;
+    scan.start(lights);
+    // After the first REMOVE FROM GROUP of gear 1.
+    run_late(dali, scan, 2 + 3 + 2 + 2 + 2 + 1);
+    REQUIRE(dali.gear[1].groups == 0x0020);
+    // Both pairs, each followed by the groups.
+    REQUIRE(dali.forward_frames - frames ==
+            2 + 3 * (1 + 2 + 2) + 2 * (2 + 2));
+  }
+}
+
+TEST_CASE("Startup scan yields between sequences") {
+  SimBus dali(2);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  StartupScan scan(&bus, &inventory);
+  scan.start(std::bitset<Inventory::SHORT_ADDRESSES>("11"));
+
+  auto frames = dali.forward_frames;
+  for (int i = 0; i < 100; i++) {
+    REQUIRE(!scan.poll(true));
+    dali.now_us += 1000;
+  }
+  REQUIRE(dali.forward_frames == frames);
+  REQUIRE(!scan.busy());
+
+  // Started sequences run to their end.
+  scan.poll();
+  REQUIRE(scan.busy());
+  while (scan.busy()) {
+    scan.poll(true);
+    dali.now_us += 1000;
+  }
+  REQUIRE(!scan.done());
+}
+
+TEST_CASE("Startup scan sequences only hold frames depending on DTR") {
+  SimBus dali(2);
+  dali.assign_short_addresses();
+  dali.gear[1].dimming_curve = 1;
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  StartupScan scan(&bus, &inventory);
+  SceneTable scenes;
+  for (uint8_t scene = 0; scene < 4; scene++) {
+    scenes.set_level(scene, 0, 100);
+    scenes.set_level(scene, 1, 100);
+  }
+  scan.set_scenes(&scenes);
+  scan.add_group_member(2, 0);
+  scan.add_group_member(3, 1);
+  std::bitset<Inventory::SHORT_ADDRESSES> lights("11");
+
+  scan.start(lights);
+  size_t longest = 0;
+  while (!scan.done()) {
+    // Start a sequence, then yield until the scan waits for the caller.
+    auto frames = dali.forward_frames;
+    scan.poll();
+    for (int i = 0; i < 1000 && !scan.done(); i++) {
+      scan.poll(true);
+      dali.now_us += 1000;
+    }
+    longest = std::max(longest, dali.forward_frames - frames);
+  }
+  // DTR1, DTR0 and the identification number.
+  REQUIRE(longest == 2 + 8);
+  REQUIRE(inventory.gear(1).identification_number == 1000001);
+  REQUIRE(inventory.gear(1).gtin == 0x101112131415);
+  REQUIRE(dali.gear[1].dimming_curve == StartupScan::DIMMING_CURVE);
+  REQUIRE(dali.gear[1].groups == 0x0008);
+  REQUIRE(static_cast<int>(dali.gear[1].scenes[3]) == 100);
+
+  SECTION("DTR is written again after another sender") {
+    scan.start(lights);
+    scan.poll();
+    while (scan.busy()) {
+      scan.poll(true);
+      dali.now_us += 1000;
+    }
+    // The check of gear 1 is prepared, another sender writes DTR0.
+    for (int i = 0; i < 100; i++) {
+      scan.poll(true);
+      dali.now_us += 1000;
+    }
+    bus.shadow.invalidate();
+    dali.gear[1].dtr0 = 0;
+    scan.poll();
+    REQUIRE(scan.busy());
+    run(dali, scan);
+    REQUIRE(inventory.gear(1).present);
+  }
+}
+
+TEST_CASE("Startup scan scene levels") {
+  SimBus dali(3);
+  dali.assign_short_addresses();
+  dali.gear[0].scenes[1] = 100; // correct
+  dali.gear[1].scenes[1] = 50;  // differs
+  dali.gear[2].scenes[1] = 10;  // not part of the scene
+  dali.gear[2].scenes[7] = 10;  // scene not managed
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  StartupScan scan(&bus, &inventory);
+  SceneTable scenes;
+  scenes.set_level(1, 0, 100);
+  scenes.set_level(1, 1, 200);
+  scan.set_scenes(&scenes);
+  std::bitset<Inventory::SHORT_ADDRESSES> lights("111");
+
+  scan.start(lights);
+  run(dali, scan);
+  REQUIRE(static_cast<int>(dali.gear[0].scenes[1]) == 100);
+  REQUIRE(static_cast<int>(dali.gear[1].scenes[1]) == 200);
+  REQUIRE(static_cast<int>(dali.gear[2].scenes[1]) == DA_MASK);
+  REQUIRE(static_cast<int>(dali.gear[2].scenes[7]) == 10);
+
+  SECTION("stored levels are not written again") {
+    auto frames = dali.forward_frames;
+    scan.start(lights);
+    run(dali, scan);
+    // Check, scene level, level and status per gear and DTR1 and DTR0 once.
+    REQUIRE(dali.forward_frames - frames == 2 + 3 * (1 + 1 + 2));
+  }
+
+  SECTION("a late repeat is sent again") {
+    dali.gear[1].scenes[1] = 50;
+    auto frames = dali.forward_frames;
+    scan.start(lights);
+    // After the first STORE DTR AS SCENE of gear 1.
+    run_late(dali, scan, 2 + 3 + 1 + 2 + 1 + 2);
+    REQUIRE(static_cast<int>(dali.gear[1].scenes[1]) == 200);
+    // DTR0 and the pair twice, each followed by the scene level.
+    REQUIRE(dali.forward_frames - frames ==
+            2 + 3 * (1 + 1 + 2) + 2 * (3 + 1));
+  }
+}
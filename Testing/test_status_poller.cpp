@@ -0,0 +1,118 @@
+#include <catch2/catch_test_macros.hpp>
+#include "simlw14.h"
+#include "status_poller.h"
+#include <vector>
+
+using namespace libdali;
+
+// Polls for `duration_ms` of virtual time, one poll per millisecond.
+static std::vector<ScanResult> run(SimBus &dali, StatusPoller &poller,
+                                   uint64_t duration_ms, bool yield = false) {
+  std::vector<ScanResult> results;
+  auto end_us = dali.now_us + duration_ms * 1000;
+  while (dali.now_us < end_us) {
+    if (auto result = poller.poll(yield)) {
+      results.push_back(*result);
+    }
+    dali.now_us += 1000;
+  }
+  return results;
+}
+
+TEST_CASE("Status poller") {
+  SimBus dali(8);
+  dali.assign_short_addresses();
+  SimLW14 lw14(dali);
+  LW14Adapter bus(&lw14);
+  Inventory inventory;
+  StatusPoller poller(&bus, &inventory);
+  std::bitset<Inventory::SHORT_ADDRESSES> lights;
+  for (uint8_t i = 0; i < 8; i++) {
+    lights.set(i);
+    inventory.set_level(i, 254);
+    poller.set_state(ScanResult{.short_address = i,
+                                .present = true,
+                                .level = 254,
+                                .status = dali.gear[i].status()});
+  }
+  poller.start(lights);
+
+  SECTION("stays within its share of the bus") {
+    poller.set_interval_ms(0, 0);
+    auto frames = dali.forward_frames;
+    REQUIRE(run(dali, poller, 60000).empty());
+    auto polls = (dali.forward_frames - frames) / 2;
+    REQUIRE(polls > 0);
+    REQUIRE(polls * StatusPoller::POLL_BUS_TIME_US <=
+            60000 * 1000 * StatusPoller::DEFAULT_SHARE_PERCENT / 100 +
+                StatusPoller::POLL_BUS_TIME_US);
+  }
+
+  SECTION("yields to commands of the caller") {
+    auto frames = dali.forward_frames;
+    REQUIRE(run(dali, poller, 60000, true).empty());
+    REQUIRE(dali.forward_frames == frames);
+  }
+
+  SECTION("yields between the queries of a gear") {
+    poller.set_interval_ms(0, 0);
+    auto frames = dali.forward_frames;
+    while (dali.forward_frames == frames) {
+      poller.poll(false);
+      dali.now_us += 1000;
+    }
+    // QUERY ACTUAL LEVEL is answered, QUERY STATUS waits.
+    for (int i = 0; i < 100; i++) {
+      REQUIRE(!poller.poll(true));
+      dali.now_us += 1000;
+    }
+    REQUIRE(dali.forward_frames == frames + 1);
+    REQUIRE(!poller.busy());
+    run(dali, poller, 100);
+    REQUIRE(dali.forward_frames == frames + 2);
+  }
+
+  SECTION("reports changes on the line") {
+    dali.gear[3].actual_level = 100;
+    dali.gear[5].lamp_failure = true;
+    auto results = run(dali, poller, 60000);
+    REQUIRE(results.size() == 2);
+    REQUIRE(results[0].short_address == 3);
+    REQUIRE(static_cast<int>(results[0].level) == 100);
+    REQUIRE(static_cast<int>(inventory.gear(3).level) == 100);
+    REQUIRE(results[1].short_address == 5);
+    REQUIRE(QueryStatusResponse(results[1].status).LampFailure);
+  }
+
+  SECTION("reports missing gear") {
+    dali.gear[6].short_address = SIM_NO_SHORT_ADDRESS;
+    auto results = run(dali, poller, 60000);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].short_address == 6);
+    REQUIRE(!results[0].present);
+  }
+
+  SECTION("polls stable gear less often") {
+    dali.gear[2].lamp_failure = true;
+    run(dali, poller, 600000);
+    REQUIRE(poller.interval_ms(0) == StatusPoller::DEFAULT_MAX_INTERVAL_MS);
+    REQUIRE(poller.interval_ms(2) == StatusPoller::DEFAULT_MIN_INTERVAL_MS);
+  }
+
+  SECTION("drops a state read while a command changed the gear") {
+    dali.gear[0].actual_level = 100;
+    // Run until the poll of gear 0 is in progress.
+    auto frames = dali.forward_frames;
+    while (dali.forward_frames == frames) {
+      REQUIRE(!poller.poll(false));
+      dali.now_us += 1000;
+    }
+    poller.discard(0);
+    auto results = run(dali, poller, 1000);
+    REQUIRE(results.empty());
+    // Polled again after the minimum interval.
+    results = run(dali, poller, StatusPoller::DEFAULT_MIN_INTERVAL_MS);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].short_address == 0);
+  }
+}
@@ -1,5 +1,6 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
+from esphome import automation
 from esphome.const import CONF_ID
 from esphome.components import i2c
 
@@ -8,12 +9,89 @@ AUTO_LOAD = ["output"]
 
 dali_ns = cg.esphome_ns.namespace("dali")
 Bus = dali_ns.class_("Bus", cg.Component, i2c.I2CDevice)
+GoToSceneAction = dali_ns.class_("GoToSceneAction", automation.Action)
+ErrorCode = cg.global_ns.namespace("libdali").class_("ErrorCode")
+
+CONF_BROADCAST_COLLAPSE = "broadcast_collapse"
+CONF_TIMING_MARGIN = "timing_margin"
+CONF_MIN_SETTLE = "min_settle"
+CONF_POLL_SHARE = "poll_share"
+CONF_MIN_POLL_INTERVAL = "min_poll_interval"
+CONF_MAX_POLL_INTERVAL = "max_poll_interval"
+CONF_SCENES = "scenes"
+CONF_SCENE = "scene"
+CONF_LEVELS = "levels"
+CONF_SHORT_ADDRESS = "short_address"
+CONF_LEVEL = "level"
+CONF_GROUP = "group"
+CONF_RETRY = "retry"
+CONF_ATTEMPTS = "attempts"
+CONF_BACKOFF = "backoff"
+CONF_DEADLINE = "deadline"
+CONF_FOLLOW_OTHER_MASTERS = "follow_other_masters"
+CONF_LOOP_BUDGET = "loop_budget"
+
+RETRY_ERRORS = {
+    "bus_busy": ErrorCode.BUS_BUSY,
+    "i2c_error": ErrorCode.I2C_ERROR,
+    "timeout": ErrorCode.TIMEOUT,
+}
+RETRY_POLICY_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_ATTEMPTS): cv.int_range(min=1, max=10),
+        cv.Required(CONF_BACKOFF): cv.positive_time_period_microseconds,
+    }
+)
+RETRY_SCHEMA = cv.Schema(
+    {
+        cv.Optional(
+            CONF_DEADLINE, default="500ms"
+        ): cv.positive_time_period_milliseconds,
+        **{cv.Optional(key): RETRY_POLICY_SCHEMA for key in RETRY_ERRORS},
+    }
+)
+
+SCENE_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_SCENE): cv.int_range(min=0, max=15),
+        cv.Required(CONF_LEVELS): cv.ensure_list(
+            cv.Schema(
+                {
+                    cv.Required(CONF_SHORT_ADDRESS): cv.int_range(
+                        min=0, max=63
+                    ),
+                    cv.Required(CONF_LEVEL): cv.percentage,
+                }
+            )
+        ),
+    }
+)
 
 MULTI_CONF = True
 CONFIG_SCHEMA = (
     cv.Schema(
         {
             cv.GenerateID(): cv.declare_id(Bus),
+            cv.Optional(CONF_BROADCAST_COLLAPSE, default=True): cv.boolean,
+            cv.Optional(
+                CONF_TIMING_MARGIN, default="5ms"
+            ): cv.positive_time_period_microseconds,
+            cv.Optional(
+                CONF_MIN_SETTLE, default="0ms"
+            ): cv.positive_time_period_microseconds,
+            cv.Optional(CONF_POLL_SHARE, default="10%"): cv.percentage,
+            cv.Optional(
+                CONF_MIN_POLL_INTERVAL, default="5s"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(
+                CONF_MAX_POLL_INTERVAL, default="300s"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_SCENES): cv.ensure_list(SCENE_SCHEMA),
+            cv.Optional(CONF_RETRY): RETRY_SCHEMA,
+            cv.Optional(CONF_FOLLOW_OTHER_MASTERS, default=False): cv.boolean,
+            cv.Optional(
+                CONF_LOOP_BUDGET, default="4ms"
+            ): cv.positive_time_period_microseconds,
         }
     )
     .extend(cv.COMPONENT_SCHEMA)
@@ -24,3 +102,68 @@ async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
     await i2c.register_i2c_device(var, config)
+    cg.add(var.set_broadcast_collapse(config[CONF_BROADCAST_COLLAPSE]))
+    cg.add(
+        var.set_timing_margin_us(config[CONF_TIMING_MARGIN].total_microseconds)
+    )
+    cg.add(var.set_min_settle_us(config[CONF_MIN_SETTLE].total_microseconds))
+    cg.add(var.set_poll_share(int(round(config[CONF_POLL_SHARE] * 100))))
+    cg.add(
+        var.set_poll_interval(
+            config[CONF_MIN_POLL_INTERVAL].total_milliseconds,
+            config[CONF_MAX_POLL_INTERVAL].total_milliseconds,
+        )
+    )
+    cg.add(
+        var.set_follow_other_masters(config[CONF_FOLLOW_OTHER_MASTERS])
+    )
+    cg.add(
+        var.set_loop_budget_us(config[CONF_LOOP_BUDGET].total_microseconds)
+    )
+    if CONF_RETRY in config:
+        retry = config[CONF_RETRY]
+        cg.add(
+            var.set_retry_deadline_ms(retry[CONF_DEADLINE].total_milliseconds)
+        )
+        for key, error in RETRY_ERRORS.items():
+            if key not in retry:
+                continue
+            cg.add(
+                var.set_retry_policy(
+                    error,
+                    retry[key][CONF_ATTEMPTS],
+                    retry[key][CONF_BACKOFF].total_microseconds,
+                )
+            )
+    for scene in config.get(CONF_SCENES, []):
+        for level in scene[CONF_LEVELS]:
+            cg.add(
+                var.add_scene_level(
+                    scene[CONF_SCENE],
+                    level[CONF_SHORT_ADDRESS],
+                    int(round(level[CONF_LEVEL] * 254)),
+                )
+            )
+
+
+@automation.register_action(
+    "dali.go_to_scene",
+    GoToSceneAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(Bus),
+            cv.Required(CONF_SCENE): cv.templatable(
+                cv.int_range(min=0, max=15)
+            ),
+            cv.Optional(CONF_GROUP): cv.int_range(min=0, max=15),
+        }
+    ),
+)
+async def go_to_scene_to_code(config, action_id, template_arg, args):
+    bus = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, bus)
+    scene = await cg.templatable(config[CONF_SCENE], args, cg.uint8)
+    cg.add(var.set_scene(scene))
+    if CONF_GROUP in config:
+        cg.add(var.set_group(config[CONF_GROUP]))
+    return var
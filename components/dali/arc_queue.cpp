@@ -0,0 +1,220 @@
+#include "arc_queue.h"
+
+namespace libdali {
+
+bool ArcQueue::push(uint8_t short_address, uint8_t level, uint8_t fade) {
+  short_address &= SIZE - 1;
+  if (level == DA_MASK) {
+    // Same mapping as DirectArc.
+    level = 254;
+  }
+  if (level == this->known_[short_address]) {
+    // Gear is already there, drop a pending change in between.
+    this->pending_[short_address] = DA_MASK;
+    return false;
+  }
+  this->pending_[short_address] = level;
+  this->pending_fade_[short_address] = fade;
+  return true;
+}
+
+bool ArcQueue::push_group(uint8_t group, uint8_t level, uint8_t fade) {
+  group &= GROUPS - 1;
+  if (level == DA_MASK) {
+    level = 254;
+  }
+  const auto &members = this->members_[group];
+  // Without known members the level of the group is unknown.
+  bool needed = members.none();
+  for (size_t short_address = 0; short_address < SIZE; short_address++) {
+    if (!members.test(short_address)) {
+      continue;
+    }
+    // The group level replaces levels queued before.
+    this->pending_[short_address] = DA_MASK;
+    needed |= this->known_[short_address] != level;
+  }
+  if (!needed) {
+    this->pending_group_[group] = DA_MASK;
+    return false;
+  }
+  this->pending_group_[group] = level;
+  this->pending_group_fade_[group] = fade;
+  return true;
+}
+
+std::bitset<ArcQueue::SIZE> ArcQueue::targets(const Entry &entry) const {
+  if (entry.short_address == BROADCAST) {
+    return this->gear_;
+  }
+  if (entry.short_address & GROUP) {
+    return this->members_[entry.short_address & (GROUPS - 1)];
+  }
+  std::bitset<SIZE> targets;
+  targets.set(entry.short_address & (SIZE - 1));
+  return targets;
+}
+
+std::optional<ArcQueue::Entry> ArcQueue::pop_group_() {
+  for (uint8_t group = 0; group < GROUPS; group++) {
+    auto level = this->pending_group_[group];
+    if (level == DA_MASK) {
+      continue;
+    }
+    this->pending_group_[group] = DA_MASK;
+    const auto &members = this->members_[group];
+    for (size_t short_address = 0; short_address < SIZE; short_address++) {
+      if (members.test(short_address)) {
+        this->known_[short_address] = level;
+      }
+    }
+    return Entry{.short_address = static_cast<uint8_t>(GROUP | group),
+                 .level = level,
+                 .fade = this->pending_group_fade_[group]};
+  }
+  return std::nullopt;
+}
+
+std::optional<ArcQueue::Entry> ArcQueue::pop() {
+  if (auto entry = this->pop_group_()) {
+    return entry;
+  }
+  if (this->broadcast_collapse_) {
+    if (auto entry = this->pop_broadcast_()) {
+      return entry;
+    }
+  }
+  for (size_t i = 0; i < SIZE; i++) {
+    auto short_address = (this->cursor_ + i) % SIZE;
+    auto level = this->pending_[short_address];
+    if (level == DA_MASK) {
+      continue;
+    }
+    this->cursor_ = (short_address + 1) % SIZE;
+    this->pending_[short_address] = DA_MASK;
+    this->known_[short_address] = level;
+    return Entry{.short_address = static_cast<uint8_t>(short_address),
+                 .level = level,
+                 .fade = this->pending_fade_[short_address]};
+  }
+  return std::nullopt;
+}
+
+std::optional<ArcQueue::Entry> ArcQueue::pop_broadcast_() {
+  if (this->gear_.none()) {
+    return std::nullopt;
+  }
+  // Level every gear ends up with, either pending or already there.
+  uint8_t level = DA_MASK;
+  std::optional<uint8_t> fade;
+  size_t pending = 0;
+  for (size_t short_address = 0; short_address < SIZE; short_address++) {
+    if (!this->gear_.test(short_address)) {
+      continue;
+    }
+    auto target = this->pending_[short_address];
+    if (target != DA_MASK) {
+      pending++;
+      if (fade.has_value() && *fade != this->pending_fade_[short_address]) {
+        return std::nullopt;
+      }
+      fade = this->pending_fade_[short_address];
+    } else {
+      target = this->known_[short_address];
+    }
+    if (target == DA_MASK || (level != DA_MASK && target != level)) {
+      return std::nullopt;
+    }
+    level = target;
+  }
+  // A single frame is as cheap as a broadcast.
+  if (pending < 2) {
+    return std::nullopt;
+  }
+  for (size_t short_address = 0; short_address < SIZE; short_address++) {
+    if (this->gear_.test(short_address)) {
+      this->pending_[short_address] = DA_MASK;
+      this->known_[short_address] = level;
+    }
+  }
+  return Entry{
+      .short_address = BROADCAST, .level = level, .fade = fade.value_or(0)};
+}
+
+void ArcQueue::sent(const Entry &entry, ErrorCode err) {
+  if (!err) {
+    return;
+  }
+  auto targets = this->targets(entry);
+  for (size_t short_address = 0; short_address < SIZE; short_address++) {
+    if (!targets.test(short_address)) {
+      continue;
+    }
+    if (this->known_[short_address] == entry.level) {
+      this->known_[short_address] = DA_MASK;
+    }
+  }
+}
+
+bool ArcQueue::retry(const Entry &entry) {
+  // Only the failed send resets the level of the gear, a known level is newer.
+  auto targets = this->targets(entry);
+  for (size_t short_address = 0; short_address < SIZE; short_address++) {
+    if (targets.test(short_address) &&
+        (this->known_[short_address] != DA_MASK ||
+         this->pending_[short_address] != DA_MASK)) {
+      targets.reset(short_address);
+    }
+  }
+  if (entry.short_address != BROADCAST && (entry.short_address & GROUP)) {
+    auto group = entry.short_address & (GROUPS - 1);
+    if (this->pending_group_[group] != DA_MASK) {
+      return false;
+    }
+    if (targets == this->members_[group]) {
+      // All members, or a group without known members.
+      this->pending_group_[group] = entry.level;
+      this->pending_group_fade_[group] = entry.fade;
+      return true;
+    }
+  }
+  for (size_t short_address = 0; short_address < SIZE; short_address++) {
+    if (targets.test(short_address)) {
+      this->pending_[short_address] = entry.level;
+      this->pending_fade_[short_address] = entry.fade;
+    }
+  }
+  return targets.any();
+}
+
+void ArcQueue::set_level(uint8_t short_address, uint8_t level) {
+  this->known_[short_address & (SIZE - 1)] = level;
+}
+
+void ArcQueue::forget(uint8_t short_address) {
+  this->known_[short_address & (SIZE - 1)] = DA_MASK;
+}
+
+std::optional<uint8_t> ArcQueue::level(uint8_t short_address) const {
+  auto level = this->known_[short_address & (SIZE - 1)];
+  if (level == DA_MASK) {
+    return std::nullopt;
+  }
+  return level;
+}
+
+bool ArcQueue::empty() const {
+  for (auto level : this->pending_) {
+    if (level != DA_MASK) {
+      return false;
+    }
+  }
+  for (auto level : this->pending_group_) {
+    if (level != DA_MASK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace libdali
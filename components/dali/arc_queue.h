@@ -0,0 +1,111 @@
+#pragma once
+#include "dali.h"
+#include <array>
+
+namespace libdali {
+
+// Pending DirectArc levels, one slot per short address. A newer level for a
+// gear replaces the one not sent yet ("latest wins"), and levels equal to the
+// last level sent to or reported by the gear are dropped. This bounds the
+// number of frames to the number of gear, independent of how often the level
+// changes.
+//
+// With broadcast collapse enabled, pending levels are sent as one broadcast
+// DirectArc if all gear added with add_gear() are set to the same level with
+// the same fade.
+//
+// Levels for a group are sent before levels for single gear and replace the
+// levels of its members queued before them.
+class ArcQueue {
+public:
+  static constexpr size_t SIZE = 64;
+  static constexpr size_t GROUPS = 16;
+  // Entry::short_address of a broadcast entry, the value of Broadcast.
+  static constexpr uint8_t BROADCAST = 0x7f;
+  // Entry::short_address of a group entry is GROUP | group, as in the address
+  // byte.
+  static constexpr uint8_t GROUP = 0x40;
+
+  struct Entry {
+    uint8_t short_address;
+    uint8_t level;
+    // Extended fade time to reach the level with, see extended_fade_time().
+    uint8_t fade = 0;
+    Address address() const {
+      if (this->short_address == BROADCAST) {
+        return Broadcast;
+      }
+      if (this->short_address & GROUP) {
+        return Address::from_group(this->short_address);
+      }
+      return Address::from_short_address(this->short_address);
+    }
+  };
+
+  // Gear controlled through this queue, considered for broadcast collapse.
+  void add_gear(uint8_t short_address) {
+    this->gear_.set(short_address & (SIZE - 1));
+  }
+  void add_group_member(uint8_t group, uint8_t short_address) {
+    this->members_[group & (GROUPS - 1)].set(short_address & (SIZE - 1));
+  }
+  const std::bitset<SIZE> &members(uint8_t group) const {
+    return this->members_[group & (GROUPS - 1)];
+  }
+  // Gear the entry reaches.
+  std::bitset<SIZE> targets(const Entry &entry) const;
+  void set_broadcast_collapse(bool enabled) {
+    this->broadcast_collapse_ = enabled;
+  }
+
+  // Queue `level` for the gear, reached with the extended fade time `fade`.
+  // Returns false if no frame is needed.
+  bool push(uint8_t short_address, uint8_t level, uint8_t fade = 0);
+  // Queue `level` for all members of the group. Always queued for a group
+  // without members added.
+  bool push_group(uint8_t group, uint8_t level, uint8_t fade = 0);
+  // Next level to send, round robin over the short addresses, or a broadcast
+  // entry covering all gear. The level is remembered as sent.
+  std::optional<Entry> pop();
+  // Record the outcome of sending a popped entry.
+  void sent(const Entry &entry, ErrorCode err);
+  // Queue an entry that failed again, for the gear without a newer level.
+  // Gear whose level is known again, e.g. because a newer level was sent
+  // since the failure, is skipped. Returns false if nothing was queued.
+  bool retry(const Entry &entry);
+  // Record the level reported by the gear, e.g. by QUERY ACTUAL LEVEL.
+  void set_level(uint8_t short_address, uint8_t level);
+  // Drop the level queued for the gear.
+  void cancel(uint8_t short_address) {
+    this->pending_[short_address & (SIZE - 1)] = DA_MASK;
+  }
+  // Forget the level of the gear, the next push() is always sent.
+  void forget(uint8_t short_address);
+  // Level last sent to or reported by the gear.
+  std::optional<uint8_t> level(uint8_t short_address) const;
+  bool empty() const;
+
+protected:
+  // DA_MASK marks an empty slot, DirectArc never sends it as level.
+  std::array<uint8_t, SIZE> pending_ = filled_(DA_MASK);
+  std::array<uint8_t, SIZE> pending_fade_{};
+  std::array<uint8_t, GROUPS> pending_group_ = filled_<GROUPS>(DA_MASK);
+  std::array<uint8_t, GROUPS> pending_group_fade_{};
+  std::array<std::bitset<SIZE>, GROUPS> members_{};
+  std::array<uint8_t, SIZE> known_ = filled_(DA_MASK);
+  size_t cursor_ = 0;
+  std::bitset<SIZE> gear_;
+  bool broadcast_collapse_ = false;
+
+  std::optional<Entry> pop_group_();
+  std::optional<Entry> pop_broadcast_();
+
+  template <size_t N = SIZE>
+  static constexpr std::array<uint8_t, N> filled_(uint8_t v) {
+    std::array<uint8_t, N> a{};
+    a.fill(v);
+    return a;
+  }
+};
+
+} // namespace libdali
@@ -0,0 +1,136 @@
+#include "arc_sender.h"
+
+namespace libdali {
+
+void ArcSender::add_(uint8_t address, uint8_t data, bool repeat) {
+  this->frames_[this->count_++] =
+      Frame{.address = address, .data = data, .repeat = repeat};
+}
+
+void ArcSender::send(const ArcQueue::Entry &entry,
+                     const std::bitset<Inventory::SHORT_ADDRESSES> &targets) {
+  this->entry_ = entry;
+  this->targets_ = targets;
+  this->count_ = 0;
+  this->next_ = 0;
+  this->pair_repeats_ = 0;
+  this->busy_ = true;
+
+  bool unknown = false, differs = false;
+  for (uint8_t i = 0; i < Inventory::SHORT_ADDRESSES; i++) {
+    if (!this->targets_.test(i)) {
+      continue;
+    }
+    auto fade = this->inventory_->gear(i).extended_fade_time;
+    unknown |= fade == DA_MASK;
+    // A change without fade keeps a short fade that is already programmed.
+    differs |= fade != entry.fade &&
+               (entry.fade != 0 || fade == DA_MASK ||
+                extended_fade_time_ms(fade) > SHORT_FADE_MS);
+  }
+  auto command = entry.address().command();
+  if (unknown) {
+    this->add_(DA_DTR0, 0);
+    this->add_(command, SetFadeTime.command);
+    this->add_(command, SetFadeTime.command, true);
+  }
+  this->fade_sent_ = differs;
+  if (differs) {
+    this->add_(DA_DTR0, entry.fade);
+    this->add_(command, SetExtendedFadeTime.command);
+    this->add_(command, SetExtendedFadeTime.command, true);
+  }
+  if (unknown || differs) {
+    // The DTR0 frames bypass the register cache.
+    this->bus_->shadow.invalidate();
+  }
+  this->add_(entry.address().dacp(), entry.level);
+
+  // Get the first frame on the wire right away.
+  if (this->submit_()) {
+    this->bus_->poll();
+  }
+}
+
+bool ArcSender::submit_() {
+  const auto &frame = this->frames_[this->next_];
+  auto handle = this->bus_->submit(frame.address, frame.data, 0);
+  if (!handle) {
+    return false;
+  }
+  this->handle_ = *handle;
+  this->next_++;
+  if (this->next_ < this->count_ && this->frames_[this->next_].repeat) {
+    this->pair_ms_ = this->bus_->now_ms();
+  }
+  return true;
+}
+
+ErrorCode ArcSender::finish_(ErrorCode err) {
+  this->busy_ = false;
+  for (uint8_t i = 0; i < Inventory::SHORT_ADDRESSES; i++) {
+    if (!this->targets_.test(i)) {
+      continue;
+    }
+    if (!err) {
+      this->inventory_->set_level(i, this->entry_.level);
+      if (this->fade_sent_) {
+        this->inventory_->set_extended_fade_time(i, this->entry_.fade);
+      }
+    } else if (this->count_ > 1) {
+      // The fade time may be half programmed.
+      this->inventory_->set_extended_fade_time(i, DA_MASK);
+    }
+  }
+  return err;
+}
+
+void ArcSender::late_pair_() {
+  // The gear ignores the second frame, the fade time may be half programmed.
+  for (uint8_t i = 0; i < Inventory::SHORT_ADDRESSES; i++) {
+    if (this->targets_.test(i)) {
+      this->inventory_->set_extended_fade_time(i, DA_MASK);
+    }
+  }
+  if (this->pair_repeats_ < MAX_PAIR_REPEATS) {
+    this->pair_repeats_++;
+    // Again from DTR0.
+    this->next_ -= 2;
+    return;
+  }
+  // Give up the fade, the level is still sent.
+  this->fade_sent_ = false;
+  this->next_++;
+}
+
+std::optional<ErrorCode> ArcSender::poll() {
+  if (!this->busy_) {
+    return std::nullopt;
+  }
+  while (true) {
+    if (this->handle_.has_value()) {
+      auto result = this->bus_->poll(*this->handle_, nullptr);
+      if (!result.has_value()) {
+        return std::nullopt;
+      }
+      this->handle_.reset();
+      if (*result) {
+        return this->finish_(*result);
+      }
+    }
+    if (this->next_ == this->count_) {
+      return this->finish_(ErrorCode::OK);
+    }
+    if (this->frames_[this->next_].repeat &&
+        this->bus_->now_ms() - this->pair_ms_ > SEND_TWICE_MS) {
+      this->late_pair_();
+      continue;
+    }
+    if (!this->submit_()) {
+      // Queue full, retry on the next poll.
+      return std::nullopt;
+    }
+  }
+}
+
+} // namespace libdali
@@ -0,0 +1,80 @@
+#pragma once
+#include "arc_queue.h"
+#include "inventory.h"
+#include "lw14.h"
+
+namespace libdali {
+
+// Sends ArcQueue entries with LW14Adapter::submit() and poll(), one frame at
+// a time, so the caller never blocks.
+//
+// The gear does the fade to the level itself: if the fade of the entry
+// differs from the extended fade time cached in the inventory, DTR0 and
+// SET EXTENDED FADE TIME go before the DirectArc. Gear whose fade time was
+// not programmed yet also gets FADE TIME 0, which selects the extended fade
+// time. An entry without fade keeps an extended fade time of up to
+// SHORT_FADE_MS instead of reprogramming it. Levels and fade times are
+// recorded in the inventory.
+//
+// The gear ignores a configuration command not repeated within
+// SEND_TWICE_MS. If the second frame of a pair cannot be sent in time, e.g.
+// because poll() was called late, the pair is sent again from its DTR0
+// frame, up to MAX_PAIR_REPEATS times. Then the level is sent without
+// recording the fade, the next send() programs it again.
+class ArcSender {
+public:
+  static constexpr uint32_t SHORT_FADE_MS = 200;
+  static constexpr uint32_t SEND_TWICE_MS = 100;
+  static constexpr uint8_t MAX_PAIR_REPEATS = 2;
+
+  ArcSender(LW14Adapter *bus, Inventory *inventory)
+      : bus_(bus), inventory_(inventory) {}
+
+  // Start sending the entry to `targets`, see ArcQueue::targets().
+  void send(const ArcQueue::Entry &entry,
+            const std::bitset<Inventory::SHORT_ADDRESSES> &targets);
+  bool busy() const { return this->busy_; }
+  // Advance without blocking. Returns the outcome once the entry was sent.
+  std::optional<ErrorCode> poll();
+  // Entry of the last send().
+  const ArcQueue::Entry &entry() const { return this->entry_; }
+  // Frames of the last send().
+  uint8_t frames() const { return this->count_; }
+  // Send-twice pairs of the last send() sent again.
+  uint8_t pair_repeats() const { return this->pair_repeats_; }
+
+protected:
+  struct Frame {
+    uint8_t address, data;
+    // Second frame of a configuration command sent twice.
+    bool repeat;
+  };
+  // DTR0 and FADE TIME twice, DTR0 and EXTENDED FADE TIME twice, DirectArc.
+  static constexpr size_t MAX_FRAMES = 7;
+
+  void add_(uint8_t address, uint8_t data, bool repeat = false);
+  // The second frame of the pair at next_ is too late to be sent.
+  void late_pair_();
+  // Submit the next frame, false if the adapter queue is full.
+  bool submit_();
+  ErrorCode finish_(ErrorCode err);
+
+  LW14Adapter *bus_;
+  Inventory *inventory_;
+  ArcQueue::Entry entry_{};
+  std::bitset<Inventory::SHORT_ADDRESSES> targets_;
+  bool busy_ = false;
+  // The last send() programs the extended fade time.
+  bool fade_sent_ = false;
+
+  std::array<Frame, MAX_FRAMES> frames_{};
+  uint8_t count_ = 0;
+  // Next frame to submit.
+  uint8_t next_ = 0;
+  // Transport milliseconds the first frame of the current pair was sent.
+  uint32_t pair_ms_ = 0;
+  uint8_t pair_repeats_ = 0;
+  std::optional<CommandHandle> handle_;
+};
+
+} // namespace libdali
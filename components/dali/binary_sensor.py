@@ -0,0 +1,31 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import binary_sensor
+from esphome.const import CONF_TYPE
+from . import Bus, dali_ns
+
+GearBinarySensor = dali_ns.class_("GearBinarySensor", binary_sensor.BinarySensor)
+GearBinarySensorType = dali_ns.enum("GearBinarySensorType", is_class=True)
+
+DEPENDENCIES = ["dali"]
+CONF_BUS = "bus"
+CONF_SHORT_ADDRESS = "short_address"
+TYPES = {
+    "present": GearBinarySensorType.PRESENT,
+    "lamp_failure": GearBinarySensorType.LAMP_FAILURE,
+    "power_failure": GearBinarySensorType.POWER_FAILURE,
+}
+CONFIG_SCHEMA = binary_sensor.binary_sensor_schema(GearBinarySensor).extend(
+    {
+        cv.Required(CONF_BUS): cv.use_id(Bus),
+        cv.Required(CONF_SHORT_ADDRESS): cv.int_range(min=0, max=63),
+        cv.Required(CONF_TYPE): cv.enum(TYPES, lower=True),
+    }
+)
+
+async def to_code(config):
+    var = await binary_sensor.new_binary_sensor(config)
+    bus = await cg.get_variable(config[CONF_BUS])
+    cg.add(var.set_short_address(config[CONF_SHORT_ADDRESS]))
+    cg.add(var.set_type(config[CONF_TYPE]))
+    cg.add(bus.add_binary_sensor(var))
@@ -0,0 +1,93 @@
+#pragma once
+#include "dali.h"
+#include <array>
+
+namespace libdali {
+
+// Kind of a forward frame, by its address byte and expected reply.
+enum class CommandClass : uint8_t {
+  // Level or configuration command to gear, without reply.
+  CONTROL,
+  // Command to gear with a reply.
+  QUERY,
+  // Special command (DTR, INITIALISE, SEARCHADDR, COMPARE, ...).
+  SPECIAL,
+};
+
+constexpr CommandClass command_class(uint8_t address, size_t reply_length) {
+  // Special commands use the odd address bytes 101xxxx1 and 110xxxx1.
+  if ((address & 1) &&
+      ((address & 0xe0) == 0xa0 || (address & 0xe0) == 0xc0)) {
+    return CommandClass::SPECIAL;
+  }
+  return reply_length > 0 ? CommandClass::QUERY : CommandClass::CONTROL;
+}
+
+// Latency of the commands of one class, from submit() to completion, in
+// buckets of transport milliseconds.
+struct LatencyHistogram {
+  // Upper bounds of the buckets, the last bucket takes everything above.
+  static constexpr std::array<uint32_t, 6> BOUNDS_MS = {20, 40, 80,
+                                                        160, 320, 640};
+  static constexpr size_t BUCKETS = BOUNDS_MS.size() + 1;
+
+  void add(uint32_t ms) {
+    size_t i = 0;
+    while (i < BOUNDS_MS.size() && ms > BOUNDS_MS[i]) {
+      i++;
+    }
+    this->buckets[i]++;
+    this->count++;
+    this->total_ms += ms;
+    if (ms > this->max_ms) {
+      this->max_ms = ms;
+    }
+  }
+  uint32_t average_ms() const {
+    return this->count == 0 ? 0 : this->total_ms / this->count;
+  }
+
+  std::array<uint32_t, BUCKETS> buckets{};
+  uint32_t count = 0;
+  uint64_t total_ms = 0;
+  uint32_t max_ms = 0;
+};
+
+// Counters of an LW14Adapter since start or the last reset. Fixed size, the
+// adapter updates them without allocating.
+struct BusMetrics {
+  static constexpr size_t ERROR_CODES = ErrorCode::INVALID_ARGUMENT + 1;
+  static constexpr size_t COMMAND_CLASSES = 3;
+
+  // Completed commands by result.
+  std::array<uint32_t, ERROR_CODES> results{};
+  std::array<LatencyHistogram, COMMAND_CLASSES> latency{};
+  // Commands rejected by submit() because the queue was full.
+  uint32_t queue_full = 0;
+  // Status reads that found the bus busy or a reply window open before a
+  // command could be sent.
+  uint32_t busy_waits = 0;
+  // Stale telegrams read from the COMMAND register before sending.
+  uint32_t stale_telegrams = 0;
+  // Status reads while waiting for a reply that found a telegram overwritten
+  // before it was read, e.g. by frames of another master.
+  uint32_t overruns = 0;
+  uint32_t i2c_transactions = 0;
+
+  uint32_t result(ErrorCode code) const {
+    return this->results[static_cast<ErrorCode::code_t>(code)];
+  }
+  const LatencyHistogram &latency_of(CommandClass c) const {
+    return this->latency[static_cast<size_t>(c)];
+  }
+  uint32_t commands() const {
+    uint32_t n = 0;
+    for (auto count : this->results) {
+      n += count;
+    }
+    return n;
+  }
+  void reset() { *this = BusMetrics{}; }
+};
+
+} // namespace libdali
@@ -0,0 +1,152 @@
+#include "commissioning.h"
+
+namespace libdali {
+
+ErrorCode Commissioning::run(CommissioningMode mode) {
+  // Only send DTR and SEARCHADDR frames that change the gear registers.
+  RegisterCacheScope cache(this->bus_);
+  this->gear_ = {};
+  this->added_ = 0;
+  this->unassigned_ = 0;
+  this->compares_ = 0;
+
+  ErrorCode err;
+  if (mode == CommissioningMode::FULL) {
+    // Delete all existing short addresses.
+    err = DataTransferRegister(this->bus_, DA_MASK);
+    if (err) {
+      return err;
+    }
+    err = StoreDTRAsShortAddress(this->bus_, Broadcast);
+    if (err) {
+      return err;
+    }
+  } else {
+    err = this->scan_();
+    if (err) {
+      return err;
+    }
+  }
+
+  // Terminate other potentially running initialise.
+  err = Terminate(this->bus_);
+  if (err) {
+    return err;
+  }
+
+  // Start initialisation, the gear will accept addressing commands for 15min.
+  err = Initialise(this->bus_, mode == CommissioningMode::FULL
+                                   ? InitialiseMode::ALL
+                                   : InitialiseMode::NEW);
+  if (err) {
+    return err;
+  }
+
+  // Command gears to chose a random address.
+  err = Randomise(this->bus_);
+  if (err) {
+    return err;
+  }
+
+  // Give gears 100ms time to find their random address.
+  this->bus_->delay_microseconds(100000);
+
+  err = this->address_();
+  auto terminate_err = Terminate(this->bus_);
+  return err ? err : terminate_err;
+}
+
+ErrorCode Commissioning::scan_() {
+  for (uint8_t short_address = 0; short_address < SHORT_ADDRESSES;
+       short_address++) {
+    auto address = Address::from_short_address(short_address);
+    auto &gear = this->gear_[short_address];
+    auto present = QueryControlGearPresent(this->bus_, address);
+    if (!present && present.error() != ErrorCode::FRAME_ERROR) {
+      return present.error();
+    }
+    if (present && !*present) {
+      continue;
+    }
+    gear.present = true;
+
+    // QUERY RANDOM ADDRESS is DALI-2, DALI-1 gear does not answer it. Its
+    // random address stays unknown, the short address is used all the same.
+    auto random_address = QueryRandomAddress(this->bus_, address);
+    if (random_address) {
+      gear.random_address = *random_address;
+    } else if (random_address.error() == ErrorCode::FRAME_ERROR) {
+      gear.conflict = true;
+    } else if (random_address.error() != ErrorCode::TIMEOUT) {
+      return random_address.error();
+    }
+  }
+  return ErrorCode::OK;
+}
+
+std::optional<uint8_t> Commissioning::free_short_address_() const {
+  for (uint8_t short_address = 0; short_address < SHORT_ADDRESSES;
+       short_address++) {
+    if (!this->gear_[short_address].present) {
+      return short_address;
+    }
+  }
+  return std::nullopt;
+}
+
+ErrorCode Commissioning::address_() {
+  RandomAddressSearch search(this->bus_);
+  while (true) {
+    auto found = search.next();
+    this->compares_ = search.compares();
+    if (!found) {
+      return found.error();
+    }
+    if (!found->found) {
+      return ErrorCode::OK;
+    }
+
+    // Exclude the gear from further COMPARE in this initialisation.
+    auto withdrawn = search.withdraw();
+    this->compares_ = search.compares();
+    if (!withdrawn) {
+      return withdrawn.error();
+    }
+    if (!*withdrawn) {
+      // The search would find the same gear again.
+      return ErrorCode::FRAME_ERROR;
+    }
+
+    auto short_address = this->free_short_address_();
+    if (!short_address) {
+      this->unassigned_++;
+      continue;
+    }
+
+    auto err = SearchAddrs(this->bus_, SearchAddr(found->random_address));
+    if (err) {
+      return err;
+    }
+    err = ProgramShortAddress(this->bus_, *short_address);
+    if (err) {
+      return err;
+    }
+    auto verified = VerifyShortAddress(
+        this->bus_, Address::from_short_address(*short_address));
+    if (!verified) {
+      return verified.error();
+    }
+    if (!*verified) {
+      this->unassigned_++;
+      continue;
+    }
+
+    auto &gear = this->gear_[*short_address];
+    gear.present = true;
+    gear.added = true;
+    gear.random_address = found->random_address;
+    this->added_++;
+  }
+}
+
+} // namespace libdali
@@ -0,0 +1,59 @@
+#pragma once
+#include "dali.h"
+#include "search.h"
+#include <array>
+
+namespace libdali {
+
+enum class CommissioningMode {
+  // Delete all short addresses and address the whole line from 0 on.
+  FULL,
+  // Keep the addressed gear and give gear without a short address the free
+  // short addresses.
+  INCREMENTAL,
+};
+
+// Assigns short addresses to the gear on the line.
+class Commissioning {
+public:
+  static constexpr uint8_t SHORT_ADDRESSES = 64;
+
+  struct Gear {
+    bool present = false;
+    // Got its short address in this run.
+    bool added = false;
+    // More than one gear answered for the short address.
+    bool conflict = false;
+    // Unknown for DALI-1 gear found by the incremental scan.
+    std::optional<uint32_t> random_address;
+  };
+
+  explicit Commissioning(BusInterface *bus) : bus_(bus) {}
+
+  ErrorCode run(CommissioningMode mode);
+
+  const Gear &gear(uint8_t short_address) const {
+    return this->gear_[short_address];
+  }
+  // Gear that got a short address in the last run.
+  uint8_t added() const { return this->added_; }
+  // Gear found without a short address after all short addresses were used.
+  uint8_t unassigned() const { return this->unassigned_; }
+  // COMPARE frames sent in the last run.
+  uint32_t compares() const { return this->compares_; }
+
+protected:
+  // Find the gear already holding a short address.
+  ErrorCode scan_();
+  // Address the gear in initialisation state into the free short addresses.
+  ErrorCode address_();
+  std::optional<uint8_t> free_short_address_() const;
+
+  BusInterface *bus_;
+  std::array<Gear, SHORT_ADDRESSES> gear_{};
+  uint8_t added_ = 0;
+  uint8_t unassigned_ = 0;
+  uint32_t compares_ = 0;
+};
+
+} // namespace libdali
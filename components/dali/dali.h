@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <bitset>
 #include <cstddef>
 #include <cstdint>
@@ -10,7 +11,15 @@
 namespace libdali {
 
 struct ErrorCode {
-  enum code_t { OK, TIMEOUT, BUS_BUSY, BUS_ERROR, FRAME_ERROR, I2C_ERROR };
+  enum code_t {
+    OK,
+    TIMEOUT,
+    BUS_BUSY,
+    BUS_ERROR,
+    FRAME_ERROR,
+    I2C_ERROR,
+    INVALID_ARGUMENT
+  };
   constexpr ErrorCode(code_t c = OK) : c_(c) {}
   constexpr const char *text() const { return strings[static_cast<int>(c_)]; }
   constexpr operator const char *() const { return text(); }
@@ -23,12 +32,13 @@ struct ErrorCode {
 
 private:
   code_t c_;
-  constexpr static const char *strings[6] = {"OK",
+  constexpr static const char *strings[7] = {"OK",
                                              "Error: timeout",
                                              "Error: Bus busy",
                                              "Error: bus error",
                                              "Error: frame error",
-                                             "Error: i2c error"};
+                                             "Error: i2c error",
+                                             "Error: invalid argument"};
 };
 
 template <typename T> class Result : public std::optional<T> {
@@ -41,6 +51,35 @@ public:
   ErrorCode error() const { return this->error_; }
 };
 
+// Duration of `te` DALI half bit periods (Te = 416.67us) in microseconds.
+constexpr uint32_t dali_te_us(uint32_t te) { return te * 416667 / 1000; }
+
+// Shadow copy of the registers all gear share by being written with
+// broadcast special commands: DTR0, DTR1 and the search address. While
+// enabled, frames that would not change them are not sent.
+// Gear that power cycles or another master on the bus can change the
+// registers behind our back, so the cache is only enabled for the duration
+// of a RegisterCacheScope, e.g. a commissioning run.
+struct ShadowRegisters {
+  bool enabled = false;
+  std::optional<uint8_t> dtr0, dtr1;
+  std::optional<uint8_t> search_h, search_m, search_l;
+  void invalidate() {
+    this->dtr0.reset();
+    this->dtr1.reset();
+    this->invalidate_search();
+  }
+  void invalidate_search() {
+    this->search_h.reset();
+    this->search_m.reset();
+    this->search_l.reset();
+  }
+};
+
+// Runtime interface of a DALI master. The commands below are templates on the
+// bus type: called with a BusInterface they dispatch DaliCommand() at runtime,
+// called with a bus class that declares it final, e.g. an LW14AdapterT, the
+// compiler resolves the call and can inline the whole command.
 class BusInterface {
 public:
   virtual ~BusInterface() {}
@@ -48,8 +87,48 @@ public:
                                 size_t reply_length,
                                 uint32_t timeout_ms = 150) = 0;
   virtual void delay_microseconds(uint32_t us) = 0;
+  // Milliseconds of the clock delay_microseconds() waits on.
+  virtual uint32_t now_ms() = 0;
+
+  ShadowRegisters shadow;
 };
 
+// Enables the shadow register cache of the bus while in scope.
+class RegisterCacheScope {
+  BusInterface *bus_;
+
+public:
+  RegisterCacheScope(BusInterface *bus) : bus_(bus) {
+    this->bus_->shadow.invalidate();
+    this->bus_->shadow.enabled = true;
+  }
+  RegisterCacheScope(const RegisterCacheScope &o) = delete;
+  RegisterCacheScope &operator=(const RegisterCacheScope &o) = delete;
+  ~RegisterCacheScope() {
+    this->bus_->shadow.enabled = false;
+    this->bus_->shadow.invalidate();
+  }
+};
+
+// Sends the special command `address` with `value`, unless the shadow
+// register `reg` shows that the gear already hold the value. A failed frame
+// may have reached only some gear, or the gear lost power and reset their
+// registers, so all shadow registers are forgotten.
+template <typename BusT>
+ErrorCode WriteShadowed(BusT *bus, std::optional<uint8_t> &reg,
+                        uint8_t address, uint8_t value) {
+  if (bus->shadow.enabled && reg == value) {
+    return ErrorCode::OK;
+  }
+  auto err = bus->DaliCommand(address, value, nullptr, 0);
+  if (err) {
+    bus->shadow.invalidate();
+  } else {
+    reg = value;
+  }
+  return err;
+}
+
 constexpr static const uint8_t DA_MASK = 0xff;
 
 class Address {
@@ -64,16 +143,21 @@ public:
   static Address from_short_address(const uint8_t shortAddress) {
     return Address(shortAddress & 63);
   }
+  // Group address G0-G15, 100gggg.
+  static Address from_group(const uint8_t group) {
+    return Address(0x40 | (group & 15));
+  }
 };
 
 static const Address Broadcast(0x7f);
 
 // forward declaration of function DataTransferRegister.
-static ErrorCode DataTransferRegister(BusInterface *bus, uint8_t value);
+template <typename BusT>
+ErrorCode DataTransferRegister(BusT *bus, uint8_t value);
 
 // DirectArc command.
-static ErrorCode DirectArc(BusInterface *bus, const Address &address,
-                           uint8_t power) {
+template <typename BusT>
+ErrorCode DirectArc(BusT *bus, const Address &address, uint8_t power) {
   if (power == DA_MASK) {
     power = 254;
   }
@@ -81,13 +165,15 @@ static ErrorCode DirectArc(BusInterface *bus, const Address &address,
 }
 
 // DirectArc command, modus stop fading.
-static ErrorCode DirectArcStopFading(BusInterface *bus, const Address& address) {
+template <typename BusT>
+ErrorCode DirectArcStopFading(BusT *bus, const Address& address) {
     return bus->DaliCommand(address.dacp(), DA_MASK, nullptr, 0);
 }
 
 struct ControlCommand {
   uint8_t command;
-  ErrorCode operator()(BusInterface *bus, const Address &address) const {
+  template <typename BusT>
+  ErrorCode operator()(BusT *bus, const Address &address) const {
     return bus->DaliCommand(address.command(), this->command, nullptr, 0);
   }
 };
@@ -122,10 +208,72 @@ constexpr static const ControlCommand OnAndStepUp{.command = 0x08};
 // Command 9: ENABLE DAPC SEQUENCE
 constexpr static const ControlCommand EnableDAPCSequence{.command = 0x09};
 
+// Command 16-31: GO TO SCENE
+// Gear that is not part of the scene keeps its level.
+constexpr static const uint8_t DA_GO_TO_SCENE = 0x10;
+template <typename BusT>
+ErrorCode GoToScene(BusT *bus, const Address &address, uint8_t scene) {
+  return bus->DaliCommand(address.command(), DA_GO_TO_SCENE | (scene & 15),
+                          nullptr, 0);
+}
+
+// Command 64-79: STORE DTR AS SCENE
+// Stores DTR0 as level of the scene, DA_MASK removes the gear from it.
+// This function implements sending the command twice.
+constexpr static const uint8_t DA_STORE_DTR_AS_SCENE = 0x40;
+template <typename BusT>
+ErrorCode StoreDTRAsScene(BusT *bus, const Address &address, uint8_t scene) {
+  uint8_t command = DA_STORE_DTR_AS_SCENE | (scene & 15);
+  auto err = bus->DaliCommand(address.command(), command, nullptr, 0);
+  if (err) {
+    return err;
+  }
+  return bus->DaliCommand(address.command(), command, nullptr, 0);
+}
+
+// Command 80-95: REMOVE FROM SCENE
+// This function implements sending the command twice.
+constexpr static const uint8_t DA_REMOVE_FROM_SCENE = 0x50;
+template <typename BusT>
+ErrorCode RemoveFromScene(BusT *bus, const Address &address, uint8_t scene) {
+  uint8_t command = DA_REMOVE_FROM_SCENE | (scene & 15);
+  auto err = bus->DaliCommand(address.command(), command, nullptr, 0);
+  if (err) {
+    return err;
+  }
+  return bus->DaliCommand(address.command(), command, nullptr, 0);
+}
+
+// Command 96-111: ADD TO GROUP
+// This function implements sending the command twice.
+constexpr static const uint8_t DA_ADD_TO_GROUP = 0x60;
+template <typename BusT>
+ErrorCode AddToGroup(BusT *bus, const Address &address, uint8_t group) {
+  uint8_t command = DA_ADD_TO_GROUP | (group & 15);
+  auto err = bus->DaliCommand(address.command(), command, nullptr, 0);
+  if (err) {
+    return err;
+  }
+  return bus->DaliCommand(address.command(), command, nullptr, 0);
+}
+
+// Command 112-127: REMOVE FROM GROUP
+// This function implements sending the command twice.
+constexpr static const uint8_t DA_REMOVE_FROM_GROUP = 0x70;
+template <typename BusT>
+ErrorCode RemoveFromGroup(BusT *bus, const Address &address, uint8_t group) {
+  uint8_t command = DA_REMOVE_FROM_GROUP | (group & 15);
+  auto err = bus->DaliCommand(address.command(), command, nullptr, 0);
+  if (err) {
+    return err;
+  }
+  return bus->DaliCommand(address.command(), command, nullptr, 0);
+}
+
 // Command 128: STORE DTR AS SHORT ADDRESS
 // This command will be send twice.
-static ErrorCode StoreDTRAsShortAddress(BusInterface *bus,
-                                        const Address &address) {
+template <typename BusT>
+ErrorCode StoreDTRAsShortAddress(BusT *bus, const Address &address) {
   auto err = bus->DaliCommand(address.command(), 0x80, nullptr, 0);
   if (err) {
     return err;
@@ -135,7 +283,8 @@ static ErrorCode StoreDTRAsShortAddress(BusInterface *bus,
 
 template <typename T> struct QueryCommand {
   const uint8_t command;
-  Result<T> operator()(BusInterface *bus, const Address &address) const {
+  template <typename BusT>
+  Result<T> operator()(BusT *bus, const Address &address) const {
     uint8_t reply = 0;
     auto err = bus->DaliCommand(address.command(), this->command, &reply, 1);
     if (err) {
@@ -170,13 +319,84 @@ struct QueryStatusResponse {
 constexpr static const QueryCommand<QueryStatusResponse> QueryStatus{.command =
                                                                          0x90};
 
+// Command 145: QUERY CONTROL GEAR PRESENT
+// No reply means no gear with the address is present.
+template <typename BusT>
+Result<bool> QueryControlGearPresent(BusT *bus, const Address &address) {
+  uint8_t reply;
+  auto err = bus->DaliCommand(address.command(), 0x91, &reply, 1);
+  if (err == ErrorCode::TIMEOUT) {
+    return Result<bool>(false);
+  }
+  if (err) {
+    return Result<bool>(err);
+  }
+  return Result<bool>(reply == 0xff);
+}
+
 // Command 160: QUERY ACTUAL LEVEL
 constexpr static const QueryCommand<uint8_t> QueryActualLevel{.command = 0xa0};
 
+// Command 176-191: QUERY SCENE LEVEL
+// DA_MASK if the gear is not part of the scene.
+constexpr static const uint8_t DA_QUERY_SCENE_LEVEL = 0xb0;
+template <typename BusT>
+Result<uint8_t> QuerySceneLevel(BusT *bus, const Address &address,
+                                uint8_t scene) {
+  uint8_t reply = 0;
+  auto err = bus->DaliCommand(address.command(),
+                              DA_QUERY_SCENE_LEVEL | (scene & 15), &reply, 1);
+  if (err) {
+    return Result<uint8_t>(err);
+  }
+  return Result<uint8_t>(reply);
+}
+
+// Command 192, 193: QUERY GROUPS 0-7, QUERY GROUPS 8-15
+constexpr static const QueryCommand<uint8_t> QueryGroupsL{.command = 0xc0};
+constexpr static const QueryCommand<uint8_t> QueryGroupsH{.command = 0xc1};
+
+// Group membership as bit mask, bit n for group n.
+template <typename BusT>
+Result<uint16_t> QueryGroups(BusT *bus, const Address &address) {
+  auto low = QueryGroupsL(bus, address);
+  if (!low) {
+    return Result<uint16_t>(low.error());
+  }
+  auto high = QueryGroupsH(bus, address);
+  if (!high) {
+    return Result<uint16_t>(high.error());
+  }
+  return Result<uint16_t>(static_cast<uint16_t>(*high << 8 | *low));
+}
+
+// Command 194-196: QUERY RANDOM ADDRESS (H), (M), (L)
+constexpr static const QueryCommand<uint8_t> QueryRandomAddressH{.command =
+                                                                     0xc2};
+constexpr static const QueryCommand<uint8_t> QueryRandomAddressM{.command =
+                                                                     0xc3};
+constexpr static const QueryCommand<uint8_t> QueryRandomAddressL{.command =
+                                                                     0xc4};
+
+// The 24bit random address, queried byte by byte.
+template <typename BusT>
+Result<uint32_t> QueryRandomAddress(BusT *bus, const Address &address) {
+  uint32_t value = 0;
+  for (auto query : {QueryRandomAddressH, QueryRandomAddressM,
+                     QueryRandomAddressL}) {
+    auto byte = query(bus, address);
+    if (!byte) {
+      return Result<uint32_t>(byte.error());
+    }
+    value = (value << 8) | *byte;
+  }
+  return Result<uint32_t>(value);
+}
+
 struct DTR0Command {
   const uint8_t command;
-  ErrorCode operator()(BusInterface *bus, const Address &address,
-                       uint8_t dtr0) const {
+  template <typename BusT>
+  ErrorCode operator()(BusT *bus, const Address &address, uint8_t dtr0) const {
     auto err = DataTransferRegister(bus, dtr0);
     if (err) {
       return err;
@@ -187,6 +407,59 @@ struct DTR0Command {
   }
 };
 
+// DTR0 command that configures the gear, sent twice.
+struct DTR0ConfigCommand {
+  const uint8_t command;
+  template <typename BusT>
+  ErrorCode operator()(BusT *bus, const Address &address, uint8_t dtr0) const {
+    auto err = DataTransferRegister(bus, dtr0);
+    if (err) {
+      return err;
+    }
+    err = bus->DaliCommand(address.command(), this->command, nullptr, 0);
+    if (err) {
+      return err;
+    }
+    return bus->DaliCommand(address.command(), this->command, nullptr, 0);
+  }
+};
+
+// Command 46: SET FADE TIME
+// DTR0 = 0: the extended fade time is used. DTR0 = 1-15: 0.7s to 90.5s.
+constexpr static const DTR0ConfigCommand SetFadeTime{.command = 0x2e};
+
+// Command 48: SET EXTENDED FADE TIME
+// DTR0 as returned by extended_fade_time().
+constexpr static const DTR0ConfigCommand SetExtendedFadeTime{.command = 0x30};
+
+// DTR0 value of SET EXTENDED FADE TIME for a fade of `ms`: the base value
+// 1-16 in bits 3:0 (stored minus one) times the multiplier in bits 6:4, 1 for
+// 100ms, 2 for 1s, 3 for 10s and 4 for 1min. The smallest multiplier that
+// fits is used and the base rounded. 0 is no fade, fades are at most 16min.
+constexpr uint8_t extended_fade_time(uint32_t ms) {
+  constexpr uint32_t multiplier_ms[] = {100, 1000, 10000, 60000};
+  if (ms < multiplier_ms[0] / 2) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < 4; i++) {
+    auto base = (ms + multiplier_ms[i] / 2) / multiplier_ms[i];
+    if (base <= 16) {
+      return static_cast<uint8_t>(((i + 1) << 4) | ((base > 0 ? base : 1) - 1));
+    }
+  }
+  return 0x4f;
+}
+
+// Fade in milliseconds of an extended_fade_time() value.
+constexpr uint32_t extended_fade_time_ms(uint8_t value) {
+  constexpr uint32_t multiplier_ms[] = {0, 100, 1000, 10000, 60000};
+  auto multiplier = value >> 4;
+  if (multiplier > 4) {
+    return 0;
+  }
+  return multiplier_ms[multiplier] * ((value & 0x0f) + 1);
+}
+
 // Command 227: SELECT DIMMING CURVE
 // DTR = 1: linear curve. DTR = 0: logarithmic curve.
 constexpr static const DTR0Command SelectDimmingCurve{.command = 0xE3};
@@ -257,7 +530,8 @@ constexpr static const QueryCommand<bool> QueryShortCircuit{.command = 0xf2};
 // Command 250: COMPARE
 // A gear will respond with "yes" (0xff) => true, if it's
 // BRN is smaller or equal to the current SEARCHADDR.
-static Result<bool> Compare(BusInterface *bus) {
+template <typename BusT>
+Result<bool> Compare(BusT *bus) {
   uint8_t reply;
   auto err = bus->DaliCommand(0xa9, 0, &reply, 1);
   if (err == ErrorCode::TIMEOUT) {
@@ -270,7 +544,8 @@ static Result<bool> Compare(BusInterface *bus) {
 }
 
 // Command 251: TERMINATE
-static ErrorCode Terminate(BusInterface *bus) {
+template <typename BusT>
+ErrorCode Terminate(BusT *bus) {
   return bus->DaliCommand(0xa1, 0x00, nullptr, 0);
 }
 
@@ -296,14 +571,17 @@ constexpr static const QueryCommand<QueryOperatingModeResponse>
     QueryOperatingMode{.command = 0xfc};
 
 // Command 261: WITHDRAW
-static ErrorCode Withdraw(BusInterface *bus) {
+template <typename BusT>
+ErrorCode Withdraw(BusT *bus) {
   return bus->DaliCommand(0xab, 0x00, nullptr, 0);
 }
 
 // Command 257: DATA TRANSFER REGISTER (DTR)
 // Stores value in DTR0.
-static ErrorCode DataTransferRegister(BusInterface *bus, const uint8_t value) {
-  return bus->DaliCommand(0xa3, value, nullptr, 0);
+constexpr static const uint8_t DA_DTR0 = 0xa3;
+template <typename BusT>
+ErrorCode DataTransferRegister(BusT *bus, const uint8_t value) {
+  return WriteShadowed(bus, bus->shadow.dtr0, DA_DTR0, value);
 }
 
 enum class InitialiseMode : uint8_t {
@@ -312,7 +590,10 @@ enum class InitialiseMode : uint8_t {
 };
 
 // Command 258: INITIALISE
-static ErrorCode Initialise(BusInterface *bus, const InitialiseMode mode) {
+// Gear entering the initialisation state may hold any search address.
+template <typename BusT>
+ErrorCode Initialise(BusT *bus, const InitialiseMode mode) {
+  bus->shadow.invalidate_search();
   auto err = bus->DaliCommand(0xa5, static_cast<uint8_t>(mode), nullptr, 0);
   if (err) {
     return err;
@@ -322,7 +603,9 @@ static ErrorCode Initialise(BusInterface *bus, const InitialiseMode mode) {
 }
 
 // Command 258: INITIALISE with address.
-static ErrorCode Initialise(BusInterface *bus, const Address &address) {
+template <typename BusT>
+ErrorCode Initialise(BusT *bus, const Address &address) {
+  bus->shadow.invalidate_search();
   auto err = bus->DaliCommand(0xa5, address.command(), nullptr, 0);
   if (err) {
     return err;
@@ -334,7 +617,8 @@ static ErrorCode Initialise(BusInterface *bus, const Address &address) {
 // Command 259: RANDOMISE
 // Standard defines a gear may up to 100ms to define a new address.
 // This function implements sending the command twice.
-static ErrorCode Randomise(BusInterface *bus) {
+template <typename BusT>
+ErrorCode Randomise(BusT *bus) {
   auto err = bus->DaliCommand(0xa7, 0, nullptr, 0);
   if (err) {
     return err;
@@ -367,35 +651,40 @@ public:
 static const SearchAddr SearchAddrMax = SearchAddr(0x00ffffff);
 
 // Command 264-266: Sets the 24bit search addr.
-static ErrorCode SearchAddrs(BusInterface *bus, const SearchAddr &address) {
+// With the register cache enabled only the bytes that changed are sent.
+template <typename BusT>
+ErrorCode SearchAddrs(BusT *bus, const SearchAddr &address) {
   static const uint8_t SEARCHADDRH = 0xb1, SEARCHADDRM = 0xb3,
                        SEARCHADDRL = 0xb5;
-  auto err = bus->DaliCommand(SEARCHADDRH, address.h(), nullptr, 0);
+  auto err =
+      WriteShadowed(bus, bus->shadow.search_h, SEARCHADDRH, address.h());
   if (err) {
     return err;
   }
-  err = bus->DaliCommand(SEARCHADDRM, address.m(), nullptr, 0);
+  err = WriteShadowed(bus, bus->shadow.search_m, SEARCHADDRM, address.m());
   if (err) {
     return err;
   }
-  err = bus->DaliCommand(SEARCHADDRL, address.l(), nullptr, 0);
+  err = WriteShadowed(bus, bus->shadow.search_l, SEARCHADDRL, address.l());
   return err;
 }
 
 // Command 267: PROGRAM SHORT ADDRESS - Set short address.
-static ErrorCode ProgramShortAddress(BusInterface *bus, uint8_t shortAddress) {
+template <typename BusT>
+ErrorCode ProgramShortAddress(BusT *bus, uint8_t shortAddress) {
   return bus->DaliCommand(
       0xb7, Address::from_short_address(shortAddress).command(), nullptr, 0);
 }
 
 // Command 267: PROGRAM SHORT ADDRESS - Delete short address.
-static ErrorCode ProgramShortAddressDelete(BusInterface *bus) {
+template <typename BusT>
+ErrorCode ProgramShortAddressDelete(BusT *bus) {
   return bus->DaliCommand(0xb7, 0xff, nullptr, 0);
 }
 
 // Command 268: VERIFY SHORT ADDRESS
-static Result<bool> VerifyShortAddress(BusInterface *bus,
-                                       const Address &address) {
+template <typename BusT>
+Result<bool> VerifyShortAddress(BusT *bus, const Address &address) {
   uint8_t reply;
   auto err = bus->DaliCommand(0xb9, address.command(), &reply, 1);
   if (err == ErrorCode::TIMEOUT) {
@@ -408,8 +697,10 @@ static Result<bool> VerifyShortAddress(BusInterface *bus,
 }
 
 // Command 273: DATA TRANSFER REGISTER 1 (DTR1)
-static ErrorCode DataTransferRegister1(BusInterface *bus, uint8_t value) {
-  return bus->DaliCommand(0xc3, value, nullptr, 0);
+constexpr static const uint8_t DA_DTR1 = 0xc3;
+template <typename BusT>
+ErrorCode DataTransferRegister1(BusT *bus, uint8_t value) {
+  return WriteShadowed(bus, bus->shadow.dtr1, DA_DTR1, value);
 }
 
 // Access to memory banks
@@ -427,32 +718,127 @@ private:
   uint64_t value;
 };
 
-template <typename T> struct ReadMemory {
-  const uint8_t bank, location;
-  Result<T> operator()(BusInterface *bus, const Address &address) const {
-    constexpr static auto DA_READ_MEMORY_LOCATION = 0xC5;
+constexpr static auto DA_READ_MEMORY_LOCATION = 0xC5;
+
+// Size of memory bank 0 as defined by IEC 62386-102, locations 0x00-0x1a.
+constexpr size_t MEMORY_BANK0_SIZE = 0x1b;
+
+// A byte range of one memory bank of a gear, read in one sequential pass.
+// READ MEMORY LOCATION increments DTR0, so DTR1 and DTR0 are only written
+// once for the whole range.
+template <size_t Capacity> class MemoryBankBuffer {
+  uint8_t bank_ = 0, start_ = 0;
+  size_t length_ = 0;
+  std::array<uint8_t, Capacity> data_{};
+  // Locations the gear answered for.
+  std::bitset<Capacity> valid_;
+
+public:
+  uint8_t bank() const { return this->bank_; }
+  uint8_t start() const { return this->start_; }
+  // Number of locations read, including the ones without answer.
+  size_t length() const { return this->length_; }
+  bool contains(uint8_t bank, size_t location, size_t size) const {
+    if (bank != this->bank_ || location < this->start_ ||
+        location + size > this->start_ + this->length_) {
+      return false;
+    }
+    for (size_t i = location - this->start_; i < location + size - this->start_;
+         i++) {
+      if (!this->valid_.test(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  const uint8_t *at(size_t location) const {
+    return &this->data_[location - this->start_];
+  }
+
+  // Reads up to `length` bytes from `start` on. Location 0 of every bank
+  // holds its last accessible location, reading from 0 stops only there and
+  // skips locations below it the gear does not answer for, e.g. the reserved
+  // location 0x01 of bank 0. Other ranges stop at the first location the
+  // gear does not answer for.
+  template <typename BusT>
+  ErrorCode read(BusT *bus, const Address &address, uint8_t bank,
+                 uint8_t start = 0, size_t length = Capacity) {
+    this->bank_ = bank;
+    this->start_ = start;
+    this->length_ = 0;
+    this->valid_.reset();
+    if (length > Capacity) {
+      length = Capacity;
+    }
+    if (start + length > 0x100) {
+      length = 0x100 - start;
+    }
 
     auto err = DataTransferRegister1(bus, bank);
     if (err) {
       return err;
     }
-
-    err = DataTransferRegister(bus, location);
+    err = DataTransferRegister(bus, start);
     if (err) {
       return err;
     }
 
-    uint8_t buf[T::Size];
-    for (size_t i = 0; i < T::Size; i++) {
+    // READ MEMORY LOCATION increments DTR0 of the addressed gear only.
+    bus->shadow.dtr0.reset();
+    while (this->length_ < length) {
       err = bus->DaliCommand(address.command(), DA_READ_MEMORY_LOCATION,
-                             &buf[i], 1);
+                             &this->data_[this->length_], 1);
+      if (err == ErrorCode::TIMEOUT && this->length_ > 0) {
+        if (start != 0) {
+          // Past the last accessible location.
+          return ErrorCode::OK;
+        }
+        // Not implemented, DTR0 is incremented all the same.
+        this->data_[this->length_++] = 0;
+        continue;
+      }
       if (err) {
-        return Result<T>(err);
+        return err;
+      }
+      if (this->length_ == 0 && start == 0) {
+        size_t last = this->data_[0];
+        if (last + 1 < length) {
+          length = last + 1;
+        }
       }
+      this->valid_.set(this->length_++);
+    }
+    return ErrorCode::OK;
+  }
+};
+
+// Memory bank 0: identification of the gear.
+using MemoryBank0 = MemoryBankBuffer<MEMORY_BANK0_SIZE>;
+
+template <typename T> struct ReadMemory {
+  const uint8_t bank, location;
+  template <typename BusT>
+  Result<T> operator()(BusT *bus, const Address &address) const {
+    MemoryBankBuffer<T::Size> buffer;
+    auto err = buffer.read(bus, address, this->bank, this->location);
+    if (err) {
+      return Result<T>(err);
     }
-    T value(&buf[0]);
+    if (buffer.length() < T::Size) {
+      return Result<T>(ErrorCode(ErrorCode::TIMEOUT));
+    }
+    T value(buffer.at(this->location));
     return Result<T>(std::move(value));
   }
+  // Served from a bank read before, std::nullopt if the buffer does not
+  // contain the value.
+  template <size_t Capacity>
+  std::optional<T> operator()(const MemoryBankBuffer<Capacity> &buffer) const {
+    if (!buffer.contains(this->bank, this->location, T::Size)) {
+      return std::nullopt;
+    }
+    return T(buffer.at(this->location));
+  }
 };
 
 // Bank 0: Global Trade Item Number
@@ -461,5 +847,11 @@ constexpr static const ReadMemory<MemoryUInt64<6>> MemoryBank0GTIN{
 // Bank 0: Identification or serial number of the bus unit
 constexpr static const ReadMemory<MemoryUInt64<8>>
     MemoryBank0GearIdentificationNumber{.bank = 0, .location = 0x0b};
+// Bank 0: Firmware version, major and minor
+constexpr static const ReadMemory<MemoryUInt64<2>> MemoryBank0FirmwareVersion{
+    .bank = 0, .location = 0x09};
+// Bank 0: Last accessible memory bank
+constexpr static const ReadMemory<MemoryUInt64<1>>
+    MemoryBank0LastAccessibleBank{.bank = 0, .location = 0x02};
 
 } // namespace libdali
@@ -0,0 +1,23 @@
+#include "esphome_binary_sensor.h"
+#include "dali.h"
+
+namespace esphome {
+namespace dali {
+
+void GearBinarySensor::update(const libdali::ScanResult &state) {
+  libdali::QueryStatusResponse status(state.status);
+  switch (this->type_) {
+  case GearBinarySensorType::PRESENT:
+    this->publish_state(state.present);
+    break;
+  case GearBinarySensorType::LAMP_FAILURE:
+    this->publish_state(state.present && status.LampFailure);
+    break;
+  case GearBinarySensorType::POWER_FAILURE:
+    this->publish_state(state.present && status.QueryPowerFailure);
+    break;
+  }
+}
+
+} // namespace dali
+} // namespace esphome
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "startup_scan.h"
+
+#include "esphome/components/binary_sensor/binary_sensor.h"
+
+namespace esphome {
+namespace dali {
+
+enum class GearBinarySensorType : uint8_t {
+  // The gear answers queries.
+  PRESENT,
+  LAMP_FAILURE,
+  // The gear was powered up and got no level since.
+  POWER_FAILURE,
+};
+
+// Binary state of one gear, published from the startup scan and the status
+// poller of its bus.
+class GearBinarySensor : public binary_sensor::BinarySensor {
+public:
+  void set_short_address(uint8_t short_address) {
+    this->short_address_ = short_address;
+  }
+  uint8_t get_short_address() const { return this->short_address_; }
+  void set_type(GearBinarySensorType type) { this->type_ = type; }
+  void update(const libdali::ScanResult &state);
+
+protected:
+  uint8_t short_address_ = 0;
+  GearBinarySensorType type_ = GearBinarySensorType::PRESENT;
+};
+
+} // namespace dali
+} // namespace esphome
@@ -1,13 +1,399 @@
 #include "esphome_bus.h"
 #include "esphome.h"
+#include "esphome_binary_sensor.h"
+#include "esphome_light.h"
 #include "esphome/core/log.h"
+#include <cinttypes>
 
 namespace esphome {
 namespace dali {
 
 static const char *const TAG = "dali";
 
-void Bus::setup() {}
+void Bus::setup() {
+  // Only the blocks of the configured gear are stored.
+  auto gear = this->lights_ | this->group_members_;
+  for (uint8_t i = 0; i < libdali::Inventory::SHORT_ADDRESSES; i++) {
+    if (gear.test(i)) {
+      this->inventory_blocks_ |= 1 << (i / libdali::Inventory::BLOCK_GEAR);
+    }
+  }
+  for (uint8_t block = 0; block < libdali::Inventory::BLOCKS; block++) {
+    if (!(this->inventory_blocks_ & (1 << block))) {
+      continue;
+    }
+    auto &pref = this->inventory_prefs_[block];
+    pref = global_preferences->make_preference<libdali::Inventory::Record>(
+        fnv1_hash("dali_inventory_" + std::to_string(block)) ^
+        this->address_);
+    libdali::Inventory::Record record;
+    if (!pref.load(&record) || !this->inventory_.load(block, record)) {
+      ESP_LOGD(TAG, "No stored gear inventory for short addresses %u-%u",
+               block * libdali::Inventory::BLOCK_GEAR,
+               (block + 1) * libdali::Inventory::BLOCK_GEAR - 1);
+    }
+  }
+
+  this->scheduler_.add(&this->levels_job_, libdali::Priority::USER);
+  this->scheduler_.add(&this->scan_job_, libdali::Priority::CONFIG);
+  this->scheduler_.add(&this->poll_job_, libdali::Priority::POLL);
+
+  // Level and status of the lights are collected in loop(), so the node
+  // comes up without waiting for the bus.
+  this->scan_.set_scenes(&this->scenes_);
+  this->scan_.start(this->lights_ | this->group_members_);
+  this->scanning_ = true;
+
+  if (this->follow_other_masters_) {
+    this->set_monitor(&this->bus_monitor_);
+    this->high_freq_.start();
+  }
+}
+
+void Bus::save_inventory_() {
+  auto dirty = this->inventory_.dirty_blocks() & this->inventory_blocks_;
+  this->inventory_.clear_dirty();
+  // Preferences are written to flash in the flash write interval.
+  for (uint8_t block = 0; dirty != 0; block++, dirty >>= 1) {
+    if (dirty & 1) {
+      auto record = this->inventory_.record(block);
+      this->inventory_prefs_[block].save(&record);
+    }
+  }
+}
+
+void Bus::loop() {
+  this->loop_monitor_();
+  this->scheduler_.run([] { return micros(); });
+  if (this->sender_.busy() || this->scan_.busy()) {
+    this->sequence_high_freq_.start();
+  } else {
+    this->sequence_high_freq_.stop();
+  }
+  this->save_inventory_();
+}
+
+void Bus::publish_binary_sensors_(const libdali::ScanResult &state) {
+  for (auto *sensor : this->binary_sensors_) {
+    if (sensor->get_short_address() == state.short_address) {
+      sensor->update(state);
+    }
+  }
+}
+
+bool Bus::run_poll_(bool start) {
+  if (this->scanning_) {
+    return false;
+  }
+  // The poller only starts queries when the scheduler has nothing else.
+  auto state = this->poller_.poll(!start);
+  if (!state.has_value()) {
+    return false;
+  }
+  if (auto *output = this->outputs_[state->short_address]) {
+    output->apply_poll(*state);
+  }
+  this->publish_binary_sensors_(*state);
+  return true;
+}
+
+void Bus::loop_monitor_() {
+  if (!this->follow_other_masters_) {
+    return;
+  }
+  // Reads the status for telegrams while no command is in flight.
+  this->poll();
+  libdali::MonitorFrame frame;
+  while (this->bus_monitor_.pop(frame)) {
+    if (frame.flags & libdali::MonitorFrame::OVERRUN) {
+      ESP_LOGW(TAG, "Frames of other masters were lost");
+    }
+    // Own frames are known already, replies change no level.
+    if (frame.own() || frame.backward() || frame.length != 2) {
+      continue;
+    }
+    this->follow_frame_(libdali::frame_effect(frame.data[0], frame.data[1]));
+  }
+}
+
+void Bus::follow_frame_(const libdali::FrameEffect &effect) {
+  using Kind = libdali::FrameEffect::Kind;
+  if (effect.kind == Kind::NONE) {
+    return;
+  }
+  auto targets = this->arc_queue_.targets(
+      libdali::ArcQueue::Entry{.short_address = effect.target, .level = 0});
+  for (uint8_t i = 0; i < libdali::Inventory::SHORT_ADDRESSES; i++) {
+    if (!targets.test(i)) {
+      continue;
+    }
+    uint8_t level = effect.value;
+    if (effect.kind == Kind::SCENE) {
+      level = this->scenes_.level(effect.value, i);
+    }
+    if (effect.kind == Kind::CHANGED || level == libdali::DA_MASK) {
+      // Ask the gear where it ended up.
+      this->poller_.expedite(i);
+      continue;
+    }
+    ESP_LOGD(TAG, "Gear %d set to %d by another master", i, level);
+    this->poller_.discard(i);
+    if (this->outputs_[i] != nullptr) {
+      this->outputs_[i]->follow_level(level);
+    } else {
+      this->set_known_level(i, level);
+    }
+  }
+}
+
+bool Bus::run_scan_(bool start) {
+  if (!this->scanning_) {
+    return false;
+  }
+  // Levels go first, the scan continues between them.
+  auto result = this->scan_.poll(!start);
+  if (result.has_value()) {
+    if (auto *output = this->outputs_[result->short_address]) {
+      output->apply_scan(*result);
+    }
+    this->publish_binary_sensors_(*result);
+    this->poller_.set_state(*result);
+  }
+  if (this->scan_.done()) {
+    ESP_LOGD(TAG, "Startup scan done");
+    this->scanning_ = false;
+    this->poller_.start(this->lights_);
+    return true;
+  }
+  return result.has_value();
+}
+
+void Bus::go_to_scene(uint8_t scene, std::optional<uint8_t> group) {
+  SceneRecall recall{.scene = static_cast<uint8_t>(scene & 15),
+                     .group = group};
+  auto targets = this->scene_targets_(recall);
+  for (uint8_t i = 0; i < libdali::Inventory::SHORT_ADDRESSES; i++) {
+    if (targets.test(i) &&
+        this->scenes_.level(recall.scene, i) != libdali::DA_MASK) {
+      // The scene replaces levels queued before.
+      this->arc_queue_.cancel(i);
+      this->poller_.discard(i);
+    } else {
+      targets.reset(i);
+    }
+  }
+  uint8_t address = recall.group.has_value()
+                        ? libdali::ArcQueue::GROUP | (*recall.group & 15)
+                        : libdali::ArcQueue::BROADCAST;
+  this->drop_arc_retries_(targets, address);
+  this->pending_scene_ = recall;
+}
+
+std::bitset<libdali::Inventory::SHORT_ADDRESSES>
+Bus::scene_targets_(const SceneRecall &recall) const {
+  if (recall.group.has_value()) {
+    return this->arc_queue_.members(*recall.group);
+  }
+  return this->lights_;
+}
+
+bool Bus::poll_scene_() {
+  if (!this->scene_handle_.has_value()) {
+    return true;
+  }
+  auto result = this->poll(*this->scene_handle_, nullptr);
+  if (!result.has_value()) {
+    return false;
+  }
+  this->scene_handle_.reset();
+  if (*result) {
+    ESP_LOGE(TAG, "Go to scene %d failed: %s", this->recalling_.scene,
+             result->text());
+    return true;
+  }
+  // Gear that is part of the scene is at its scene level now.
+  auto targets = this->scene_targets_(this->recalling_);
+  for (uint8_t i = 0; i < libdali::Inventory::SHORT_ADDRESSES; i++) {
+    auto level = this->scenes_.level(this->recalling_.scene, i);
+    if (!targets.test(i) || level == libdali::DA_MASK) {
+      continue;
+    }
+    this->arc_queue_.set_level(i, level);
+    this->inventory_.set_level(i, level);
+    if (this->outputs_[i] != nullptr) {
+      this->outputs_[i]->follow_level(level);
+    }
+  }
+  return true;
+}
+
+static bool same_entry(const libdali::ArcQueue::Entry &a,
+                       const libdali::ArcQueue::Entry &b) {
+  return a.short_address == b.short_address && a.level == b.level &&
+         a.fade == b.fade;
+}
+
+void Bus::arc_result_(const libdali::ArcQueue::Entry &entry,
+                      libdali::ErrorCode err) {
+  // Slot of the retried level if this is its result. A retried level the
+  // queue sent as part of another entry, e.g. a broadcast, ends with it.
+  std::optional<ArcRetry> *slot = nullptr;
+  auto targets = this->arc_queue_.targets(entry);
+  for (auto &retry : this->arc_retries_) {
+    if (!retry.has_value() || retry->waiting) {
+      continue;
+    }
+    if (same_entry(retry->entry, entry)) {
+      slot = &retry;
+    } else if ((this->arc_queue_.targets(retry->entry) & targets).any()) {
+      if (!err) {
+        this->retry_stats_.recovered++;
+      }
+      retry.reset();
+    }
+  }
+  bool retried = slot != nullptr;
+  if (!err) {
+    if (retried) {
+      this->retry_stats_.recovered++;
+      slot->reset();
+    }
+    return;
+  }
+  if (!retried) {
+    for (auto &retry : this->arc_retries_) {
+      if (!retry.has_value()) {
+        slot = &retry;
+        break;
+      }
+    }
+  }
+  auto now_ms = this->now_ms();
+  uint8_t attempt = retried ? (*slot)->attempt + 1 : 1;
+  uint32_t first_ms = retried ? (*slot)->first_ms : now_ms;
+  // A DirectArc has no reply, the sequence is repeated from its start.
+  if (this->retry_policies_.allows(err, 0, attempt)) {
+    auto backoff_ms =
+        (this->retry_policies_.backoff_us(err, attempt) + 999) / 1000;
+    if (now_ms - first_ms + backoff_ms <=
+        this->retry_policies_.get_deadline_ms()) {
+      if (slot == nullptr) {
+        ESP_LOGW(TAG, "Too many failed levels, Direct Arc Control %d to %d "
+                      "not retried",
+                 entry.short_address, entry.level);
+        this->retry_stats_.failed++;
+        return;
+      }
+      *slot = ArcRetry{.entry = entry,
+                       .attempt = attempt,
+                       .first_ms = first_ms,
+                       .due_ms = now_ms + backoff_ms,
+                       .waiting = true};
+      return;
+    }
+  }
+  if (retried) {
+    this->retry_stats_.failed++;
+    slot->reset();
+  }
+}
+
+void Bus::drop_arc_retries_(
+    const std::bitset<libdali::Inventory::SHORT_ADDRESSES> &targets,
+    uint8_t short_address) {
+  for (auto &retry : this->arc_retries_) {
+    if (retry.has_value() &&
+        (retry->entry.short_address == short_address ||
+         (this->arc_queue_.targets(retry->entry) & targets).any())) {
+      retry.reset();
+    }
+  }
+}
+
+bool Bus::run_levels_(bool start) {
+  bool progress = false;
+  if (this->scene_handle_.has_value()) {
+    if (!this->poll_scene_()) {
+      return false;
+    }
+    progress = true;
+  }
+  if (this->sender_.busy()) {
+    auto result = this->sender_.poll();
+    if (!result.has_value()) {
+      return false;
+    }
+    const auto &entry = this->sender_.entry();
+    if (*result) {
+      ESP_LOGE(TAG, "Direct Arc Control %d to %d failed: %s",
+               entry.short_address, entry.level, result->text());
+    }
+    this->arc_queue_.sent(entry, *result);
+    this->arc_result_(entry, *result);
+    if (!*result && (entry.short_address & libdali::ArcQueue::GROUP) &&
+        entry.short_address != libdali::ArcQueue::BROADCAST) {
+      // The lights of the members follow the group.
+      auto members = this->arc_queue_.targets(entry);
+      for (uint8_t i = 0; i < libdali::Inventory::SHORT_ADDRESSES; i++) {
+        if (members.test(i) && this->outputs_[i] != nullptr) {
+          this->outputs_[i]->follow_level(entry.level);
+        }
+      }
+    }
+    progress = true;
+  }
+
+  // Another job owns the bus for its sequence.
+  if (!start) {
+    return progress;
+  }
+
+  if (this->pending_scene_.has_value()) {
+    auto recall = *this->pending_scene_;
+    auto address = recall.group.has_value()
+                       ? libdali::Address::from_group(*recall.group)
+                       : libdali::Broadcast;
+    ESP_LOGD(TAG, "Go to scene %d", recall.scene);
+    auto handle = this->submit(address.command(),
+                               libdali::DA_GO_TO_SCENE | recall.scene, 0);
+    if (!handle) {
+      // Adapter queue full, retry in the next loop.
+      return progress;
+    }
+    this->pending_scene_.reset();
+    this->recalling_ = recall;
+    this->scene_handle_ = *handle;
+    this->poll();
+    return true;
+  }
+
+  for (auto &retry : this->arc_retries_) {
+    if (!retry.has_value() || !retry->waiting ||
+        static_cast<int32_t>(this->now_ms() - retry->due_ms) < 0) {
+      continue;
+    }
+    if (!this->arc_queue_.retry(retry->entry)) {
+      // All gear got a newer level since.
+      retry.reset();
+      continue;
+    }
+    retry->waiting = false;
+    this->retry_stats_.retries++;
+  }
+
+  // Lights write their state from their own loop(), which runs after this
+  // one. All changes of one loop iteration are queued when the next call pops
+  // them, which lets the queue collapse them into a broadcast.
+  auto next = this->arc_queue_.pop();
+  if (!next.has_value()) {
+    return progress;
+  }
+  if (next->short_address == libdali::ArcQueue::BROADCAST) {
+    ESP_LOGD(TAG, "All lights set to %d, sending broadcast", next->level);
+  }
+  this->sender_.send(*next, this->arc_queue_.targets(*next));
+  return true;
+}
 
 libdali::I2CResult Bus::write_register(uint8_t i2c_register, uint8_t *data,
                                        size_t len) {
@@ -29,7 +415,21 @@ libdali::I2CResult Bus::read_register(uint8_t i2c_register, uint8_t *data,
   return libdali::I2CResult::OK;
 }
 
-void Bus::dump_config() { }
+void Bus::dump_config() {
+  ESP_LOGCONFIG(TAG, "DALI bus (LW14):");
+  LOG_I2C_DEVICE(this);
+  ESP_LOGCONFIG(TAG, "  Broadcast collapse: %s",
+                YESNO(this->broadcast_collapse_));
+  ESP_LOGCONFIG(TAG, "  Timing margin: %" PRIu32 " us",
+                this->get_timing_margin_us());
+  ESP_LOGCONFIG(TAG, "  Minimum settle time: %" PRIu32 " us",
+                this->get_min_settle_us());
+  ESP_LOGCONFIG(TAG, "  Poll share: %u%%", this->poller_.get_share_percent());
+  ESP_LOGCONFIG(TAG, "  Follow other masters: %s",
+                YESNO(this->follow_other_masters_));
+  ESP_LOGCONFIG(TAG, "  Loop budget: %" PRIu32 " us",
+                this->scheduler_.get_budget_us());
+}
 
 } // namespace dali
 } // namespace esphome
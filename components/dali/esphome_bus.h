@@ -1,14 +1,30 @@
 #pragma once
 
+#include "arc_queue.h"
+#include "arc_sender.h"
+#include "inventory.h"
 #include "lw14.h"
+#include "monitor.h"
+#include "retry.h"
+#include "scenes.h"
+#include "scheduler.h"
+#include "startup_scan.h"
+#include "status_poller.h"
 
 #include "esphome/components/i2c/i2c.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
 #include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+#include <vector>
 
 namespace esphome {
 namespace dali {
 
+class GearBinarySensor;
+class Output;
+
 class Bus : public Component,
             public i2c::I2CDevice,
             public libdali::I2CInterface,
@@ -17,6 +33,7 @@ public:
   Bus() : libdali::LW14Adapter(this) {};
   // Implement Component.
   void setup() override;
+  void loop() override;
   void dump_config() override;
   float get_setup_priority() const override { return setup_priority::IO; }
   // Implement I2CInterface.
@@ -26,6 +43,211 @@ public:
                                     size_t len) override;
   libdali::I2CResult read_register(uint8_t i2c_register, uint8_t *data,
                                    size_t len) override;
+
+  // Send levels as one broadcast DirectArc when all lights of the bus change
+  // to the same level in the same loop iteration.
+  void set_broadcast_collapse(bool enabled) {
+    this->broadcast_collapse_ = enabled;
+    this->arc_queue_.set_broadcast_collapse(enabled);
+  }
+  // Share of the bus time used to poll the lights for changes on the line.
+  void set_poll_share(uint8_t percent) {
+    this->poller_.set_share_percent(percent);
+  }
+  void set_poll_interval(uint32_t min_ms, uint32_t max_ms) {
+    this->poller_.set_interval_ms(min_ms, max_ms);
+  }
+  // Register the short address of a light controlled through this bus.
+  // Called before setup(), which validates the inventory of these gear.
+  void add_light(uint8_t short_address) {
+    this->arc_queue_.add_gear(short_address);
+    this->lights_.set(short_address);
+  }
+  // Make the gear a member of the group. Membership of the groups with
+  // members is synchronised by the startup scan.
+  void add_group_member(uint8_t group, uint8_t short_address) {
+    this->arc_queue_.add_group_member(group, short_address);
+    this->scan_.add_group_member(group, short_address);
+    this->group_members_.set(short_address);
+  }
+  // Queue a DirectArc for all members of the group, sent as one frame.
+  void queue_group_arc(uint8_t group, uint8_t level, uint32_t fade_ms = 0) {
+    this->arc_queue_.push_group(group, level,
+                                libdali::extended_fade_time(fade_ms));
+    const auto &members = this->arc_queue_.members(group);
+    for (uint8_t i = 0; i < libdali::Inventory::SHORT_ADDRESSES; i++) {
+      if (members.test(i)) {
+        this->poller_.discard(i);
+      }
+    }
+    this->drop_arc_retries_(members, libdali::ArcQueue::GROUP | (group & 15));
+  }
+  // Level the gear stores for the scene, programmed by the startup scan.
+  void add_scene_level(uint8_t scene, uint8_t short_address, uint8_t level) {
+    this->scenes_.set_level(scene, short_address, level);
+  }
+  // Recall the scene with one GO TO SCENE frame to the group or, without a
+  // group, as broadcast.
+  void go_to_scene(uint8_t scene, std::optional<uint8_t> group);
+  // Queue a DirectArc for the gear, sent from loop(). A newer level replaces
+  // an older one that was not sent yet. The gear fades to the level in
+  // `fade_ms`, rounded to the extended fade time.
+  void queue_direct_arc(uint8_t short_address, uint8_t level,
+                        uint32_t fade_ms = 0) {
+    this->arc_queue_.push(short_address, level,
+                          libdali::extended_fade_time(fade_ms));
+    this->poller_.discard(short_address);
+    std::bitset<libdali::Inventory::SHORT_ADDRESSES> targets;
+    targets.set(short_address & 63);
+    this->drop_arc_retries_(targets);
+  }
+  // Record the level the gear reported.
+  void set_known_level(uint8_t short_address, uint8_t level) {
+    this->arc_queue_.set_level(short_address, level);
+    this->inventory_.set_level(short_address, level);
+  }
+  // Identity and state of the gear, restored from flash and validated by the
+  // startup scan.
+  libdali::Inventory &inventory() { return this->inventory_; }
+  // The output gets the result of the startup scan for its gear.
+  void set_output(uint8_t short_address, Output *output) {
+    this->outputs_[short_address] = output;
+  }
+  // The sensor follows the state of its gear.
+  void add_binary_sensor(GearBinarySensor *sensor) {
+    this->binary_sensors_.push_back(sensor);
+  }
+  // Levels that failed with `err` are queued again after a backoff.
+  void set_retry_policy(libdali::ErrorCode err, uint8_t attempts,
+                        uint32_t backoff_us) {
+    this->retry_policies_.set(err, libdali::RetryPolicy{
+                                       .attempts = attempts,
+                                       .backoff_us = backoff_us,
+                                       .queries = false});
+  }
+  void set_retry_deadline_ms(uint32_t deadline_ms) {
+    this->retry_policies_.set_deadline_ms(deadline_ms);
+  }
+  const libdali::RetryStats &retry_stats() const { return this->retry_stats_; }
+  // Capture the frames of other masters like wall panels and sensors, and
+  // let the lights follow the levels they set.
+  void set_follow_other_masters(bool enabled) {
+    this->follow_other_masters_ = enabled;
+  }
+  // Frames captured in monitor mode.
+  const libdali::BusMonitor &bus_monitor() const { return this->bus_monitor_; }
+  // Time one loop() may spend on the bus before it returns.
+  void set_loop_budget_us(uint32_t budget_us) {
+    this->scheduler_.set_budget_us(budget_us);
+  }
+
+protected:
+  // Job of the scheduler, runs the methods of the bus.
+  class Job : public libdali::SchedulerJob {
+  public:
+    using Run = bool (Bus::*)(bool start);
+    using Busy = bool (Bus::*)() const;
+    Job(Bus *bus, Run run, Busy busy) : bus_(bus), run_(run), busy_(busy) {}
+    bool busy() const override { return (this->bus_->*this->busy_)(); }
+    bool run(bool start) override { return (this->bus_->*this->run_)(start); }
+
+  protected:
+    Bus *bus_;
+    Run run_;
+    Busy busy_;
+  };
+  struct SceneRecall {
+    uint8_t scene;
+    std::optional<uint8_t> group;
+  };
+  // Failed levels retried at the same time, further failures are given up.
+  static constexpr size_t ARC_RETRIES = 4;
+  // Failed level that is retried.
+  struct ArcRetry {
+    libdali::ArcQueue::Entry entry;
+    uint8_t attempt;
+    // Transport milliseconds of the first failure and of the next try.
+    uint32_t first_ms, due_ms;
+    // Not queued again yet.
+    bool waiting;
+  };
+  std::bitset<libdali::Inventory::SHORT_ADDRESSES>
+  scene_targets_(const SceneRecall &recall) const;
+  // Returns false while the recall is in flight.
+  bool poll_scene_();
+  // Jobs of the scheduler, see SchedulerJob.
+  bool run_levels_(bool start);
+  bool levels_busy_() const {
+    return this->sender_.busy() || this->scene_handle_.has_value();
+  }
+  bool run_scan_(bool start);
+  bool scan_busy_() const { return this->scan_.busy(); }
+  bool run_poll_(bool start);
+  bool poll_busy_() const { return this->poller_.busy(); }
+  // Record the outcome of a level sent, schedule a retry of a failed one.
+  void arc_result_(const libdali::ArcQueue::Entry &entry,
+                   libdali::ErrorCode err);
+  // Forget retries of failed levels a newer level or scene replaces, given
+  // by the gear it reaches or the address byte of a group or broadcast.
+  void drop_arc_retries_(
+      const std::bitset<libdali::Inventory::SHORT_ADDRESSES> &targets,
+      uint8_t short_address = libdali::DA_MASK);
+  void loop_monitor_();
+  // Update the state of the gear a frame of another master addressed.
+  void follow_frame_(const libdali::FrameEffect &effect);
+  void publish_binary_sensors_(const libdali::ScanResult &state);
+  void save_inventory_();
+
+  libdali::ArcQueue arc_queue_;
+  libdali::Inventory inventory_;
+  std::array<ESPPreferenceObject, libdali::Inventory::BLOCKS> inventory_prefs_;
+  // Blocks of the inventory with configured gear, bit per block.
+  uint8_t inventory_blocks_ = 0;
+  std::bitset<libdali::Inventory::SHORT_ADDRESSES> lights_;
+  std::bitset<libdali::Inventory::SHORT_ADDRESSES> group_members_;
+  libdali::StartupScan scan_{this, &this->inventory_};
+  bool scanning_ = false;
+  libdali::StatusPoller poller_{this, &this->inventory_};
+  std::array<Output *, libdali::Inventory::SHORT_ADDRESSES> outputs_{};
+  std::vector<GearBinarySensor *> binary_sensors_;
+  libdali::ArcSender sender_{this, &this->inventory_};
+  libdali::SceneTable scenes_;
+  std::optional<SceneRecall> pending_scene_;
+  // Recall in flight.
+  SceneRecall recalling_{};
+  std::optional<libdali::CommandHandle> scene_handle_;
+  libdali::RetryPolicies retry_policies_;
+  libdali::RetryStats retry_stats_;
+  std::array<std::optional<ArcRetry>, ARC_RETRIES> arc_retries_;
+  bool broadcast_collapse_ = false;
+  bool follow_other_masters_ = false;
+  libdali::BusMonitor bus_monitor_;
+  // A telegram has to be read within a few milliseconds, before the next
+  // frame on the bus replaces it.
+  HighFrequencyLoopRequester high_freq_;
+  // The second frame of a configuration command sent twice has to follow
+  // within 100ms, slow components between two loops must not delay it.
+  HighFrequencyLoopRequester sequence_high_freq_;
+  // Levels and scenes go first, then the startup scan that configures the
+  // gear, then the poller.
+  libdali::Scheduler scheduler_;
+  Job levels_job_{this, &Bus::run_levels_, &Bus::levels_busy_};
+  Job scan_job_{this, &Bus::run_scan_, &Bus::scan_busy_};
+  Job poll_job_{this, &Bus::run_poll_, &Bus::poll_busy_};
+};
+
+template <typename... Ts> class GoToSceneAction : public Action<Ts...> {
+public:
+  explicit GoToSceneAction(Bus *bus) : bus_(bus) {}
+  TEMPLATABLE_VALUE(uint8_t, scene)
+  void set_group(uint8_t group) { this->group_ = group; }
+  void play(Ts... x) override {
+    this->bus_->go_to_scene(this->scene_.value(x...), this->group_);
+  }
+
+protected:
+  Bus *bus_;
+  std::optional<uint8_t> group_;
 };
 
 } // namespace dali
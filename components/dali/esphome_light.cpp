@@ -1,4 +1,6 @@
 #include "esphome_light.h"
+#include <cinttypes>
+#include <utility>
 
 namespace esphome {
 namespace dali {
@@ -6,40 +8,72 @@ namespace dali {
 static const char *const TAG = "dali.output";
 
 void Output::setup_state(light::LightState *state) {
-  auto address = libdali::Address::from_short_address(this->short_address);
+  this->state_ = state;
+  state->set_gamma_correct(1.0f);
+  // The restored state is not written to the gear.
+  state->set_restore_mode(esphome::light::LIGHT_ALWAYS_OFF);
+  this->skip_write_ = true;
+
+  if (this->group_.has_value()) {
+    ESP_LOGD(TAG, "'%s' Dali group %d => %d", state->get_object_id().c_str(),
+             *this->group_,
+             libdali::Address::from_group(*this->group_).command());
+    return;
+  }
 
+  auto address = libdali::Address::from_short_address(this->short_address);
   ESP_LOGD(TAG, "'%s' Dali Address is %d => %d", state->get_object_id().c_str(),
            this->short_address, address.command());
+  // The actual level comes from the startup scan of the bus.
+  this->bus->set_output(this->short_address, this);
+}
 
-  state->set_default_transition_length(0);
-  state->set_gamma_correct(1.0f);
-
-  auto err = libdali::SelectDimmingCurve(this->bus, address, 0);
-  if (err) {
-    ESP_LOGE(TAG, "'%s' Failed to select dimming curve linear: %s",
-             state->get_object_id().c_str(), err.text());
+void Output::apply_scan(const libdali::ScanResult &result) {
+  if (!result.present) {
+    ESP_LOGE(TAG, "'%s' No gear with short address %d",
+             this->state_->get_object_id().c_str(), this->short_address);
+    return;
   }
+  if (libdali::QueryStatusResponse(result.status).LampFailure) {
+    ESP_LOGW(TAG, "'%s' Lamp failure", this->state_->get_object_id().c_str());
+  }
+  if (this->written_) {
+    ESP_LOGD(TAG, "'%s' Changed during the startup scan, keep it",
+             this->state_->get_object_id().c_str());
+    return;
+  }
+
+  ESP_LOGD(TAG, "'%s' actualLevel=%02x", this->state_->get_object_id().c_str(),
+           result.level);
+  this->publish_level_(result.level);
+}
 
-  auto r = libdali::QueryActualLevel(this->bus, address);
-  if (r.error()) {
-    ESP_LOGE(TAG, "'%s' Failed to query actual level: %s",
-             state->get_object_id().c_str(), r.error().text());
+void Output::apply_poll(const libdali::ScanResult &result) {
+  if (!result.present) {
+    ESP_LOGW(TAG, "'%s' Gear with short address %d stopped answering",
+             this->state_->get_object_id().c_str(), this->short_address);
     return;
   }
-  if (r.value() == 0) {
-    ESP_LOGD(TAG, "'%s' Lamp is off, leave off.",
-             state->get_object_id().c_str());
-    state->set_restore_mode(esphome::light::LIGHT_ALWAYS_OFF);
-  } else {
-    auto target_brightness = 1.0f / 254.0f * float(r.value());
-    this->restore_brightness = target_brightness;
-    // The "State" in initial state is restored and overriden by "Restore" mode.
-    // Hack: Change the restore mode. Change from DEFAULT_OFF to
-    // LIGHT_ALWAYS_ON. Custom code in write_state handles this value.
-    state->set_restore_mode(esphome::light::LIGHT_ALWAYS_ON);
-    ESP_LOGD(TAG, "'%s' Lamp is on, set to actualLevel=%02x target=%f",
-             state->get_object_id().c_str(), r.value(), target_brightness);
+  if (libdali::QueryStatusResponse(result.status).LampFailure) {
+    ESP_LOGW(TAG, "'%s' Lamp failure", this->state_->get_object_id().c_str());
   }
+  ESP_LOGD(TAG, "'%s' Level on the bus is %02x",
+           this->state_->get_object_id().c_str(), result.level);
+  this->publish_level_(result.level);
+}
+
+void Output::publish_level_(uint8_t level) {
+  this->bus->set_known_level(this->short_address, level);
+  this->fade_level_.reset();
+  // The level is known now, the write of this call sends no frame.
+  this->skip_write_ = false;
+  auto call = this->state_->make_call();
+  call.set_state(level > 0);
+  if (level > 0) {
+    call.set_brightness(float(level) / 254.0f);
+  }
+  call.set_transition_length(0);
+  call.perform();
 }
 
 light::LightTraits Output::get_traits() {
@@ -48,35 +82,68 @@ light::LightTraits Output::get_traits() {
   return traits;
 }
 
-void Output::write_state(light::LightState *state) {
-  auto address = libdali::Address::from_short_address(this->short_address);
+uint8_t Output::level_(bool on, float brightness) {
+  if (!on) {
+    return 0;
+  }
+  // Rounded, so levels from the scan map back to themselves.
+  return uint8_t(254.0f * brightness + 0.5f);
+}
 
-  if (this->restore_brightness.has_value()) {
-    ESP_LOGD(TAG, "'%s' Restore", state->get_object_id().c_str());
-    auto call = state->make_call();
-    call.set_brightness(this->restore_brightness.value());
-    call.set_state(true);
-    this->restore_brightness.reset();
-    call.perform();
+void Output::write_state(light::LightState *state) {
+  if (this->skip_write_) {
+    this->skip_write_ = false;
     return;
   }
+  this->written_ = true;
   bool on;
   float brightness;
   state->current_values_as_brightness(&brightness);
   state->current_values_as_binary(&on);
-  auto target_brightness = uint8_t(254.0f * float(brightness));
+  auto target_brightness = level_(on, brightness);
+  if (std::exchange(this->fade_level_, std::nullopt) == target_brightness) {
+    // End of a transition, the gear fades there already. A DirectArc without
+    // fade would replace the pending one and make the gear jump.
+    return;
+  }
 
   ESP_LOGI(TAG, "'%s' write_state: On: %d Brightness: %f, Dali value: %x",
            state->get_object_id().c_str(), on, brightness, target_brightness);
-  if (!on) {
-    target_brightness = 0;
+
+  this->queue_level_(target_brightness, 0);
+}
+
+void Output::queue_level_(uint8_t level, uint32_t fade_ms) {
+  if (this->group_.has_value()) {
+    this->bus->queue_group_arc(*this->group_, level, fade_ms);
+  } else {
+    this->bus->queue_direct_arc(this->short_address, level, fade_ms);
   }
+}
+
+void Output::fade_to(const light::LightColorValues &values,
+                     uint32_t length_ms) {
+  this->skip_write_ = false;
+  this->written_ = true;
+  float brightness;
+  values.as_brightness(&brightness, 1.0f);
+  auto level = level_(values.is_on(), brightness);
+
+  ESP_LOGI(TAG, "'%s' fade to %x in %" PRIu32 " ms",
+           this->state_->get_object_id().c_str(), level, length_ms);
+  this->fade_level_ = level;
+  this->queue_level_(level, length_ms);
+}
+
+void FadeTransformer::start() {
+  this->output_->fade_to(this->get_target_values(), this->length_);
+}
 
-  auto err = libdali::DirectArc(this->bus, address, target_brightness);
-  if (err) {
-    ESP_LOGE(TAG, "'%s' Direct Arc Control failed: %s",
-             state->get_object_id().c_str(), err.text());
+optional<light::LightColorValues> FadeTransformer::apply() {
+  if (this->get_progress_() < 1.0f) {
+    return {};
   }
+  return this->get_target_values();
 }
 
 } // namespace dali
@@ -1,27 +1,73 @@
 #pragma once
 
 #include "dali.h"
+#include "esphome_bus.h"
 #include "esphome/components/light/light_output.h"
 #include <esphome.h>
+#include <memory>
 #include <optional>
 
 namespace esphome {
 namespace dali {
 
+class Output;
+
+// Leaves transitions to the gear: one DirectArc with the transition length as
+// fade time instead of a level per loop iteration. The light state jumps to
+// the target at the end, its write sends no frame.
+class FadeTransformer : public light::LightTransformer {
+public:
+  explicit FadeTransformer(Output *output) : output_(output) {}
+  void start() override;
+  optional<light::LightColorValues> apply() override;
+  bool publish_at_end() override { return true; }
+  bool is_transition() override { return true; }
+
+protected:
+  Output *output_;
+};
+
 class Output : public light::LightOutput, public Component {
 public:
   light::LightTraits get_traits() override;
+  std::unique_ptr<light::LightTransformer>
+  create_default_transition() override {
+    return std::make_unique<FadeTransformer>(this);
+  }
   void setup_state(light::LightState *state) override;
   void write_state(light::LightState *state) override;
   void set_short_address(uint8_t short_address) {
     this->short_address = short_address;
   }
-  void set_bus(libdali::BusInterface *bus) { this->bus = bus; }
+  // Control the group instead of a single gear.
+  void set_group(uint8_t group) { this->group_ = group; }
+  void set_bus(Bus *bus) { this->bus = bus; }
+  // Initialise the light from the state of its gear.
+  void apply_scan(const libdali::ScanResult &result);
+  // Follow a change of the gear found by the status poller.
+  void apply_poll(const libdali::ScanResult &result);
+  // Let the gear fade to `values` in `length_ms`.
+  void fade_to(const light::LightColorValues &values, uint32_t length_ms);
+  // Follow a level sent to a group the gear is a member of.
+  void follow_level(uint8_t level) { this->publish_level_(level); }
 
 private:
-  std::optional<float> restore_brightness;
+  void publish_level_(uint8_t level);
+  void queue_level_(uint8_t level, uint32_t fade_ms);
+  // DirectArc level of a light state.
+  static uint8_t level_(bool on, float brightness);
+
   uint8_t short_address;
-  libdali::BusInterface *bus;
+  std::optional<uint8_t> group_;
+  Bus *bus;
+  light::LightState *state_ = nullptr;
+  // The first write is the state restored by the light, not a change.
+  bool skip_write_ = false;
+  // The light was changed, the scan result is outdated.
+  bool written_ = false;
+  // Level fade_to() queued, written by the light again at the end of the
+  // transition.
+  std::optional<uint8_t> fade_level_;
 };
 
 } // namespace dali
@@ -0,0 +1,54 @@
+#include "esphome_sensor.h"
+#include "esphome_bus.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace dali {
+
+static const char *const TAG = "dali.sensor";
+
+float BusSensor::value_() const {
+  using libdali::ErrorCode;
+  const auto &metrics = this->bus_->metrics();
+  const auto &latency = metrics.latency_of(this->command_class_);
+  switch (this->type_) {
+  case BusSensorType::COMMANDS:
+    return metrics.commands();
+  case BusSensorType::TIMEOUTS:
+    return metrics.result(ErrorCode::TIMEOUT);
+  case BusSensorType::FRAME_ERRORS:
+    return metrics.result(ErrorCode::FRAME_ERROR);
+  case BusSensorType::BUS_BUSY:
+    return metrics.result(ErrorCode::BUS_BUSY);
+  case BusSensorType::BUS_ERRORS:
+    return metrics.result(ErrorCode::BUS_ERROR);
+  case BusSensorType::I2C_ERRORS:
+    return metrics.result(ErrorCode::I2C_ERROR);
+  case BusSensorType::BUSY_WAITS:
+    return metrics.busy_waits;
+  case BusSensorType::I2C_TRANSACTIONS:
+    return metrics.i2c_transactions;
+  case BusSensorType::LATENCY_AVERAGE:
+    return latency.average_ms();
+  case BusSensorType::LATENCY_MAX:
+    return latency.max_ms;
+  case BusSensorType::RETRIES:
+    return this->bus_->retry_stats().retries;
+  case BusSensorType::RETRIES_RECOVERED:
+    return this->bus_->retry_stats().recovered;
+  case BusSensorType::RETRIES_FAILED:
+    return this->bus_->retry_stats().failed;
+  }
+  return 0;
+}
+
+void BusSensor::update() {
+  this->publish_state(this->value_());
+}
+
+void BusSensor::dump_config() {
+  ESP_LOGCONFIG(TAG, "DALI bus sensor '%s'", this->get_name().c_str());
+}
+
+} // namespace dali
+} // namespace esphome
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bus_metrics.h"
+
+#include "esphome/components/sensor/sensor.h"
+#include "esphome/core/component.h"
+
+namespace esphome {
+namespace dali {
+
+class Bus;
+
+enum class BusSensorType : uint8_t {
+  // Completed commands.
+  COMMANDS,
+  TIMEOUTS,
+  FRAME_ERRORS,
+  BUS_BUSY,
+  BUS_ERRORS,
+  I2C_ERRORS,
+  // Status reads that found the bus busy before sending.
+  BUSY_WAITS,
+  I2C_TRANSACTIONS,
+  // Latency of the commands of one class in milliseconds.
+  LATENCY_AVERAGE,
+  LATENCY_MAX,
+  // Levels sent again after a failure, see RetryStats.
+  RETRIES,
+  RETRIES_RECOVERED,
+  RETRIES_FAILED,
+};
+
+// Publishes one of the bus metrics in the update interval.
+class BusSensor : public sensor::Sensor, public PollingComponent {
+public:
+  void set_bus(Bus *bus) { this->bus_ = bus; }
+  void set_type(BusSensorType type) { this->type_ = type; }
+  void set_command_class(libdali::CommandClass command_class) {
+    this->command_class_ = command_class;
+  }
+  void update() override;
+  void dump_config() override;
+
+protected:
+  float value_() const;
+
+  Bus *bus_ = nullptr;
+  BusSensorType type_ = BusSensorType::COMMANDS;
+  libdali::CommandClass command_class_ = libdali::CommandClass::CONTROL;
+};
+
+} // namespace dali
+} // namespace esphome
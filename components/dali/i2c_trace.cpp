@@ -0,0 +1,229 @@
+#include "i2c_trace.h"
+#include <algorithm>
+
+namespace libdali {
+
+RecordingI2C::RecordingI2C(I2CInterface *transport) : transport_(transport) {
+  this->trace_.assign(std::begin(I2CTrace::MAGIC), std::end(I2CTrace::MAGIC));
+  this->trace_.push_back(I2CTrace::VERSION);
+}
+
+bool RecordingI2C::begin_(I2CTrace::Op op, bool error, size_t length,
+                          uint32_t now_ms) {
+  // Header, delta and register take at most 7 bytes.
+  if (this->max_bytes_ != 0 &&
+      this->trace_.size() + 7 + length > this->max_bytes_) {
+    this->truncated_++;
+    return false;
+  }
+  this->millis_record_ =
+      op == I2CTrace::Op::MILLIS ? this->trace_.size() : 0;
+  this->trace_.push_back(static_cast<uint8_t>(
+      static_cast<uint8_t>(op) | (error ? 0x04 : 0) | length << 3));
+  this->varint_(now_ms - this->last_ms_);
+  this->last_ms_ = now_ms;
+  return true;
+}
+
+void RecordingI2C::varint_(uint32_t value) {
+  while (value >= 0x80) {
+    this->trace_.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  this->trace_.push_back(static_cast<uint8_t>(value));
+}
+
+I2CResult RecordingI2C::write_register(uint8_t i2c_register, uint8_t *data,
+                                       size_t len) {
+  auto result = this->transport_->write_register(i2c_register, data, len);
+  if (len <= I2CTrace::MAX_LENGTH &&
+      this->begin_(I2CTrace::Op::WRITE, result != I2CResult::OK, len,
+                   this->transport_->millis())) {
+    this->trace_.push_back(i2c_register);
+    this->trace_.insert(this->trace_.end(), data, data + len);
+  }
+  return result;
+}
+
+I2CResult RecordingI2C::read_register(uint8_t i2c_register, uint8_t *data,
+                                      size_t len) {
+  auto result = this->transport_->read_register(i2c_register, data, len);
+  if (len <= I2CTrace::MAX_LENGTH &&
+      this->begin_(I2CTrace::Op::READ, result != I2CResult::OK, len,
+                   this->transport_->millis())) {
+    this->trace_.push_back(i2c_register);
+    this->trace_.insert(this->trace_.end(), data, data + len);
+  }
+  return result;
+}
+
+void RecordingI2C::delay_microseconds(uint32_t us) {
+  this->transport_->delay_microseconds(us);
+  if (this->begin_(I2CTrace::Op::DELAY, false, 0,
+                   this->transport_->millis())) {
+    this->varint_(us);
+  }
+}
+
+uint32_t RecordingI2C::millis() {
+  auto now_ms = this->transport_->millis();
+  // Polling loops read the clock a lot, count the repeats in the record.
+  if (this->millis_record_ != 0 && now_ms == this->last_ms_ &&
+      (this->trace_[this->millis_record_] >> 3) < I2CTrace::MAX_LENGTH) {
+    this->trace_[this->millis_record_] += 1 << 3;
+    return now_ms;
+  }
+  this->begin_(I2CTrace::Op::MILLIS, false, 0, now_ms);
+  return now_ms;
+}
+
+ReplayI2C::ReplayI2C(std::vector<uint8_t> trace) : trace_(std::move(trace)) {
+  this->valid_ = this->trace_.size() >= I2CTrace::HEADER_SIZE &&
+                 std::equal(std::begin(I2CTrace::MAGIC),
+                            std::end(I2CTrace::MAGIC), this->trace_.begin()) &&
+                 this->trace_[sizeof(I2CTrace::MAGIC)] == I2CTrace::VERSION &&
+                 this->decode_();
+  if (!this->valid_) {
+    this->records_.clear();
+  }
+}
+
+bool ReplayI2C::decode_() {
+  const auto &t = this->trace_;
+  size_t p = I2CTrace::HEADER_SIZE;
+  auto varint = [&](uint32_t &value) {
+    value = 0;
+    for (unsigned shift = 0; p < t.size() && shift < 32; shift += 7) {
+      uint8_t byte = t[p++];
+      value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  uint32_t time_ms = 0;
+  while (p < t.size()) {
+    Record record;
+    record.offset = static_cast<uint32_t>(p);
+    uint8_t head = t[p++];
+    record.op = static_cast<I2CTrace::Op>(head & 0x03);
+    record.error = head & 0x04;
+    record.length = head >> 3;
+    record.i2c_register = 0;
+    record.value = 0;
+    uint32_t delta_ms;
+    if (!varint(delta_ms)) {
+      return false;
+    }
+    time_ms += delta_ms;
+    record.time_ms = time_ms;
+    switch (record.op) {
+    case I2CTrace::Op::READ:
+    case I2CTrace::Op::WRITE:
+      if (p + 1 + record.length > t.size()) {
+        return false;
+      }
+      record.i2c_register = t[p++];
+      record.value = static_cast<uint32_t>(p);
+      p += record.length;
+      break;
+    case I2CTrace::Op::DELAY:
+      if (!varint(record.value)) {
+        return false;
+      }
+      break;
+    case I2CTrace::Op::MILLIS:
+      break;
+    }
+    this->records_.push_back(record);
+  }
+  return true;
+}
+
+void ReplayI2C::consume_(const Record &record) {
+  this->next_++;
+  this->millis_repeats_ =
+      record.op == I2CTrace::Op::MILLIS ? record.length : 0;
+  uint64_t time_us = static_cast<uint64_t>(record.time_ms) * 1000;
+  if (time_us > this->now_us_) {
+    this->now_us_ = time_us;
+  }
+}
+
+const ReplayI2C::Record *ReplayI2C::access_(I2CTrace::Op op,
+                                            uint8_t i2c_register,
+                                            size_t len) {
+  if (this->diverged_) {
+    return nullptr;
+  }
+  while (const auto *record = this->peek_()) {
+    if (record->op == I2CTrace::Op::READ ||
+        record->op == I2CTrace::Op::WRITE) {
+      if (record->op != op || record->i2c_register != i2c_register ||
+          record->length != len) {
+        // A different access.
+        this->diverged_ = true;
+        this->divergence_offset_ = record->offset;
+        return nullptr;
+      }
+      this->consume_(*record);
+      this->transactions_++;
+      return record;
+    }
+    this->consume_(*record);
+  }
+  // The end of the trace.
+  this->diverged_ = true;
+  this->divergence_offset_ = this->trace_.size();
+  return nullptr;
+}
+
+I2CResult ReplayI2C::write_register(uint8_t i2c_register, uint8_t *data,
+                                    size_t len) {
+  const auto *record = this->access_(I2CTrace::Op::WRITE, i2c_register, len);
+  if (record == nullptr) {
+    return I2CResult::ERROR;
+  }
+  if (!std::equal(data, data + len, this->trace_.begin() + record->value)) {
+    this->diverged_ = true;
+    this->divergence_offset_ = record->offset;
+    return I2CResult::ERROR;
+  }
+  return record->error ? I2CResult::ERROR : I2CResult::OK;
+}
+
+I2CResult ReplayI2C::read_register(uint8_t i2c_register, uint8_t *data,
+                                   size_t len) {
+  const auto *record = this->access_(I2CTrace::Op::READ, i2c_register, len);
+  if (record == nullptr) {
+    return I2CResult::ERROR;
+  }
+  std::copy_n(this->trace_.begin() + record->value, len, data);
+  return record->error ? I2CResult::ERROR : I2CResult::OK;
+}
+
+void ReplayI2C::delay_microseconds(uint32_t us) {
+  this->now_us_ += us;
+  const auto *record = this->peek_();
+  if (!this->diverged_ && record != nullptr &&
+      record->op == I2CTrace::Op::DELAY) {
+    this->consume_(*record);
+  }
+}
+
+uint32_t ReplayI2C::millis() {
+  if (this->millis_repeats_ > 0) {
+    this->millis_repeats_--;
+    return static_cast<uint32_t>(this->now_us_ / 1000);
+  }
+  const auto *record = this->peek_();
+  if (!this->diverged_ && record != nullptr &&
+      record->op == I2CTrace::Op::MILLIS) {
+    this->consume_(*record);
+  }
+  return static_cast<uint32_t>(this->now_us_ / 1000);
+}
+
+} // namespace libdali
@@ -0,0 +1,141 @@
+#pragma once
+#include "lw14.h"
+#include <vector>
+
+namespace libdali {
+
+// Binary trace of the calls to an I2CInterface, written by RecordingI2C and
+// read by ReplayI2C.
+//
+// The trace starts with MAGIC and VERSION, followed by one record per call:
+//
+//   op | error << 2 | length << 3    one byte, see Op
+//   milliseconds since the record before, as varint
+//   READ, WRITE: register, `length` data bytes read or written
+//   DELAY: microseconds, as varint
+//   MILLIS: `length` is the number of further calls that returned the same
+//           milliseconds right after this one
+//
+// A status read takes four bytes. Varints are little endian base 128, seven
+// bits per byte with the high bit set on all but the last byte.
+struct I2CTrace {
+  static constexpr uint8_t MAGIC[3] = {'L', 'W', 'T'};
+  static constexpr uint8_t VERSION = 1;
+  static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 1;
+  // Longest register access a record can hold.
+  static constexpr size_t MAX_LENGTH = 31;
+
+  enum class Op : uint8_t {
+    READ = 0,
+    WRITE = 1,
+    DELAY = 2,
+    MILLIS = 3,
+  };
+};
+
+// Decorates a transport and records every call with the transport
+// milliseconds and the result into a trace, e.g. to take a field problem
+// home. Calls of millis() are recorded too, the replay returns the same
+// clock to the same code.
+class RecordingI2C : public I2CInterface {
+public:
+  explicit RecordingI2C(I2CInterface *transport);
+
+  I2CResult write_register(uint8_t i2c_register, uint8_t *data,
+                           size_t len) override;
+  I2CResult read_register(uint8_t i2c_register, uint8_t *data,
+                          size_t len) override;
+  void delay_microseconds(uint32_t us) override;
+  uint32_t millis() override;
+
+  // Stop recording once the trace has `max_bytes`, 0 for no limit.
+  void set_max_bytes(size_t max_bytes) { this->max_bytes_ = max_bytes; }
+  const std::vector<uint8_t> &trace() const { return this->trace_; }
+  // Calls not recorded because of the limit.
+  size_t truncated() const { return this->truncated_; }
+
+protected:
+  // Start a record, false if the limit was reached.
+  bool begin_(I2CTrace::Op op, bool error, size_t length, uint32_t now_ms);
+  void varint_(uint32_t value);
+
+  I2CInterface *transport_;
+  std::vector<uint8_t> trace_;
+  // Offset of the last record if it is a MILLIS record, 0 otherwise.
+  size_t millis_record_ = 0;
+  uint32_t last_ms_ = 0;
+  size_t max_bytes_ = 0;
+  size_t truncated_ = 0;
+};
+
+// Transport that answers from a trace of RecordingI2C without sleeping, for
+// regression tests and benchmarks of the adapter with real gear behaviour.
+// The trace is decoded once up front, replaying only walks the records.
+//
+// Register accesses have to come in the recorded order with the recorded
+// register, length and written data, otherwise the replay diverged and every
+// further access fails with I2CResult::ERROR. The clock is virtual: it moves
+// to the time of each record replayed and by the microseconds of every delay,
+// so code that sleeps or reads the clock more or less often than the
+// recorded one still replays.
+class ReplayI2C final : public I2CInterface {
+public:
+  explicit ReplayI2C(std::vector<uint8_t> trace);
+
+  I2CResult write_register(uint8_t i2c_register, uint8_t *data,
+                           size_t len) override;
+  I2CResult read_register(uint8_t i2c_register, uint8_t *data,
+                          size_t len) override;
+  void delay_microseconds(uint32_t us) override;
+  uint32_t millis() override;
+
+  // The trace has a known header and no truncated record.
+  bool valid() const { return this->valid_; }
+  // All records were replayed.
+  bool done() const { return this->next_ >= this->records_.size(); }
+  bool diverged() const { return this->diverged_; }
+  // Offset of the record the replay diverged at.
+  size_t divergence_offset() const { return this->divergence_offset_; }
+  // Register accesses replayed.
+  size_t transactions() const { return this->transactions_; }
+  // Virtual time in microseconds.
+  uint64_t now_us() const { return this->now_us_; }
+
+protected:
+  struct Record {
+    I2CTrace::Op op;
+    bool error;
+    uint8_t length;
+    uint8_t i2c_register;
+    uint32_t time_ms;
+    // Offset of the record in the trace.
+    uint32_t offset;
+    // READ, WRITE: offset of the data bytes in trace_. DELAY: microseconds.
+    uint32_t value;
+  };
+
+  // Decode the records, false on a truncated or broken one.
+  bool decode_();
+  void consume_(const Record &record);
+  // Skip clock records up to the next register access and take it, nullptr
+  // if it does not match.
+  const Record *access_(I2CTrace::Op op, uint8_t i2c_register, size_t len);
+  const Record *peek_() const {
+    return this->next_ < this->records_.size() ? &this->records_[this->next_]
+                                               : nullptr;
+  }
+
+  std::vector<uint8_t> trace_;
+  std::vector<Record> records_;
+  // Next record to replay.
+  size_t next_ = 0;
+  uint64_t now_us_ = 0;
+  bool valid_ = false;
+  bool diverged_ = false;
+  size_t divergence_offset_ = 0;
+  size_t transactions_ = 0;
+  // Calls of millis() left of the last MILLIS record.
+  uint8_t millis_repeats_ = 0;
+};
+
+} // namespace libdali
@@ -0,0 +1,226 @@
+#include "inventory.h"
+
+namespace libdali {
+
+// Raw replies, stored as is.
+constexpr static const QueryCommand<uint8_t> QueryGearTypeByte{
+    .command = QueryGearType.command};
+constexpr static const QueryCommand<uint8_t> QueryDimmingCurveByte{
+    .command = QueryDimmingCurve.command};
+constexpr static const QueryCommand<uint8_t> QueryPossibleOperatingModesByte{
+    .command = QueryPossibleOperatingModes.command};
+
+static_assert(sizeof(Inventory::StoredGear) == 17);
+
+template <size_t N>
+static void pack(std::array<uint8_t, N> &bytes, uint64_t value) {
+  for (size_t i = 0; i < N; i++) {
+    bytes[N - 1 - i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+template <size_t N>
+static uint64_t unpack(const std::array<uint8_t, N> &bytes) {
+  uint64_t value = 0;
+  for (auto byte : bytes) {
+    value = (value << 8) | byte;
+  }
+  return value;
+}
+
+// The parts of the entry that are stored.
+static bool same_identity(const InventoryEntry &a, const InventoryEntry &b) {
+  if (!a.present && !b.present) {
+    return true;
+  }
+  return a.present == b.present &&
+         a.identification_number == b.identification_number &&
+         a.gtin == b.gtin && a.gear_type == b.gear_type &&
+         a.operating_modes == b.operating_modes &&
+         a.dimming_curve == b.dimming_curve;
+}
+
+bool Inventory::load(uint8_t block, const Record &record) {
+  auto first = block * BLOCK_GEAR;
+  this->dirty_ &= ~(1 << block);
+  for (uint8_t i = 0; i < BLOCK_GEAR; i++) {
+    auto &entry = this->gear_[first + i];
+    entry = InventoryEntry{};
+    if (record.version != VERSION || !(record.present & (1 << i))) {
+      continue;
+    }
+    const auto &stored = record.gear[i];
+    entry.identification_number = unpack(stored.identification_number);
+    entry.gtin = unpack(stored.gtin);
+    entry.gear_type = stored.gear_type;
+    entry.operating_modes = stored.operating_modes;
+    entry.dimming_curve = stored.dimming_curve;
+    entry.present = true;
+  }
+  return record.version == VERSION;
+}
+
+Inventory::Record Inventory::record(uint8_t block) const {
+  Record record;
+  auto first = block * BLOCK_GEAR;
+  for (uint8_t i = 0; i < BLOCK_GEAR; i++) {
+    const auto &entry = this->gear_[first + i];
+    if (!entry.present) {
+      continue;
+    }
+    record.present |= 1 << i;
+    auto &stored = record.gear[i];
+    pack(stored.identification_number, entry.identification_number);
+    pack(stored.gtin, entry.gtin);
+    stored.gear_type = entry.gear_type;
+    stored.operating_modes = entry.operating_modes;
+    stored.dimming_curve = entry.dimming_curve;
+  }
+  return record;
+}
+
+void Inventory::update(uint8_t short_address, const InventoryEntry &entry) {
+  auto &stored = this->gear_[short_address];
+  if (!same_identity(stored, entry)) {
+    this->set_dirty_(short_address);
+  }
+  stored = entry;
+}
+
+bool Inventory::check(uint8_t short_address, std::optional<uint8_t> reply) {
+  auto &entry = this->gear_[short_address];
+  if (reply.has_value() &&
+      *reply == static_cast<uint8_t>(entry.identification_number)) {
+    return true;
+  }
+  if (entry.present) {
+    entry.present = false;
+    this->set_dirty_(short_address);
+  }
+  return false;
+}
+
+void Inventory::set_level(uint8_t short_address, uint8_t level) {
+  this->gear_[short_address].level = level;
+}
+
+void Inventory::set_dimming_curve(uint8_t short_address, uint8_t curve) {
+  auto &entry = this->gear_[short_address];
+  if (entry.dimming_curve != curve) {
+    entry.dimming_curve = curve;
+    this->set_dirty_(short_address);
+  }
+}
+
+void Inventory::set_extended_fade_time(uint8_t short_address, uint8_t value) {
+  this->gear_[short_address].extended_fade_time = value;
+}
+
+ErrorCode Inventory::query(BusInterface *bus, uint8_t short_address) {
+  auto entry = InventoryEntry{};
+  auto err = this->query_(bus, short_address, entry);
+  if (err) {
+    return err;
+  }
+  this->update(short_address, entry);
+  return ErrorCode::OK;
+}
+
+ErrorCode Inventory::query_(BusInterface *bus, uint8_t short_address,
+                            InventoryEntry &entry) {
+  auto address = Address::from_short_address(short_address);
+
+  MemoryBankBuffer<IDENTITY_LENGTH> identity;
+  auto err = identity.read(bus, address, 0, IDENTITY_LOCATION);
+  if (err == ErrorCode::TIMEOUT) {
+    // No gear with this short address.
+    return ErrorCode::OK;
+  }
+  if (err) {
+    return err;
+  }
+  if (auto gtin = MemoryBank0GTIN(identity)) {
+    entry.gtin = static_cast<uint64_t>(*gtin);
+  }
+  if (auto id = MemoryBank0GearIdentificationNumber(identity)) {
+    entry.identification_number = static_cast<uint64_t>(*id);
+  }
+
+  // Gear that doesn't implement a query doesn't answer it.
+  struct Field {
+    const QueryCommand<uint8_t> &query;
+    uint8_t &value;
+  };
+  for (auto field : {Field{QueryGearTypeByte, entry.gear_type},
+                     Field{QueryPossibleOperatingModesByte,
+                           entry.operating_modes},
+                     Field{QueryDimmingCurveByte, entry.dimming_curve},
+                     Field{QueryActualLevel, entry.level}}) {
+    auto value = field.query(bus, address);
+    if (value) {
+      field.value = *value;
+    } else if (value.error() != ErrorCode::TIMEOUT) {
+      return value.error();
+    }
+  }
+  entry.present = true;
+  return ErrorCode::OK;
+}
+
+ErrorCode
+Inventory::validate(BusInterface *bus,
+                    const std::bitset<SHORT_ADDRESSES> &short_addresses) {
+  this->queried_ = 0;
+  ErrorCode err;
+  for (uint8_t short_address = 0; short_address < SHORT_ADDRESSES;
+       short_address++) {
+    if (!short_addresses.test(short_address)) {
+      continue;
+    }
+    auto &entry = this->gear_[short_address];
+    if (!entry.present) {
+      this->queried_++;
+      err = this->query(bus, short_address);
+      if (err) {
+        break;
+      }
+      continue;
+    }
+
+    // DTR0 is broadcast, READ MEMORY LOCATION only increments it in the
+    // addressed gear. With the register cache both are written once for all
+    // gear.
+    err = DataTransferRegister1(bus, 0);
+    if (err) {
+      break;
+    }
+    err = DataTransferRegister(bus, SPOT_CHECK_LOCATION);
+    if (err) {
+      break;
+    }
+    uint8_t reply;
+    err = bus->DaliCommand(Address::from_short_address(short_address).command(),
+                           DA_READ_MEMORY_LOCATION, &reply, 1);
+    if (err == ErrorCode::TIMEOUT) {
+      // Gone, queried again on the next validation.
+      this->check(short_address, std::nullopt);
+      err = ErrorCode::OK;
+      continue;
+    }
+    if (err) {
+      break;
+    }
+    if (!this->check(short_address, reply)) {
+      this->queried_++;
+      err = this->query(bus, short_address);
+      if (err) {
+        break;
+      }
+    }
+  }
+  // DTR0 of the checked gear differs from the others now.
+  bus->shadow.dtr0.reset();
+  return err;
+}
+
+} // namespace libdali
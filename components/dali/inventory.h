@@ -0,0 +1,108 @@
+#pragma once
+#include "dali.h"
+#include <array>
+
+namespace libdali {
+
+// What is known about the gear with one short address. Level and fade are
+// kept in memory only.
+struct InventoryEntry {
+  uint64_t identification_number = 0;
+  uint64_t gtin = 0;
+  uint8_t gear_type = 0;
+  uint8_t operating_modes = 0;
+  uint8_t dimming_curve = 0;
+  // Last known actual level.
+  uint8_t level = 0;
+  // Extended fade time programmed together with FADE TIME 0, DA_MASK if not
+  // programmed yet.
+  uint8_t extended_fade_time = DA_MASK;
+  bool present = false;
+
+  bool operator==(const InventoryEntry &o) const = default;
+};
+
+// Identity and state of the gear of one bus, kept across restarts so that
+// gear only has to be queried again when it was replaced.
+class Inventory {
+public:
+  static constexpr uint8_t SHORT_ADDRESSES = 64;
+  // Changed whenever the layout of Record changes.
+  static constexpr uint32_t VERSION = 0x44414c03;
+  // Gear per Record. esphome keeps one preference per block with configured
+  // gear, so that small installations fit the preferences of an ESP8266.
+  static constexpr uint8_t BLOCK_GEAR = 8;
+  static constexpr uint8_t BLOCKS = SHORT_ADDRESSES / BLOCK_GEAR;
+  // Bank 0 range holding GTIN and identification number.
+  static constexpr uint8_t IDENTITY_LOCATION = 0x03;
+  static constexpr uint8_t IDENTITY_LENGTH = 0x10;
+  // Last byte of the identification number, the one most likely to differ.
+  static constexpr uint8_t SPOT_CHECK_LOCATION = 0x12;
+
+  // Identity of a gear as stored, big endian without padding.
+  struct StoredGear {
+    std::array<uint8_t, 8> identification_number;
+    std::array<uint8_t, 6> gtin;
+    uint8_t gear_type;
+    uint8_t operating_modes;
+    uint8_t dimming_curve;
+  };
+  // The gear of one block, stored as is, e.g. in esphome preferences or a
+  // file.
+  struct Record {
+    uint32_t version = VERSION;
+    // Bit per gear of the block.
+    uint8_t present = 0;
+    std::array<StoredGear, BLOCK_GEAR> gear{};
+  };
+
+  // Take over the stored record of the block. Returns false and keeps the
+  // gear of the block empty if it was written by another version.
+  bool load(uint8_t block, const Record &record);
+  Record record(uint8_t block) const;
+
+  const InventoryEntry &gear(uint8_t short_address) const {
+    return this->gear_[short_address];
+  }
+  // Replace the entry, e.g. with one queried without query().
+  void update(uint8_t short_address, const InventoryEntry &entry);
+  // Compare the reply to READ MEMORY LOCATION of SPOT_CHECK_LOCATION,
+  // std::nullopt if there was none, with the entry. If it doesn't match the
+  // entry is marked not present and false returned.
+  bool check(uint8_t short_address, std::optional<uint8_t> reply);
+  void set_level(uint8_t short_address, uint8_t level);
+  void set_dimming_curve(uint8_t short_address, uint8_t curve);
+  void set_extended_fade_time(uint8_t short_address, uint8_t value);
+
+  // Query all entries of the gear from the gear itself.
+  ErrorCode query(BusInterface *bus, uint8_t short_address);
+  // Check that the gear in `short_addresses` are still the ones in the
+  // inventory with one READ MEMORY LOCATION of the last byte of their
+  // identification number each. Gear not known yet or with another
+  // identification number is queried again. Meant to run with the shadow
+  // register cache enabled.
+  ErrorCode validate(BusInterface *bus,
+                     const std::bitset<SHORT_ADDRESSES> &short_addresses);
+
+  // Blocks whose record changed since the last call to clear_dirty(), one
+  // bit per block. Level and fade changes do not count.
+  uint8_t dirty_blocks() const { return this->dirty_; }
+  bool dirty() const { return this->dirty_ != 0; }
+  void clear_dirty() { this->dirty_ = 0; }
+  // Gear queried by the last validate().
+  uint8_t queried() const { return this->queried_; }
+
+protected:
+  ErrorCode query_(BusInterface *bus, uint8_t short_address,
+                   InventoryEntry &entry);
+
+  void set_dirty_(uint8_t short_address) {
+    this->dirty_ |= 1 << (short_address / BLOCK_GEAR);
+  }
+
+  std::array<InventoryEntry, SHORT_ADDRESSES> gear_{};
+  uint8_t dirty_ = 0;
+  uint8_t queried_ = 0;
+};
+
+} // namespace libdali
@@ -11,13 +11,31 @@ DEPENDENCIES = ["dali"]
 AUTO_LOAD = ["light"]
 CONF_BUS= "bus"
 CONF_SHORT_ADDRESS = "short_address"
-CONFIG_SCHEMA = light.light_schema(
-    Output, type_=LightType.BRIGHTNESS_ONLY
-).extend(
-    {
-        cv.Required(CONF_BUS): cv.use_id(Bus),
-        cv.Required(CONF_SHORT_ADDRESS): cv.int_,
-    }
+CONF_GROUP = "group"
+CONF_MEMBERS = "members"
+
+
+def validate_members(config):
+    if CONF_MEMBERS in config and CONF_GROUP not in config:
+        raise cv.Invalid(f"{CONF_MEMBERS} requires {CONF_GROUP}")
+    return config
+
+
+CONFIG_SCHEMA = cv.All(
+    light.light_schema(Output, type_=LightType.BRIGHTNESS_ONLY).extend(
+        {
+            cv.Required(CONF_BUS): cv.use_id(Bus),
+            cv.Exclusive(CONF_SHORT_ADDRESS, "address"): cv.int_range(
+                min=0, max=63
+            ),
+            cv.Exclusive(CONF_GROUP, "address"): cv.int_range(min=0, max=15),
+            cv.Optional(CONF_MEMBERS): cv.ensure_list(
+                cv.int_range(min=0, max=63)
+            ),
+        }
+    ),
+    cv.has_exactly_one_key(CONF_SHORT_ADDRESS, CONF_GROUP),
+    validate_members,
 )
 
 async def to_code(config):
@@ -25,5 +43,13 @@ async def to_code(config):
     bus = await cg.get_variable(config[CONF_BUS])
     cg.add(var.set_bus(bus))
 
+    if CONF_GROUP in config:
+        group = config[CONF_GROUP]
+        cg.add(var.set_group(group))
+        for member in config.get(CONF_MEMBERS, []):
+            cg.add(bus.add_group_member(group, member))
+        return
+
     shortAddress = config[CONF_SHORT_ADDRESS]
     cg.add(var.set_short_address(shortAddress))
+    cg.add(bus.add_light(shortAddress))
@@ -1,5 +1,8 @@
 #pragma once
+#include "bus_metrics.h"
 #include "dali.h"
+#include "monitor.h"
+#include <array>
 
 namespace libdali {
 
@@ -21,20 +24,143 @@ public:
 
 constexpr uint8_t LW14_DEFAULT_ADDRESS = 0x23;
 
-class LW14Adapter : public BusInterface {
+// Identifies a command queued with LW14Adapter::submit().
+using CommandHandle = uint32_t;
+
+// Driver of the LW14 on top of an I2C transport. With the default transport
+// I2CInterface every register access is a virtual call. A concrete transport
+// class declared final resolves them at compile time, see lw14_impl.h.
+template <typename Transport> class LW14AdapterT : public BusInterface {
 public:
-  LW14Adapter(I2CInterface *t) : transport(t) {}
-  LW14Adapter(const LW14Adapter &o) = delete;
-  virtual ErrorCode DaliCommand(uint8_t address, uint8_t data, uint8_t *reply,
-                                size_t reply_length,
-                                uint32_t timeout_ms) override;
-  LW14Adapter &operator=(const LW14Adapter &o) = delete;
+  // Number of commands that can be queued with submit() at the same time.
+  static constexpr size_t QUEUE_SIZE = 4;
+  // Longest reply the LW14 can hold in its COMMAND register.
+  static constexpr size_t MAX_REPLY_LENGTH = 3;
+  // Default safety margin added to the DALI frame timing.
+  static constexpr uint32_t DEFAULT_TIMING_MARGIN_US = 5000;
+
+  LW14AdapterT(Transport *t) : transport(t) {}
+  LW14AdapterT(const LW14AdapterT &o) = delete;
+  // Blocking command, implemented as submit() followed by poll() until done.
+  ErrorCode DaliCommand(uint8_t address, uint8_t data, uint8_t *reply,
+                        size_t reply_length,
+                        uint32_t timeout_ms = 150) final;
+  LW14AdapterT &operator=(const LW14AdapterT &o) = delete;
   virtual void delay_microseconds(uint32_t us) override {
     this->transport->delay_microseconds(us);
   }
+  // Milliseconds of the transport clock.
+  uint32_t now_ms() final { return this->transport->millis(); }
+
+  // Queue a command without touching the bus. Fails with BUS_BUSY if
+  // QUEUE_SIZE commands are already in flight and with INVALID_ARGUMENT if
+  // `reply_length` exceeds MAX_REPLY_LENGTH. Every returned handle has to be
+  // polled until it completed, otherwise its slot is never released.
+  // `timeout_ms` is the least time to wait for a reply after the frame was
+  // sent, extended to the end of the DALI reply window if shorter. A reply
+  // window that closes without a reply ends the wait early.
+  Result<CommandHandle> submit(uint8_t address, uint8_t data,
+                               size_t reply_length, uint32_t timeout_ms = 150);
+  // Advance the queued commands as far as possible without sleeping.
+  // Returns std::nullopt while `handle` is still in progress, otherwise its
+  // result. On success the reply is copied to `reply`.
+  std::optional<ErrorCode> poll(CommandHandle handle, uint8_t *reply);
+  // Like poll(handle, reply) without advancing the queue, for callers that
+  // collect several handles after one poll().
+  std::optional<ErrorCode> collect(CommandHandle handle, uint8_t *reply);
+  // Advance the queued commands. Returns true while commands are in flight.
+  bool poll();
+  // Microseconds until poll() can make progress again, 0 if it should be
+  // called right away.
+  uint32_t poll_delay_us();
+
+  // Margin added to the forward frame time before the status is read, and to
+  // the end of the reply window before a command without reply gives up.
+  void set_timing_margin_us(uint32_t margin_us) {
+    this->timing_margin_us_ = margin_us;
+  }
+  uint32_t get_timing_margin_us() const { return this->timing_margin_us_; }
+  // Shortest wait after writing a frame before the status is read. Some LW14
+  // and ESP32 combinations report overlapping responses when read too early,
+  // the former fixed wait was 50000 us. 0 waits only for the forward frame
+  // and the timing margin.
+  void set_min_settle_us(uint32_t settle_us) {
+    this->min_settle_us_ = settle_us;
+  }
+  uint32_t get_min_settle_us() const { return this->min_settle_us_; }
+
+  const BusMetrics &metrics() const { return this->metrics_; }
+  void reset_metrics() { this->metrics_.reset(); }
+
+  // Monitor mode: record every frame sent and every telegram received into
+  // `monitor`, nullptr turns it off. While no command is in flight poll()
+  // reads the status at most once per transport millisecond to catch the
+  // frames of other masters, call it at least every few milliseconds to read
+  // each telegram before the next one overwrites it.
+  void set_monitor(BusMonitor *monitor) { this->monitor_ = monitor; }
+  BusMonitor *get_monitor() const { return this->monitor_; }
 
 protected:
-  I2CInterface *transport;
+  enum class Phase : uint8_t {
+    FREE,       // Slot unused.
+    WAIT_IDLE,  // Waiting for a non-busy bus.
+    SETTLE,     // Frame written, waiting before looking at the reply.
+    WAIT_REPLY, // Waiting for a reply or the end of the frame.
+    DONE,       // Finished, result not yet collected.
+  };
+  struct PendingCommand {
+    Phase phase = Phase::FREE;
+    uint8_t address = 0, data = 0;
+    uint8_t reply_length = 0;
+    uint8_t reply[MAX_REPLY_LENGTH] = {};
+    uint8_t attempts = 0;
+    CommandClass command_class = CommandClass::CONTROL;
+    // Transport milliseconds of submit(), for the latency.
+    uint32_t submitted = 0;
+    // Deadline for the reply, counted from the end of SETTLE.
+    uint32_t timeout_ms = 0;
+    // Start of the current wait in transport milliseconds.
+    uint32_t since = 0;
+    uint32_t wait_ms = 0;
+    ErrorCode result;
+  };
+
+  // Runs one step of the active command. Returns false if it has to wait.
+  bool step_(PendingCommand &cmd);
+  void finish_(PendingCommand &cmd, ErrorCode result);
+  // Transport register access, counted in the metrics.
+  I2CResult read_(uint8_t i2c_register, uint8_t *data, size_t len);
+  I2CResult write_(uint8_t i2c_register, uint8_t *data, size_t len);
+  // Read the telegram waiting in the COMMAND register, recorded as a frame
+  // of another master.
+  I2CResult read_telegram_(uint8_t status);
+  // Look for telegrams while no command is in flight, for the monitor.
+  void listen_();
+  void record_(uint8_t flags, const uint8_t *data, size_t length) {
+    if (this->monitor_ != nullptr) {
+      this->monitor_->record(this->transport->millis(), flags, data, length);
+    }
+  }
+  PendingCommand &slot_(CommandHandle handle) {
+    return this->queue_[handle % QUEUE_SIZE];
+  }
+
+  Transport *transport;
+  std::array<PendingCommand, QUEUE_SIZE> queue_;
+  // Oldest command not yet finished.
+  CommandHandle active_ = 0;
+  // Handle given to the next submitted command.
+  CommandHandle next_ = 0;
+  uint32_t timing_margin_us_ = DEFAULT_TIMING_MARGIN_US;
+  uint32_t min_settle_us_ = 0;
+  BusMetrics metrics_;
+  BusMonitor *monitor_ = nullptr;
+  // Transport milliseconds of the last status read of listen_().
+  uint32_t listened_ms_ = 0;
 };
 
+// The runtime polymorphic adapter, compiled once in lw14.cpp.
+extern template class LW14AdapterT<I2CInterface>;
+using LW14Adapter = LW14AdapterT<I2CInterface>;
+
 } // namespace libdali
@@ -0,0 +1,356 @@
+#pragma once
+// Definitions of LW14AdapterT. lw14.cpp instantiates the adapter for
+// I2CInterface, include this header to instantiate it for a concrete
+// transport:
+//
+//   class Transport final : public libdali::I2CInterface { ... };
+//   libdali::LW14AdapterT<Transport> bus(&transport);
+#include "lw14.h"
+#include <bitset>
+#include <cstdint>
+#include <sstream>
+
+namespace libdali {
+
+struct I2CRegister {
+  struct I2cRegister {
+    uint8_t address;
+    uint8_t size;
+  };
+  static constexpr I2cRegister STATUS{.address = 0x00, .size = 1};
+  static constexpr I2cRegister COMMAND{.address = 0x01, .size = 1};
+  static constexpr I2cRegister CONFIG{.address = 0x02, .size = 1};
+  static constexpr I2cRegister SIGNATURE{.address = 0xf0, .size = 1};
+  static constexpr I2cRegister ADDRESS{.address = 0xfe, .size = 1};
+};
+
+// The status register is one byte that contains the bus status and command
+// status flags.
+class I2CRegisterStatusValue : std::bitset<I2CRegister::STATUS.size*8> {
+public:
+  explicit I2CRegisterStatusValue(uint8_t v)
+      : std::bitset<I2CRegister::STATUS.size*8>(v) {}
+  // LSB byte count for telegram received
+  bool lsb_byte_count() const { return this->test(0); }
+  // MSB byte count for telegram received
+  bool msb_byte_count() const { return this->test(1); }
+  // Bytes of the received telegram, 1 for a backward frame, 2 or 3 for the
+  // forward frame of another master.
+  uint8_t byte_count() const {
+    return (this->msb_byte_count() ? 2 : 0) + (this->lsb_byte_count() ? 1 : 0);
+  }
+  // true if less than 22 Te since last command
+  bool reply_timeframe() const { return this->test(2); }
+  bool valid_reply() const { return this->test(3); }
+  bool frame_error() const { return this->test(4); }
+  bool overrun() const { return this->test(5); }
+  bool busy() const { return this->test(6); }
+  bool bus_error() const { return this->test(7); }
+  explicit operator std::string() const noexcept {
+    std::ostringstream buf;
+    buf << "lsb_byte_count: " << this->lsb_byte_count()
+        << ",msb_byte_count: " << this->msb_byte_count()
+        << ",reply_timeframe: " << this->reply_timeframe()
+        << ",valid_reply: " << this->valid_reply()
+        << ",frame_error: " << this->frame_error()
+        << ",overrun: " << this->overrun() << ",busy: " << this->busy()
+        << ",bus_error: " << this->bus_error();
+    return buf.str();
+  }
+};
+
+// DALI frame timing in half bit periods Te.
+// A forward frame is a start bit, 16 data bits and 2 stop bits.
+static constexpr uint32_t FORWARD_FRAME_TE = 38;
+// A backward frame starts at most 22 Te after the forward frame and is a start
+// bit, 8 data bits and 2 stop bits.
+static constexpr uint32_t BACKWARD_FRAME_END_TE = 22 + 22;
+// The LW14 keeps the settling time after the previous frame before sending.
+static constexpr uint32_t SETTLING_TE = 22;
+
+constexpr uint32_t us_to_ms(uint32_t us) { return (us + 999) / 1000; }
+
+template <typename Transport>
+ErrorCode LW14AdapterT<Transport>::DaliCommand(uint8_t address, uint8_t data,
+                                              uint8_t *reply,
+                                              size_t reply_length,
+                                              uint32_t timeout_ms) {
+  auto handle = this->submit(address, data, reply_length, timeout_ms);
+  if (!handle) {
+    return handle.error();
+  }
+  while (true) {
+    if (auto result = this->poll(*handle, reply)) {
+      return *result;
+    }
+    auto wait = this->poll_delay_us();
+    if (wait > 0) {
+      this->transport->delay_microseconds(wait);
+    }
+  }
+}
+
+template <typename Transport>
+Result<CommandHandle>
+LW14AdapterT<Transport>::submit(uint8_t address, uint8_t data,
+                                size_t reply_length, uint32_t timeout_ms) {
+  if (reply_length > MAX_REPLY_LENGTH) {
+    return Result<CommandHandle>(ErrorCode(ErrorCode::INVALID_ARGUMENT));
+  }
+  auto &cmd = this->slot_(this->next_);
+  if (cmd.phase != Phase::FREE) {
+    this->metrics_.queue_full++;
+    return Result<CommandHandle>(ErrorCode(ErrorCode::BUS_BUSY));
+  }
+  cmd = PendingCommand{};
+  cmd.phase = Phase::WAIT_IDLE;
+  cmd.address = address;
+  cmd.data = data;
+  cmd.reply_length = static_cast<uint8_t>(reply_length);
+  cmd.timeout_ms = timeout_ms;
+  cmd.command_class = command_class(address, cmd.reply_length);
+  cmd.submitted = this->transport->millis();
+  return Result<CommandHandle>(this->next_++);
+}
+
+template <typename Transport>
+std::optional<ErrorCode> LW14AdapterT<Transport>::poll(CommandHandle handle,
+                                                      uint8_t *reply) {
+  this->poll();
+  return this->collect(handle, reply);
+}
+
+template <typename Transport>
+std::optional<ErrorCode>
+LW14AdapterT<Transport>::collect(CommandHandle handle, uint8_t *reply) {
+  // Only the QUEUE_SIZE handles below active_ can be finished.
+  if (static_cast<CommandHandle>(this->active_ - handle - 1) >= QUEUE_SIZE) {
+    return std::nullopt;
+  }
+  auto &cmd = this->slot_(handle);
+  if (cmd.phase != Phase::DONE) {
+    return std::nullopt;
+  }
+  if (!cmd.result && reply != nullptr) {
+    for (size_t i = 0; i < cmd.reply_length; i++) {
+      reply[i] = cmd.reply[i];
+    }
+  }
+  cmd.phase = Phase::FREE;
+  return cmd.result;
+}
+
+template <typename Transport>
+bool LW14AdapterT<Transport>::poll() {
+  while (this->active_ != this->next_) {
+    if (!this->step_(this->slot_(this->active_))) {
+      return true;
+    }
+  }
+  if (this->monitor_ != nullptr) {
+    this->listen_();
+  }
+  return false;
+}
+
+template <typename Transport>
+void LW14AdapterT<Transport>::listen_() {
+  auto now_ms = this->transport->millis();
+  if (now_ms == this->listened_ms_) {
+    return;
+  }
+  this->listened_ms_ = now_ms;
+  uint8_t status;
+  if (this->read_(I2CRegister::STATUS.address, &status, 1) != I2CResult::OK) {
+    return;
+  }
+  if (I2CRegisterStatusValue(status).valid_reply()) {
+    this->read_telegram_(status);
+  }
+}
+
+template <typename Transport>
+I2CResult LW14AdapterT<Transport>::read_telegram_(uint8_t status) {
+  auto value = I2CRegisterStatusValue(status);
+  uint8_t telegram[MAX_REPLY_LENGTH] = {};
+  size_t length = value.byte_count() == 0 ? 1 : value.byte_count();
+  auto err = this->read_(I2CRegister::COMMAND.address, &telegram[0], length);
+  if (err == I2CResult::OK) {
+    uint8_t flags = length == 1 ? MonitorFrame::BACKWARD : 0;
+    flags |= value.overrun() ? MonitorFrame::OVERRUN : 0;
+    this->record_(flags, &telegram[0], length);
+  }
+  return err;
+}
+
+template <typename Transport>
+uint32_t LW14AdapterT<Transport>::poll_delay_us() {
+  if (this->active_ == this->next_) {
+    return 0;
+  }
+  const auto &cmd = this->slot_(this->active_);
+  auto elapsed = this->transport->millis() - cmd.since;
+  if (elapsed >= cmd.wait_ms) {
+    return 0;
+  }
+  return (cmd.wait_ms - elapsed) * 1000;
+}
+
+template <typename Transport>
+void LW14AdapterT<Transport>::finish_(PendingCommand &cmd, ErrorCode result) {
+  cmd.result = result;
+  cmd.phase = Phase::DONE;
+  this->active_++;
+  this->metrics_.results[static_cast<ErrorCode::code_t>(result)]++;
+  this->metrics_.latency[static_cast<size_t>(cmd.command_class)].add(
+      this->transport->millis() - cmd.submitted);
+}
+
+template <typename Transport>
+I2CResult LW14AdapterT<Transport>::read_(uint8_t i2c_register, uint8_t *data,
+                                         size_t len) {
+  this->metrics_.i2c_transactions++;
+  return this->transport->read_register(i2c_register, data, len);
+}
+
+template <typename Transport>
+I2CResult LW14AdapterT<Transport>::write_(uint8_t i2c_register,
+                                          uint8_t *data, size_t len) {
+  this->metrics_.i2c_transactions++;
+  return this->transport->write_register(i2c_register, data, len);
+}
+
+template <typename Transport>
+bool LW14AdapterT<Transport>::step_(PendingCommand &cmd) {
+  if (this->transport->millis() - cmd.since < cmd.wait_ms) {
+    return false;
+  }
+  cmd.wait_ms = 0;
+
+  uint8_t buf[2];
+  switch (cmd.phase) {
+  case Phase::WAIT_IDLE: {
+    // wait for non-busy bus.
+    auto err = this->read_(I2CRegister::STATUS.address, &buf[0], 1);
+    if (err != I2CResult::OK) {
+      this->finish_(cmd, ErrorCode::I2C_ERROR);
+      return true;
+    }
+    auto status = I2CRegisterStatusValue(buf[0]);
+    if (status.bus_error()) {
+      this->finish_(cmd, ErrorCode::BUS_ERROR);
+      return true;
+    }
+    if (status.valid_reply()) {
+      // Telegram of another master or a late reply, clear it.
+      this->read_telegram_(buf[0]);
+      this->metrics_.stale_telegrams++;
+      cmd.attempts++;
+      return true;
+    }
+    if (status.busy() || status.reply_timeframe()) {
+      // wait 25 iterations for non busy bus.
+      this->metrics_.busy_waits++;
+      if (cmd.attempts++ > 25) {
+        this->finish_(cmd, ErrorCode::BUS_BUSY);
+        return true;
+      }
+      cmd.since = this->transport->millis();
+      // The reply window of the previous frame closes within 22 Te.
+      cmd.wait_ms = status.busy() ? 10 : 1;
+      return false;
+    }
+
+    buf[0] = cmd.address;
+    buf[1] = cmd.data;
+    err = this->write_(I2CRegister::COMMAND.address, &buf[0], 2);
+    if (err != I2CResult::OK) {
+      this->finish_(cmd, ErrorCode::I2C_ERROR);
+      return true;
+    }
+    this->record_(MonitorFrame::OWN, &buf[0], 2);
+
+    // Nothing to look at before the forward frame is on the wire.
+    cmd.phase = Phase::SETTLE;
+    cmd.since = this->transport->millis();
+    cmd.wait_ms = us_to_ms(dali_te_us(FORWARD_FRAME_TE) +
+                           this->timing_margin_us_);
+    if (cmd.wait_ms < us_to_ms(this->min_settle_us_)) {
+      cmd.wait_ms = us_to_ms(this->min_settle_us_);
+    }
+    return false;
+  }
+  case Phase::SETTLE: {
+    // wait for valid reply or non-busy for no result. The frame may have been
+    // delayed by the settling time, a reply ends 44 Te after the frame. The
+    // caller's timeout can only extend that deadline.
+    auto deadline_ms =
+        us_to_ms(dali_te_us(SETTLING_TE + BACKWARD_FRAME_END_TE) +
+                 this->timing_margin_us_);
+    if (cmd.timeout_ms < deadline_ms) {
+      cmd.timeout_ms = deadline_ms;
+    }
+    cmd.phase = Phase::WAIT_REPLY;
+    cmd.since = this->transport->millis();
+    return true;
+  }
+  case Phase::WAIT_REPLY: {
+    auto err = this->read_(I2CRegister::STATUS.address, &buf[0], 1);
+    if (err != I2CResult::OK) {
+      this->finish_(cmd, ErrorCode::I2C_ERROR);
+      return true;
+    }
+    auto status = I2CRegisterStatusValue(buf[0]);
+    if (status.frame_error()) {
+      // On broadcasts that can mean more than one devices responded.
+      this->record_(MonitorFrame::OWN | MonitorFrame::BACKWARD |
+                        MonitorFrame::FRAME_ERROR,
+                    nullptr, 0);
+      this->finish_(cmd, ErrorCode::FRAME_ERROR);
+      return true;
+    }
+    if (status.bus_error()) { // stop if bus is faulty (no Power, short, etc.)
+      this->finish_(cmd, ErrorCode::BUS_ERROR);
+      return true;
+    }
+    if (status.overrun()) {
+      this->metrics_.overruns++;
+    }
+
+    if (!status.busy() && cmd.reply_length == 0) {
+      this->finish_(cmd, ErrorCode::OK);
+      return true;
+    }
+
+    if (status.valid_reply()) {
+      // Read reply from command register.
+      err = this->read_(I2CRegister::COMMAND.address, &cmd.reply[0],
+                        cmd.reply_length);
+      if (err == I2CResult::OK && cmd.reply_length > 0) {
+        this->record_(MonitorFrame::OWN | MonitorFrame::BACKWARD,
+                      &cmd.reply[0], cmd.reply_length);
+      }
+      this->finish_(cmd, err != I2CResult::OK ? ErrorCode::I2C_ERROR
+                                              : ErrorCode::OK);
+      return true;
+    }
+
+    if (!status.busy() && !status.reply_timeframe()) {
+      // The reply window closed without a backward frame.
+      this->finish_(cmd, ErrorCode::TIMEOUT);
+      return true;
+    }
+
+    if (this->transport->millis() - cmd.since > cmd.timeout_ms) {
+      this->finish_(cmd, ErrorCode::TIMEOUT);
+      return true;
+    }
+    return false;
+  }
+  case Phase::FREE:
+  case Phase::DONE:
+    break;
+  }
+  return false;
+}
+} // namespace libdali
@@ -0,0 +1,155 @@
+#include "monitor.h"
+#include <cstdio>
+
+namespace libdali {
+
+static constexpr uint8_t BROADCAST_TARGET = 0x7f, GROUP_TARGET = 0x40;
+
+// Address bytes 0xa0 to 0xfd are special commands (odd) or reserved, none
+// of them addresses gear by short address or group.
+static bool special(uint8_t address) {
+  return address >= 0xa0 && address < 0xfe;
+}
+
+static const char *special_name(uint8_t address) {
+  switch (address) {
+  case 0xa1: return "TERMINATE";
+  case 0xa3: return "DTR0";
+  case 0xa5: return "INITIALISE";
+  case 0xa7: return "RANDOMISE";
+  case 0xa9: return "COMPARE";
+  case 0xab: return "WITHDRAW";
+  case 0xb1: return "SEARCHADDRH";
+  case 0xb3: return "SEARCHADDRM";
+  case 0xb5: return "SEARCHADDRL";
+  case 0xb7: return "PROGRAM SHORT ADDRESS";
+  case 0xb9: return "VERIFY SHORT ADDRESS";
+  case 0xbb: return "QUERY SHORT ADDRESS";
+  case 0xc1: return "ENABLE DEVICE TYPE";
+  case 0xc3: return "DTR1";
+  case 0xc5: return "DTR2";
+  case 0xc7: return "WRITE MEMORY LOCATION";
+  }
+  return "SPECIAL";
+}
+
+static const char *command_name(uint8_t data) {
+  switch (data) {
+  case 0x00: return "OFF";
+  case 0x01: return "UP";
+  case 0x02: return "DOWN";
+  case 0x03: return "STEP UP";
+  case 0x04: return "STEP DOWN";
+  case 0x05: return "RECALL MAX LEVEL";
+  case 0x06: return "RECALL MIN LEVEL";
+  case 0x07: return "STEP DOWN AND OFF";
+  case 0x08: return "ON AND STEP UP";
+  case 0x0a: return "GO TO LAST ACTIVE LEVEL";
+  }
+  return nullptr;
+}
+
+FrameEffect frame_effect(uint8_t address, uint8_t data) {
+  FrameEffect effect;
+  effect.target = address >> 1;
+  if (special(address)) {
+    return effect;
+  }
+  if (!(address & 1)) {
+    // MASK stops a fade at the level reached, which is unknown.
+    effect.kind = data == DA_MASK ? FrameEffect::Kind::CHANGED
+                                  : FrameEffect::Kind::LEVEL;
+    effect.value = data;
+    return effect;
+  }
+  if (data == 0x00) {
+    effect.kind = FrameEffect::Kind::LEVEL;
+  } else if ((data & 0xf0) == 0x10) {
+    effect.kind = FrameEffect::Kind::SCENE;
+    effect.value = data & 0x0f;
+  } else if (data <= 0x08 || data == 0x0a) {
+    effect.kind = FrameEffect::Kind::CHANGED;
+  }
+  return effect;
+}
+
+size_t MonitorFrame::encode(uint8_t *out) const {
+  for (size_t i = 0; i < 4; i++) {
+    out[i] = static_cast<uint8_t>(this->time_ms >> (8 * i));
+  }
+  auto length = this->length < MAX_LENGTH ? this->length : MAX_LENGTH;
+  out[4] = static_cast<uint8_t>(this->flags << 2 | length);
+  for (size_t i = 0; i < length; i++) {
+    out[5 + i] = this->data[i];
+  }
+  return 5 + length;
+}
+
+int MonitorFrame::describe(char *out, size_t size) const {
+  char bytes[3 * MAX_LENGTH] = "";
+  for (size_t i = 0, n = 0; i < this->length && i < MAX_LENGTH; i++) {
+    n += std::snprintf(bytes + n, sizeof(bytes) - n, "%s%02x",
+                       n > 0 ? " " : "", this->data[i]);
+  }
+
+  char meaning[48] = "";
+  if (this->flags & FRAME_ERROR) {
+    std::snprintf(meaning, sizeof(meaning), "frame error");
+  } else if (this->backward()) {
+    std::snprintf(meaning, sizeof(meaning), "reply %u", this->data[0]);
+  } else if (this->length == 2) {
+    uint8_t address = this->data[0], data = this->data[1];
+    uint8_t target = address >> 1;
+    char addressed[16];
+    if (special(address)) {
+      std::snprintf(meaning, sizeof(meaning), "%s %u",
+                    address & 1 ? special_name(address) : "RESERVED", data);
+    } else {
+      if (target == BROADCAST_TARGET) {
+        std::snprintf(addressed, sizeof(addressed), "broadcast");
+      } else if (target & GROUP_TARGET) {
+        std::snprintf(addressed, sizeof(addressed), "group %u", target & 15);
+      } else {
+        std::snprintf(addressed, sizeof(addressed), "short %u", target);
+      }
+      if (!(address & 1)) {
+        std::snprintf(meaning, sizeof(meaning), "%s DAPC %u", addressed, data);
+      } else if ((data & 0xf0) == 0x10) {
+        std::snprintf(meaning, sizeof(meaning), "%s GO TO SCENE %u",
+                      addressed, data & 0x0f);
+      } else if (auto name = command_name(data)) {
+        std::snprintf(meaning, sizeof(meaning), "%s %s", addressed, name);
+      } else {
+        std::snprintf(meaning, sizeof(meaning), "%s %s 0x%02x", addressed,
+                      data >= 0x90 ? "QUERY" : "COMMAND", data);
+      }
+    }
+  }
+
+  return std::snprintf(out, size, "%6lu.%03lu %s %c %-8s  %s%s",
+                       static_cast<unsigned long>(this->time_ms / 1000),
+                       static_cast<unsigned long>(this->time_ms % 1000),
+                       this->own() ? "own" : "bus",
+                       this->backward() ? '<' : '>', bytes, meaning,
+                       this->flags & OVERRUN ? " (overrun)" : "");
+}
+
+void BusMonitor::record(uint32_t time_ms, uint8_t flags, const uint8_t *data,
+                        size_t length) {
+  MonitorFrame frame;
+  frame.time_ms = time_ms;
+  frame.flags = flags;
+  frame.length = static_cast<uint8_t>(
+      length < MonitorFrame::MAX_LENGTH ? length : MonitorFrame::MAX_LENGTH);
+  for (size_t i = 0; i < frame.length; i++) {
+    frame.data[i] = data[i];
+  }
+  if (flags & MonitorFrame::OVERRUN) {
+    this->overruns_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (!this->frames_.push(frame)) {
+    this->dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+} // namespace libdali
@@ -0,0 +1,94 @@
+#pragma once
+#include "dali.h"
+#include "spsc_ring.h"
+
+namespace libdali {
+
+// One frame seen on the bus by an LW14Adapter in monitor mode.
+struct MonitorFrame {
+  // Backward frame, otherwise a forward frame.
+  static constexpr uint8_t BACKWARD = 0x01;
+  // Sent by this adapter or the reply to one of its frames, otherwise the
+  // frame of another master or the reply to it.
+  static constexpr uint8_t OWN = 0x02;
+  // More than one gear answered, the frame has no data.
+  static constexpr uint8_t FRAME_ERROR = 0x04;
+  // The LW14 dropped telegrams before this one, it was not read in time.
+  static constexpr uint8_t OVERRUN = 0x08;
+  // Longest frame, a 24 bit forward frame to control devices.
+  static constexpr size_t MAX_LENGTH = 3;
+  // Bytes of encode(): time, flags and length, data.
+  static constexpr size_t MAX_ENCODED = 4 + 1 + MAX_LENGTH;
+
+  // Transport milliseconds when the frame was written or read.
+  uint32_t time_ms = 0;
+  uint8_t flags = 0;
+  uint8_t length = 0;
+  std::array<uint8_t, MAX_LENGTH> data{};
+
+  bool backward() const { return this->flags & BACKWARD; }
+  bool own() const { return this->flags & OWN; }
+
+  // Compact binary form: time_ms little endian, flags << 2 | length, the
+  // data bytes. Returns the number of bytes written to `out`, which has room
+  // for MAX_ENCODED bytes.
+  size_t encode(uint8_t *out) const;
+  // One human readable line without line break, e.g.
+  // "    12.345 bus > fe 64     broadcast DAPC 100". Returns the length like
+  // snprintf.
+  int describe(char *out, size_t size) const;
+};
+
+// What a forward frame does to the level of the gear it addresses.
+struct FrameEffect {
+  enum class Kind : uint8_t {
+    // No level change: queries, configuration and special commands.
+    NONE,
+    // Absolute level `value`, DirectArc or OFF.
+    LEVEL,
+    // GO TO SCENE `value`.
+    SCENE,
+    // Relative or otherwise unknown change, e.g. UP or RECALL MAX LEVEL.
+    CHANGED,
+  };
+  Kind kind = Kind::NONE;
+  uint8_t value = 0;
+  // Addressed gear as ArcQueue::Entry::short_address: the short address,
+  // 0x40 | group or 0x7f for broadcast.
+  uint8_t target = 0;
+};
+
+FrameEffect frame_effect(uint8_t address, uint8_t data);
+
+// Frames captured by an LW14Adapter, see LW14AdapterT::set_monitor(). The
+// adapter records from the thread that polls it, the frames can be taken
+// from another one without locking. Frames are only dropped if the consumer
+// falls CAPACITY frames behind, more than five seconds of a saturated bus.
+class BusMonitor {
+public:
+  static constexpr size_t CAPACITY = 256;
+
+  // Producer side, called by the adapter.
+  void record(uint32_t time_ms, uint8_t flags, const uint8_t *data,
+              size_t length);
+  // Consumer side. Returns false if no frame is waiting.
+  bool pop(MonitorFrame &frame) { return this->frames_.pop(frame); }
+  size_t waiting() const { return this->frames_.size(); }
+
+  // Frames lost because the ring was full.
+  uint32_t dropped() const {
+    return this->dropped_.load(std::memory_order_relaxed);
+  }
+  // Telegrams the LW14 overwrote before they were read, see
+  // MonitorFrame::OVERRUN.
+  uint32_t overruns() const {
+    return this->overruns_.load(std::memory_order_relaxed);
+  }
+
+protected:
+  SpscRing<MonitorFrame, CAPACITY> frames_;
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> overruns_{0};
+};
+
+} // namespace libdali
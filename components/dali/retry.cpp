@@ -0,0 +1,110 @@
+#include "retry.h"
+
+namespace libdali {
+
+bool idempotent(uint8_t address, uint8_t data) {
+  if (!(address & 1)) {
+    // DirectArc.
+    return true;
+  }
+  if ((address & 0xe0) == 0xa0 || (address & 0xe0) == 0xc0) {
+    switch (address) {
+    case 0xa1: // TERMINATE
+    case 0xa3: // DTR0
+    case 0xa9: // COMPARE
+    case 0xab: // WITHDRAW
+    case 0xb1: // SEARCHADDRH
+    case 0xb3: // SEARCHADDRM
+    case 0xb5: // SEARCHADDRL
+    case 0xb7: // PROGRAM SHORT ADDRESS
+    case 0xb9: // VERIFY SHORT ADDRESS
+    case 0xbb: // QUERY SHORT ADDRESS
+    case 0xc3: // DTR1
+    case 0xc5: // DTR2
+      return true;
+    default:
+      // INITIALISE and RANDOMISE are sent twice, WRITE MEMORY LOCATION
+      // increments DTR0.
+      return false;
+    }
+  }
+  // OFF, RECALL MAX LEVEL, RECALL MIN LEVEL, GO TO LAST ACTIVE LEVEL and
+  // GO TO SCENE set an absolute level.
+  if (data == 0x00 || data == 0x05 || data == 0x06 || data == 0x0a ||
+      (data & 0xf0) == 0x10) {
+    return true;
+  }
+  // Relative level changes and configuration commands.
+  if (data < 0x90) {
+    return false;
+  }
+  // Application extended configuration commands like SELECT DIMMING CURVE,
+  // executed when received twice within 100ms.
+  if (data >= 0xe0 && data <= 0xec) {
+    return false;
+  }
+  // Queries, except READ MEMORY LOCATION which increments DTR0.
+  return data != DA_READ_MEMORY_LOCATION;
+}
+
+RetryPolicies::RetryPolicies() {
+  // The frame did not leave the LW14, the bus is used by another master.
+  this->set(ErrorCode::BUS_BUSY,
+            RetryPolicy{.attempts = 3, .backoff_us = 20000, .queries = true});
+  this->set(ErrorCode::I2C_ERROR,
+            RetryPolicy{.attempts = 3, .backoff_us = 2000, .queries = true});
+  this->set(ErrorCode::TIMEOUT,
+            RetryPolicy{.attempts = 2, .backoff_us = 5000, .queries = false});
+}
+
+bool RetryPolicies::allows(ErrorCode err, size_t reply_length,
+                           uint8_t attempt) const {
+  const auto &policy = this->get(err);
+  return err && attempt < policy.attempts &&
+         (reply_length == 0 || policy.queries);
+}
+
+uint32_t RetryPolicies::backoff_us(ErrorCode err, uint8_t attempt) {
+  uint32_t backoff = this->get(err).backoff_us;
+  for (uint8_t i = 1; i < attempt && backoff < (1u << 24); i++) {
+    backoff *= 2;
+  }
+  this->seed_ ^= this->seed_ << 13;
+  this->seed_ ^= this->seed_ >> 17;
+  this->seed_ ^= this->seed_ << 5;
+  // Spread the retries of masters that collided over time.
+  auto jitter = static_cast<uint64_t>(backoff) * (this->seed_ % 1024) / 1024;
+  return backoff / 2 + static_cast<uint32_t>(jitter);
+}
+
+ErrorCode RetryBus::DaliCommand(uint8_t address, uint8_t data, uint8_t *reply,
+                                size_t reply_length, uint32_t timeout_ms) {
+  auto err =
+      this->bus_->DaliCommand(address, data, reply, reply_length, timeout_ms);
+  if (!err || !idempotent(address, data)) {
+    return err;
+  }
+  auto start_ms = this->bus_->now_ms();
+  uint8_t attempt = 1;
+  for (; this->policies_.allows(err, reply_length, attempt); attempt++) {
+    auto backoff_us = this->policies_.backoff_us(err, attempt);
+    auto elapsed_ms = this->bus_->now_ms() - start_ms;
+    if (elapsed_ms + backoff_us / 1000 > this->policies_.get_deadline_ms()) {
+      break;
+    }
+    this->bus_->delay_microseconds(backoff_us);
+    this->stats_.retries++;
+    err =
+        this->bus_->DaliCommand(address, data, reply, reply_length, timeout_ms);
+    if (!err) {
+      this->stats_.recovered++;
+      return err;
+    }
+  }
+  if (attempt > 1) {
+    this->stats_.failed++;
+  }
+  return err;
+}
+
+} // namespace libdali
@@ -0,0 +1,96 @@
+#pragma once
+#include "bus_metrics.h"
+#include "dali.h"
+
+namespace libdali {
+
+// Whether the frame can be sent again without changing the outcome, e.g.
+// after it may or may not have reached the gear. Configuration commands are
+// sent twice within 100ms and never repeated on their own, relative level
+// changes and memory accesses that increment DTR0 are not idempotent either.
+bool idempotent(uint8_t address, uint8_t data);
+
+// How often a frame that failed with one ErrorCode is tried again.
+struct RetryPolicy {
+  // Tries including the first one, 1 disables retries.
+  uint8_t attempts = 1;
+  // Wait before the first retry, doubled for every further one.
+  uint32_t backoff_us = 0;
+  // Also retry commands with a reply. Without a reply a query usually means
+  // "no", retrying it only makes scans slower.
+  bool queries = false;
+};
+
+// Retry policy per ErrorCode with jittered exponential backoff and a total
+// deadline per command.
+//
+// By default BUS_BUSY and I2C_ERROR are retried, TIMEOUT only for commands
+// without a reply. BUS_ERROR (no bus power, short) and FRAME_ERROR (more than
+// one gear answered) are answers of the bus, not glitches.
+class RetryPolicies {
+public:
+  static constexpr uint32_t DEFAULT_DEADLINE_MS = 500;
+
+  RetryPolicies();
+
+  void set(ErrorCode err, const RetryPolicy &policy) {
+    this->policies_[static_cast<ErrorCode::code_t>(err)] = policy;
+  }
+  const RetryPolicy &get(ErrorCode err) const {
+    return this->policies_[static_cast<ErrorCode::code_t>(err)];
+  }
+  // Time from the first failure after which no retry is started.
+  void set_deadline_ms(uint32_t deadline_ms) {
+    this->deadline_ms_ = deadline_ms;
+  }
+  uint32_t get_deadline_ms() const { return this->deadline_ms_; }
+
+  // Whether try `attempt` (1 is the first retry) of a frame that failed with
+  // `err` is allowed.
+  bool allows(ErrorCode err, size_t reply_length, uint8_t attempt) const;
+  // Wait before try `attempt`, between half and one and a half of the
+  // doubled backoff.
+  uint32_t backoff_us(ErrorCode err, uint8_t attempt);
+
+protected:
+  std::array<RetryPolicy, BusMetrics::ERROR_CODES> policies_{};
+  uint32_t deadline_ms_ = DEFAULT_DEADLINE_MS;
+  // xorshift32 state for the jitter.
+  uint32_t seed_ = 0x2545f491;
+};
+
+struct RetryStats {
+  // Frames sent again.
+  uint32_t retries = 0;
+  // Commands that succeeded after a retry.
+  uint32_t recovered = 0;
+  // Commands that still failed after retrying. Many recovered commands point
+  // at a flaky line, failed ones at dead gear or a dead bus.
+  uint32_t failed = 0;
+};
+
+// Decorates a bus with the retry policies. Idempotent frames are sent again
+// until they succeed, the policy of their last error gives up or the deadline
+// passed. Other frames are passed through unchanged.
+class RetryBus : public BusInterface {
+public:
+  explicit RetryBus(BusInterface *bus) : bus_(bus) {}
+
+  ErrorCode DaliCommand(uint8_t address, uint8_t data, uint8_t *reply,
+                        size_t reply_length,
+                        uint32_t timeout_ms = 150) override;
+  void delay_microseconds(uint32_t us) override {
+    this->bus_->delay_microseconds(us);
+  }
+  uint32_t now_ms() override { return this->bus_->now_ms(); }
+
+  RetryPolicies &policies() { return this->policies_; }
+  const RetryStats &stats() const { return this->stats_; }
+
+protected:
+  BusInterface *bus_;
+  RetryPolicies policies_;
+  RetryStats stats_;
+};
+
+} // namespace libdali
@@ -0,0 +1,38 @@
+#pragma once
+#include "dali.h"
+#include <array>
+
+namespace libdali {
+
+// Scene levels the gear of a bus should store, DA_MASK for gear that is not
+// part of the scene. Only scenes with at least one level are managed, the
+// others are left as stored in the gear.
+class SceneTable {
+public:
+  static constexpr uint8_t SCENES = 16;
+  static constexpr uint8_t SHORT_ADDRESSES = 64;
+
+  SceneTable() {
+    for (auto &levels : this->levels_) {
+      levels.fill(DA_MASK);
+    }
+  }
+
+  void set_level(uint8_t scene, uint8_t short_address, uint8_t level) {
+    scene &= SCENES - 1;
+    this->levels_[scene][short_address & (SHORT_ADDRESSES - 1)] = level;
+    this->managed_ |= 1 << scene;
+  }
+  uint8_t level(uint8_t scene, uint8_t short_address) const {
+    return this->levels_[scene & (SCENES - 1)]
+                        [short_address & (SHORT_ADDRESSES - 1)];
+  }
+  // Bit n for scene n.
+  uint16_t managed() const { return this->managed_; }
+
+protected:
+  std::array<std::array<uint8_t, SHORT_ADDRESSES>, SCENES> levels_;
+  uint16_t managed_ = 0;
+};
+
+} // namespace libdali
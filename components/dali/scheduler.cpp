@@ -0,0 +1,45 @@
+#include "scheduler.h"
+
+namespace libdali {
+
+bool Scheduler::add(SchedulerJob *job, Priority priority) {
+  if (this->count_ >= MAX_JOBS) {
+    return false;
+  }
+  // Insert behind the jobs of the same priority.
+  size_t i = this->count_++;
+  while (i > 0 && this->jobs_[i - 1].priority > priority) {
+    this->jobs_[i] = this->jobs_[i - 1];
+    i--;
+  }
+  this->jobs_[i] = Entry{.job = job, .priority = priority};
+  return true;
+}
+
+SchedulerJob *Scheduler::owner() const {
+  for (size_t i = 0; i < this->count_; i++) {
+    if (this->jobs_[i].job->busy()) {
+      return this->jobs_[i].job;
+    }
+  }
+  return nullptr;
+}
+
+bool Scheduler::step_() {
+  if (auto *owner = this->owner()) {
+    // The owner does not start a new sequence, jobs of a higher priority
+    // may have work waiting by the time this one completes.
+    return owner->run(false);
+  }
+  for (size_t i = 0; i < this->count_; i++) {
+    auto *job = this->jobs_[i].job;
+    // A job that started a sequence owns the bus, even if it reports no
+    // progress because the first frame waits.
+    if (job->run(true) || job->busy()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace libdali
@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace libdali {
+
+// Priority classes of the Scheduler, highest first.
+enum class Priority : uint8_t {
+  // Levels and scenes a user asked for.
+  USER,
+  // Configuration written to the gear.
+  CONFIG,
+  // Background polling and inventory queries.
+  POLL,
+};
+
+// Work the Scheduler runs, e.g. a sender of queued levels or the status
+// poller. A job sends sequences of frames with LW14Adapter::submit() and
+// poll() and never blocks.
+class SchedulerJob {
+public:
+  virtual ~SchedulerJob() = default;
+  // A sequence was started and not completed. Until it completes no other
+  // job starts one, e.g. a DTR0 and the command using it stay together.
+  virtual bool busy() const = 0;
+  // Advance the job. With `start` it may start a new sequence once the
+  // current one completed, without only the current one is continued.
+  // Returns true if it got anywhere, false if it waits for the bus or has
+  // nothing to do.
+  virtual bool run(bool start) = 0;
+};
+
+// Runs the jobs of a bus cooperatively from a loop, in slices of a time
+// budget.
+//
+// A job in the middle of a sequence owns the bus and is the only one run
+// until the sequence completes. Otherwise the jobs get the chance to start a
+// sequence in the order of their priority, the first one that starts takes
+// the bus. Within a priority class the jobs run in the order they were added.
+class Scheduler {
+public:
+  static constexpr size_t MAX_JOBS = 4;
+  static constexpr uint32_t DEFAULT_BUDGET_US = 4000;
+
+  // Returns false if MAX_JOBS are added already.
+  bool add(SchedulerJob *job, Priority priority);
+  // Time a slice may take. A step of a job is not interrupted, a slice
+  // overshoots by at most the step that crossed the budget.
+  void set_budget_us(uint32_t budget_us) { this->budget_us_ = budget_us; }
+  uint32_t get_budget_us() const { return this->budget_us_; }
+
+  // Run the jobs until all of them wait or the budget is used up.
+  // `now_us()` returns a microsecond clock, it may wrap around.
+  template <typename Clock> void run(Clock now_us) {
+    auto start_us = now_us();
+    while (this->step_()) {
+      if (now_us() - start_us >= this->budget_us_) {
+        break;
+      }
+    }
+    auto used_us = now_us() - start_us;
+    if (used_us > this->max_slice_us_) {
+      this->max_slice_us_ = used_us;
+    }
+    if (used_us > this->budget_us_) {
+      this->over_budget_++;
+    }
+  }
+
+  // Job that owns the bus, nullptr if none is in a sequence.
+  SchedulerJob *owner() const;
+  // Longest slice and number of slices over budget since start.
+  uint32_t max_slice_us() const { return this->max_slice_us_; }
+  uint32_t over_budget() const { return this->over_budget_; }
+
+protected:
+  struct Entry {
+    SchedulerJob *job;
+    Priority priority;
+  };
+
+  // Run the owner or let the jobs start, false if none got anywhere.
+  bool step_();
+
+  // Sorted by priority.
+  std::array<Entry, MAX_JOBS> jobs_{};
+  size_t count_ = 0;
+  uint32_t budget_us_ = DEFAULT_BUDGET_US;
+  uint32_t max_slice_us_ = 0;
+  uint32_t over_budget_ = 0;
+};
+
+} // namespace libdali
@@ -0,0 +1,176 @@
+#include "search.h"
+
+namespace libdali {
+
+static constexpr uint32_t SEARCH_ADDRESS_MAX = 0xffffff;
+
+Result<RandomAddressSearch::Answer>
+RandomAddressSearch::compare_(uint32_t address) {
+  auto err = SearchAddrs(this->bus_, SearchAddr(address));
+  if (err) {
+    return Result<Answer>(err);
+  }
+  auto compare_result = Compare(this->bus_);
+  if (compare_result) {
+    return Result<Answer>(*compare_result ? Answer::YES : Answer::NO);
+  }
+  if (compare_result.error() == ErrorCode::FRAME_ERROR) {
+    // More than one gear answered at the same time.
+    return Result<Answer>(Answer::MULTIPLE);
+  }
+  return Result<Answer>(compare_result.error());
+}
+
+Result<RandomAddressSearch::Found> RandomAddressSearch::next() {
+  this->begin_next();
+  while (auto address = this->compare_address()) {
+    auto answer = this->compare_(*address);
+    if (!answer) {
+      return Result<Found>(answer.error());
+    }
+    this->answer(*answer);
+  }
+  return this->found();
+}
+
+void RandomAddressSearch::begin_next() {
+  this->start_ = this->compares_;
+  this->multiple_.reset();
+  this->found_.reset();
+  this->begin_round_();
+}
+
+void RandomAddressSearch::begin_round_() {
+  this->round_low_ = this->low_;
+  this->round_high_ = this->high_.value_or(SEARCH_ADDRESS_MAX);
+  this->confirmed_ = false;
+  if (this->high_.has_value()) {
+    this->step_ = Step::BISECT;
+    this->bisect_();
+    return;
+  }
+  // Is there any gear left at all?
+  if (this->low_ > SEARCH_ADDRESS_MAX) {
+    this->finish_(false, 0);
+    return;
+  }
+  this->step_ = Step::PRESENCE;
+  this->compare_address_ = SEARCH_ADDRESS_MAX;
+}
+
+void RandomAddressSearch::bisect_() {
+  if (this->round_low_ < this->round_high_) {
+    this->compare_address_ =
+        this->round_low_ + (this->round_high_ - this->round_low_) / 2;
+    return;
+  }
+  if (!this->confirmed_) {
+    // The upper bound from the previous round was never answered for in
+    // this round, make sure the gear is really there.
+    this->step_ = Step::CONFIRM;
+    this->compare_address_ = this->round_low_;
+    return;
+  }
+  this->finish_(true, this->round_low_);
+}
+
+void RandomAddressSearch::finish_(bool found, uint32_t random_address) {
+  this->step_ = Step::DONE;
+  this->compare_address_.reset();
+  if (found) {
+    this->found_ = random_address;
+  }
+  this->result_ = Found{.found = found, .random_address = random_address,
+                        .compares = this->compares_ - this->start_};
+}
+
+void RandomAddressSearch::answer(Answer answer) {
+  if (!this->compare_address_.has_value()) {
+    return;
+  }
+  this->compares_++;
+  auto address = *this->compare_address_;
+  switch (this->step_) {
+  case Step::PRESENCE:
+    if (answer == Answer::NO) {
+      this->finish_(false, 0);
+      return;
+    }
+    if (answer == Answer::MULTIPLE) {
+      this->multiple_ = SEARCH_ADDRESS_MAX;
+    }
+    this->confirmed_ = true;
+    this->step_ = Step::BISECT;
+    this->bisect_();
+    return;
+  case Step::BISECT:
+    if (answer == Answer::NO) {
+      this->round_low_ = address + 1;
+    } else {
+      this->round_high_ = address;
+      this->confirmed_ = true;
+      if (answer == Answer::MULTIPLE) {
+        this->multiple_ = address;
+      }
+    }
+    this->bisect_();
+    return;
+  case Step::CONFIRM:
+    if (answer == Answer::NO) {
+      // A frame error in the previous round was not a collision.
+      this->low_ = address + 1;
+      this->high_.reset();
+      this->begin_round_();
+      return;
+    }
+    this->finish_(true, address);
+    return;
+  case Step::DONE:
+    return;
+  }
+}
+
+Result<bool> RandomAddressSearch::withdraw() {
+  auto found = this->withdraw_address();
+  if (!found.has_value()) {
+    return Result<bool>(false);
+  }
+  auto err = SearchAddrs(this->bus_, SearchAddr(*found));
+  if (err) {
+    return Result<bool>(err);
+  }
+  err = Withdraw(this->bus_);
+  if (err) {
+    return Result<bool>(err);
+  }
+
+  // Withdrawn gear no longer answers COMPARE.
+  auto answer = this->compare_(*found);
+  if (!answer) {
+    return Result<bool>(answer.error());
+  }
+  return Result<bool>(this->withdrawn(*answer));
+}
+
+bool RandomAddressSearch::withdrawn(Answer answer) {
+  if (!this->found_.has_value()) {
+    return false;
+  }
+  this->compares_++;
+  auto found = *this->found_;
+  if (answer != Answer::NO) {
+    return false;
+  }
+
+  this->low_ = found + 1;
+  // A collision above the withdrawn gear means another gear is still there.
+  if (this->multiple_.has_value() && *this->multiple_ > found) {
+    this->high_ = this->multiple_;
+  } else {
+    this->high_.reset();
+  }
+  this->found_.reset();
+  return true;
+}
+
+} // namespace libdali
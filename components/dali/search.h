@@ -0,0 +1,85 @@
+#pragma once
+#include "dali.h"
+
+namespace libdali {
+
+// Finds the gear in initialisation state one by one, in order of their
+// random address, with COMPARE.
+//
+// Knowledge from earlier rounds is kept: once the gear with the lowest address
+// A is withdrawn, all remaining gear have an address above A, so the next
+// round starts at A + 1 instead of 0. A COMPARE answered by more than one gear
+// (FRAME_ERROR) at Y means that after withdrawing A at least one gear is still
+// at or below Y, which bounds the next round from above as well.
+class RandomAddressSearch {
+public:
+  RandomAddressSearch(BusInterface *bus) : bus_(bus) {}
+
+  struct Found {
+    // False if no gear is left.
+    bool found;
+    uint32_t random_address;
+    // COMPARE frames sent to find it.
+    uint32_t compares;
+  };
+  enum class Answer : uint8_t { NO, YES, MULTIPLE };
+
+  // Finds the remaining gear with the lowest random address.
+  Result<Found> next();
+  // Withdraws the gear found last from further searches and verifies that it
+  // no longer answers COMPARE. Leaves the search address at its address.
+  Result<bool> withdraw();
+  // COMPARE frames sent so far.
+  uint32_t compares() const { return this->compares_; }
+
+  // The steps of next() and withdraw() for callers that send the frames
+  // themselves, e.g. the coroutines of co_dali.h: after begin_next() COMPARE
+  // at compare_address() and pass the answer to answer() until it returns
+  // std::nullopt, then found() is the outcome. To withdraw the gear at
+  // withdraw_address(), WITHDRAW at it and pass the answer of the COMPARE
+  // there to withdrawn().
+  void begin_next();
+  std::optional<uint32_t> compare_address() const {
+    return this->compare_address_;
+  }
+  void answer(Answer answer);
+  Found found() const { return this->result_; }
+  std::optional<uint32_t> withdraw_address() const { return this->found_; }
+  bool withdrawn(Answer answer);
+
+protected:
+  enum class Step : uint8_t {
+    PRESENCE, // Any gear left, COMPARE at the highest address.
+    BISECT,   // Binary search for the lowest address a gear answers for.
+    CONFIRM,  // The upper bound of the previous round still answers.
+    DONE,
+  };
+  Result<Answer> compare_(uint32_t address);
+  // Start a round from the bounds learned so far.
+  void begin_round_();
+  // Pick the next address of the round, or finish it.
+  void bisect_();
+  void finish_(bool found, uint32_t random_address);
+
+  BusInterface *bus_;
+  // All remaining gear have a random address >= low_.
+  uint32_t low_ = 0;
+  // A remaining gear is known to have an address <= high_, if set.
+  std::optional<uint32_t> high_;
+  // Lowest address more than one gear answered COMPARE for in this round.
+  std::optional<uint32_t> multiple_;
+  std::optional<uint32_t> found_;
+  uint32_t compares_ = 0;
+
+  // State of the search of next().
+  Step step_ = Step::DONE;
+  uint32_t round_low_ = 0, round_high_ = 0;
+  // True once a gear answered for round_high_ in this round.
+  bool confirmed_ = false;
+  std::optional<uint32_t> compare_address_;
+  // COMPARE frames sent before begin_next().
+  uint32_t start_ = 0;
+  Found result_{};
+};
+
+} // namespace libdali
@@ -0,0 +1,87 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import sensor
+from esphome.const import (
+    CONF_TYPE,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_MILLISECOND,
+)
+from . import Bus, dali_ns
+
+BusSensor = dali_ns.class_("BusSensor", sensor.Sensor, cg.PollingComponent)
+BusSensorType = dali_ns.enum("BusSensorType", is_class=True)
+CommandClass = cg.global_ns.namespace("libdali").enum(
+    "CommandClass", is_class=True
+)
+
+DEPENDENCIES = ["dali"]
+CONF_BUS = "bus"
+CONF_COMMAND_CLASS = "command_class"
+COUNTERS = {
+    "commands": BusSensorType.COMMANDS,
+    "timeouts": BusSensorType.TIMEOUTS,
+    "frame_errors": BusSensorType.FRAME_ERRORS,
+    "bus_busy": BusSensorType.BUS_BUSY,
+    "bus_errors": BusSensorType.BUS_ERRORS,
+    "i2c_errors": BusSensorType.I2C_ERRORS,
+    "busy_waits": BusSensorType.BUSY_WAITS,
+    "i2c_transactions": BusSensorType.I2C_TRANSACTIONS,
+    "retries": BusSensorType.RETRIES,
+    "retries_recovered": BusSensorType.RETRIES_RECOVERED,
+    "retries_failed": BusSensorType.RETRIES_FAILED,
+}
+LATENCIES = {
+    "latency_average": BusSensorType.LATENCY_AVERAGE,
+    "latency_max": BusSensorType.LATENCY_MAX,
+}
+COMMAND_CLASSES = {
+    "control": CommandClass.CONTROL,
+    "query": CommandClass.QUERY,
+    "special": CommandClass.SPECIAL,
+}
+BASE_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_BUS): cv.use_id(Bus),
+    }
+).extend(cv.polling_component_schema("60s"))
+
+CONFIG_SCHEMA = cv.typed_schema(
+    {
+        **{
+            key: sensor.sensor_schema(
+                BusSensor,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+            ).extend(BASE_SCHEMA)
+            for key in COUNTERS
+        },
+        **{
+            key: sensor.sensor_schema(
+                BusSensor,
+                unit_of_measurement=UNIT_MILLISECOND,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
+            )
+            .extend(BASE_SCHEMA)
+            .extend(
+                {
+                    cv.Optional(CONF_COMMAND_CLASS, default="control"): cv.enum(
+                        COMMAND_CLASSES, lower=True
+                    ),
+                }
+            )
+            for key in LATENCIES
+        },
+    },
+    lower=True,
+)
+
+async def to_code(config):
+    var = await sensor.new_sensor(config)
+    await cg.register_component(var, config)
+    bus = await cg.get_variable(config[CONF_BUS])
+    cg.add(var.set_bus(bus))
+    cg.add(var.set_type({**COUNTERS, **LATENCIES}[config[CONF_TYPE]]))
+    if CONF_COMMAND_CLASS in config:
+        cg.add(var.set_command_class(config[CONF_COMMAND_CLASS]))
@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace libdali {
+
+// Fixed-size ring buffer for one producer and one consumer, which may run on
+// different threads or in an interrupt and the main loop. Neither side locks
+// or allocates: the producer only writes head_, the consumer only tail_.
+template <typename T, size_t N> class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+public:
+  static constexpr size_t capacity() { return N; }
+
+  // Producer side. Returns false if the ring is full, the value is dropped.
+  bool push(const T &value) {
+    auto head = this->head_.load(std::memory_order_relaxed);
+    if (head - this->tail_.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    this->slots_[head % N] = value;
+    // Publish the slot before the consumer can see the new head.
+    this->head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T &value) {
+    auto tail = this->tail_.load(std::memory_order_relaxed);
+    if (tail == this->head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = this->slots_[tail % N];
+    // Hand the slot back to the producer only after it was read.
+    this->tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Snapshot, exact only on the producer or consumer thread.
+  size_t size() const {
+    return this->head_.load(std::memory_order_acquire) -
+           this->tail_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return this->size() == 0; }
+
+protected:
+  std::array<T, N> slots_{};
+  // Free running indices, N divides 2^32 so they wrap around correctly. Kept
+  // on separate cache lines so the two sides do not invalidate each other.
+  alignas(64) std::atomic<uint32_t> head_{0};
+  alignas(64) std::atomic<uint32_t> tail_{0};
+};
+
+} // namespace libdali
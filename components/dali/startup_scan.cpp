@@ -0,0 +1,388 @@
+#include "startup_scan.h"
+
+namespace libdali {
+
+// The IDENTITY frames read GTIN and identification number, each after DTR1
+// and DTR0, then query the gear. Indexes of the first READ MEMORY LOCATION of
+// both and of the first query.
+static constexpr uint8_t GTIN_SIZE = 6, ID_SIZE = 8;
+static constexpr uint8_t GTIN_FIRST_READ = 2;
+static constexpr uint8_t ID_FIRST_READ = GTIN_FIRST_READ + GTIN_SIZE + 2;
+static constexpr uint8_t IDENTITY_QUERIES = ID_FIRST_READ + ID_SIZE;
+
+void StartupScan::start(
+    const std::bitset<Inventory::SHORT_ADDRESSES> &short_addresses) {
+  this->short_addresses_ = short_addresses;
+  this->stage_ = Stage::CHECK;
+  this->gear_ = 0;
+  // Start with a fresh sequence even if poll() was not called until done.
+  this->next_ = 0;
+  this->handle_.reset();
+  if (!this->prepare_()) {
+    this->advance_();
+  }
+}
+
+void StartupScan::add_(uint8_t address, uint8_t data, uint8_t reply_length,
+                       bool follows) {
+  this->frames_[this->count_++] = Frame{.address = address,
+                                        .data = data,
+                                        .reply_length = reply_length,
+                                        .follows = follows};
+}
+
+bool StartupScan::prepare_() {
+  this->count_ = 0;
+  this->next_ = 0;
+  this->answered_.reset();
+  if (!this->short_addresses_.test(this->gear_)) {
+    return false;
+  }
+  const auto &entry = this->inventory_->gear(this->gear_);
+  auto command = Address::from_short_address(this->gear_).command();
+
+  switch (this->stage_) {
+  case Stage::CHECK:
+    if (!entry.present) {
+      return false;
+    }
+    // Only the checked gear increments its DTR0, the others keep the
+    // location. Senders that write DTR0 or DTR1 in between invalidate the
+    // shadow registers.
+    if (this->bus_->shadow.dtr1 != 0 ||
+        this->bus_->shadow.dtr0 != Inventory::SPOT_CHECK_LOCATION) {
+      this->add_(DA_DTR1, 0, 0);
+      this->add_(DA_DTR0, Inventory::SPOT_CHECK_LOCATION, 0, true);
+    }
+    this->add_(command, DA_READ_MEMORY_LOCATION, 1, this->count_ > 0);
+    this->bus_->shadow.invalidate();
+    this->bus_->shadow.dtr1 = 0;
+    this->bus_->shadow.dtr0 = Inventory::SPOT_CHECK_LOCATION;
+    return true;
+  case Stage::IDENTITY:
+    if (entry.present) {
+      return false;
+    }
+    // Two short sequences instead of one over the whole identity, other
+    // senders go in between.
+    this->add_(DA_DTR1, MemoryBank0GTIN.bank, 0);
+    this->add_(DA_DTR0, MemoryBank0GTIN.location, 0, true);
+    for (size_t i = 0; i < GTIN_SIZE; i++) {
+      this->add_(command, DA_READ_MEMORY_LOCATION, 1, true);
+    }
+    this->add_(DA_DTR1, MemoryBank0GearIdentificationNumber.bank, 0);
+    this->add_(DA_DTR0, MemoryBank0GearIdentificationNumber.location, 0, true);
+    for (size_t i = 0; i < ID_SIZE; i++) {
+      this->add_(command, DA_READ_MEMORY_LOCATION, 1, true);
+    }
+    this->add_(command, QueryGearType.command, 1);
+    this->add_(command, QueryPossibleOperatingModes.command, 1);
+    this->add_(command, QueryDimmingCurve.command, 1);
+    break;
+  case Stage::CURVE:
+    if (!entry.present || entry.dimming_curve == DIMMING_CURVE) {
+      return false;
+    }
+    this->add_(DA_DTR0, DIMMING_CURVE, 0);
+    this->add_(command, SelectDimmingCurve.command, 0, true);
+    break;
+  case Stage::GROUPS:
+    if (!entry.present || this->managed_groups_ == 0) {
+      return false;
+    }
+    this->add_(command, QueryGroupsL.command, 1);
+    this->add_(command, QueryGroupsH.command, 1);
+    break;
+  case Stage::GROUPS_UPDATE: {
+    if (!this->current_groups_.has_value()) {
+      return false;
+    }
+    const auto &groups = this->groups_[this->gear_];
+    auto differs = (*this->current_groups_ ^ groups) & this->managed_groups_;
+    if (differs == 0) {
+      return false;
+    }
+    for (uint8_t group = 0; group < 16; group++) {
+      if (!(differs & (1 << group))) {
+        continue;
+      }
+      // Configuration command, sent twice.
+      uint8_t data = ((groups & (1 << group)) ? DA_ADD_TO_GROUP
+                                               : DA_REMOVE_FROM_GROUP) |
+                     group;
+      this->add_(command, data, 0);
+      this->add_(command, data, 0, true);
+    }
+    break;
+  }
+  case Stage::SCENES: {
+    auto queried = this->queried_scenes_();
+    if (!entry.present || queried == 0) {
+      return false;
+    }
+    for (uint8_t scene = 0; scene < SceneTable::SCENES; scene++) {
+      if (queried & (1 << scene)) {
+        this->add_(command, DA_QUERY_SCENE_LEVEL | scene, 1);
+      }
+    }
+    break;
+  }
+  case Stage::SCENES_UPDATE:
+    this->scenes_updated_ = 0;
+    for (uint8_t scene = 0; scene < SceneTable::SCENES; scene++) {
+      if (!(this->scenes_known_ & (1 << scene))) {
+        continue;
+      }
+      auto level = this->scenes_->level(scene, this->gear_);
+      if (level == this->current_scenes_[scene]) {
+        continue;
+      }
+      this->scenes_updated_ |= 1 << scene;
+      // Configuration commands, sent twice.
+      if (level == DA_MASK) {
+        this->add_(command, DA_REMOVE_FROM_SCENE | scene, 0);
+        this->add_(command, DA_REMOVE_FROM_SCENE | scene, 0, true);
+      } else {
+        this->add_(DA_DTR0, level, 0);
+        this->add_(command, DA_STORE_DTR_AS_SCENE | scene, 0, true);
+        this->add_(command, DA_STORE_DTR_AS_SCENE | scene, 0, true);
+      }
+    }
+    if (this->count_ == 0) {
+      return false;
+    }
+    break;
+  case Stage::STATE:
+    if (!entry.present) {
+      return false;
+    }
+    this->add_(command, QueryActualLevel.command, 1);
+    this->add_(command, QueryStatus.command, 1);
+    break;
+  case Stage::DONE:
+    return false;
+  }
+  // The frames bypass the register cache.
+  this->bus_->shadow.invalidate();
+  return true;
+}
+
+uint16_t StartupScan::queried_scenes_() const {
+  if (this->updates_ > 0) {
+    return this->scenes_updated_;
+  }
+  return this->scenes_ ? this->scenes_->managed() : 0;
+}
+
+void StartupScan::advance_() {
+  do {
+    switch (this->stage_) {
+    case Stage::CHECK:
+      if (++this->gear_ == Inventory::SHORT_ADDRESSES) {
+        this->stage_ = Stage::IDENTITY;
+        this->gear_ = 0;
+      }
+      break;
+    case Stage::IDENTITY:
+      this->stage_ = Stage::CURVE;
+      break;
+    case Stage::CURVE:
+      this->stage_ = Stage::GROUPS;
+      this->current_groups_.reset();
+      this->updates_ = 0;
+      break;
+    case Stage::GROUPS:
+      if (this->updates_ < MAX_UPDATES) {
+        this->stage_ = Stage::GROUPS_UPDATE;
+        break;
+      }
+      this->stage_ = Stage::SCENES;
+      this->scenes_known_ = 0;
+      this->updates_ = 0;
+      break;
+    case Stage::GROUPS_UPDATE:
+      if (this->count_ > 0) {
+        // Confirm the update, a repeat may have come too late.
+        this->updates_++;
+        this->stage_ = Stage::GROUPS;
+        this->current_groups_.reset();
+        break;
+      }
+      this->stage_ = Stage::SCENES;
+      this->scenes_known_ = 0;
+      this->updates_ = 0;
+      break;
+    case Stage::SCENES:
+      this->stage_ = this->updates_ < MAX_UPDATES ? Stage::SCENES_UPDATE
+                                                  : Stage::STATE;
+      break;
+    case Stage::SCENES_UPDATE:
+      if (this->count_ > 0) {
+        this->updates_++;
+        this->stage_ = Stage::SCENES;
+        this->scenes_known_ = 0;
+        break;
+      }
+      this->stage_ = Stage::STATE;
+      break;
+    case Stage::STATE:
+      this->stage_ = Stage::IDENTITY;
+      if (++this->gear_ == Inventory::SHORT_ADDRESSES) {
+        this->stage_ = Stage::DONE;
+      }
+      break;
+    case Stage::DONE:
+      return;
+    }
+  } while (this->stage_ != Stage::DONE && !this->prepare_());
+}
+
+std::optional<ScanResult> StartupScan::finish_() {
+  auto reply = [this](size_t i) -> std::optional<uint8_t> {
+    if (!this->answered_.test(i)) {
+      return std::nullopt;
+    }
+    return this->replies_[i];
+  };
+
+  switch (this->stage_) {
+  case Stage::CHECK:
+    for (uint8_t i = 0; i + 1 < this->count_; i++) {
+      if (!this->answered_.test(i)) {
+        // DTR0 or DTR1 may not hold the location.
+        this->bus_->shadow.invalidate();
+      }
+    }
+    this->inventory_->check(this->gear_, reply(this->count_ - 1));
+    break;
+  case Stage::IDENTITY: {
+    InventoryEntry entry;
+    if (!this->answered_.test(GTIN_FIRST_READ)) {
+      this->inventory_->update(this->gear_, entry);
+      return ScanResult{.short_address = this->gear_,
+                        .present = false,
+                        .level = 0,
+                        .status = 0};
+    }
+    auto complete = [this](size_t first, size_t size) {
+      for (size_t i = 0; i < size; i++) {
+        if (!this->answered_.test(first + i)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    if (complete(GTIN_FIRST_READ, GTIN_SIZE)) {
+      entry.gtin = static_cast<uint64_t>(
+          MemoryUInt64<GTIN_SIZE>(&this->replies_[GTIN_FIRST_READ]));
+    }
+    if (complete(ID_FIRST_READ, ID_SIZE)) {
+      entry.identification_number = static_cast<uint64_t>(
+          MemoryUInt64<ID_SIZE>(&this->replies_[ID_FIRST_READ]));
+    }
+    entry.gear_type = reply(IDENTITY_QUERIES).value_or(0);
+    entry.operating_modes = reply(IDENTITY_QUERIES + 1).value_or(0);
+    entry.dimming_curve = reply(IDENTITY_QUERIES + 2).value_or(0);
+    entry.present = true;
+    this->inventory_->update(this->gear_, entry);
+    break;
+  }
+  case Stage::CURVE:
+    if (this->answered_.test(0) && this->answered_.test(1)) {
+      this->inventory_->set_dimming_curve(this->gear_, DIMMING_CURVE);
+    }
+    break;
+  case Stage::GROUPS:
+    if (this->answered_.test(0) && this->answered_.test(1)) {
+      this->current_groups_ = this->replies_[1] << 8 | this->replies_[0];
+    }
+    break;
+  case Stage::GROUPS_UPDATE:
+    break;
+  case Stage::SCENES: {
+    auto queried = this->queried_scenes_();
+    size_t i = 0;
+    for (uint8_t scene = 0; scene < SceneTable::SCENES; scene++) {
+      if (!(queried & (1 << scene))) {
+        continue;
+      }
+      if (this->answered_.test(i)) {
+        this->current_scenes_[scene] = this->replies_[i];
+        this->scenes_known_ |= 1 << scene;
+      }
+      i++;
+    }
+    break;
+  }
+  case Stage::SCENES_UPDATE:
+    break;
+  case Stage::STATE: {
+    auto level = reply(0);
+    if (!level.has_value()) {
+      this->inventory_->check(this->gear_, std::nullopt);
+      return ScanResult{.short_address = this->gear_,
+                        .present = false,
+                        .level = 0,
+                        .status = 0};
+    }
+    this->inventory_->set_level(this->gear_, *level);
+    return ScanResult{.short_address = this->gear_,
+                      .present = true,
+                      .level = *level,
+                      .status = reply(1).value_or(0)};
+  }
+  case Stage::DONE:
+    break;
+  }
+  return std::nullopt;
+}
+
+std::optional<ScanResult> StartupScan::poll(bool yield) {
+  while (this->stage_ != Stage::DONE) {
+    if (this->handle_.has_value()) {
+      auto index = this->next_ - 1;
+      auto result = this->bus_->poll(*this->handle_, &this->replies_[index]);
+      if (!result.has_value()) {
+        return std::nullopt;
+      }
+      this->handle_.reset();
+      this->answered_[index] = !*result;
+      if (this->stage_ == Stage::IDENTITY && index == GTIN_FIRST_READ &&
+          *result) {
+        // No gear, skip the rest of its frames.
+        this->next_ = this->count_;
+      }
+    }
+
+    if (this->next_ < this->count_) {
+      if (yield && !this->frames_[this->next_].follows) {
+        return std::nullopt;
+      }
+      if (this->next_ == 0 && this->stage_ == Stage::CHECK &&
+          (this->bus_->shadow.dtr1 != 0 ||
+           this->bus_->shadow.dtr0 != Inventory::SPOT_CHECK_LOCATION)) {
+        // Another sender wrote DTR0 or DTR1 since prepare_().
+        this->prepare_();
+      }
+      const auto &frame = this->frames_[this->next_];
+      auto handle =
+          this->bus_->submit(frame.address, frame.data, frame.reply_length);
+      if (!handle) {
+        // Queue full, retry on the next poll.
+        return std::nullopt;
+      }
+      this->handle_ = *handle;
+      this->next_++;
+      continue;
+    }
+
+    auto result = this->finish_();
+    this->advance_();
+    if (result.has_value()) {
+      return result;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace libdali
@@ -0,0 +1,129 @@
+#pragma once
+#include "inventory.h"
+#include "lw14.h"
+#include "scenes.h"
+
+namespace libdali {
+
+// State of one gear found by the StartupScan.
+struct ScanResult {
+  uint8_t short_address;
+  // False if the gear did not answer.
+  bool present;
+  uint8_t level;
+  // QUERY STATUS reply, see QueryStatusResponse.
+  uint8_t status;
+};
+
+// Collects level and status of a set of gear after start, one frame at a time
+// with LW14Adapter::submit() and poll(), so the caller never blocks.
+//
+// Known gear of the inventory is checked first with one READ MEMORY LOCATION
+// each. Per gear in order of the short address the scan then queries the
+// identity of gear that is new or was replaced, selects the dimming curve if
+// it differs, adds it to or removes it from the groups set up with
+// add_group_member() where its membership differs, stores the scene levels of
+// set_scenes() that differ and queries the level and status.
+//
+// Groups and scene levels are queried again after an update, a configuration
+// command that was not repeated in time is sent again up to MAX_UPDATES times.
+//
+// Frames that depend on the ones before, DTR0 and DTR1 with the commands
+// using them and configuration commands sent twice, form a sequence that is
+// not interleaved with frames of other senders, see poll() and busy().
+class StartupScan {
+public:
+  // Dimming curve selected for all gear, 0 is the standard logarithmic one.
+  static constexpr uint8_t DIMMING_CURVE = 0;
+  // Updates of the groups and of the scene levels per gear, each followed by
+  // a query to confirm it.
+  static constexpr uint8_t MAX_UPDATES = 2;
+
+  StartupScan(LW14Adapter *bus, Inventory *inventory)
+      : bus_(bus), inventory_(inventory) {}
+
+  // The gear is a member of the group, gear not added is removed from it.
+  // Groups without members are left alone.
+  void add_group_member(uint8_t group, uint8_t short_address) {
+    this->managed_groups_ |= 1 << (group & 15);
+    this->groups_[short_address] |= 1 << (group & 15);
+  }
+
+  // Scene levels to store in the gear, the table has to outlive the scan.
+  void set_scenes(const SceneTable *scenes) { this->scenes_ = scenes; }
+
+  void start(const std::bitset<Inventory::SHORT_ADDRESSES> &short_addresses);
+  // Advance without blocking. Returns the result of a gear once it was
+  // scanned completely. `yield` holds back the next sequence while the
+  // caller has frames of its own to send.
+  std::optional<ScanResult> poll(bool yield = false);
+  bool done() const { return this->stage_ == Stage::DONE; }
+  // A sequence was started and its next frame has to follow it.
+  bool busy() const {
+    return this->stage_ != Stage::DONE && this->next_ > 0 &&
+           this->next_ < this->count_ && this->frames_[this->next_].follows;
+  }
+  // Microseconds until poll() can make progress again.
+  uint32_t poll_delay_us() { return this->bus_->poll_delay_us(); }
+
+protected:
+  enum class Stage : uint8_t {
+    CHECK,    // Spot check of the identity of known gear.
+    IDENTITY, // Query the identity of new gear.
+    CURVE,    // Select the dimming curve.
+    GROUPS,   // Query the group membership.
+    GROUPS_UPDATE, // Add to and remove from groups.
+    SCENES,   // Query the scene levels.
+    SCENES_UPDATE, // Store the scene levels.
+    STATE,    // Query level and status.
+    DONE,
+  };
+  struct Frame {
+    uint8_t address, data, reply_length;
+    // Depends on the frame before, no other sender goes in between.
+    bool follows;
+  };
+  // DTR0 and STORE DTR AS SCENE twice for all scenes, more than the DTR1,
+  // DTR0, bank 0 identity and three queries of IDENTITY.
+  static constexpr size_t MAX_FRAMES = 3 * SceneTable::SCENES;
+
+  // Prepare the frames of the current stage and gear, false if the stage has
+  // nothing to do for the gear.
+  bool prepare_();
+  // Evaluate the replies to the frames of the current stage and gear.
+  std::optional<ScanResult> finish_();
+  // Move on to the next stage with frames to send.
+  void advance_();
+  // Scenes the SCENES stage queries, after an update only the scenes written.
+  uint16_t queried_scenes_() const;
+  void add_(uint8_t address, uint8_t data, uint8_t reply_length,
+            bool follows = false);
+
+  LW14Adapter *bus_;
+  Inventory *inventory_;
+  std::bitset<Inventory::SHORT_ADDRESSES> short_addresses_;
+  Stage stage_ = Stage::DONE;
+  uint8_t gear_ = 0;
+  uint16_t managed_groups_ = 0;
+  std::array<uint16_t, Inventory::SHORT_ADDRESSES> groups_{};
+  // Membership of the current gear, if GROUPS got an answer.
+  std::optional<uint16_t> current_groups_;
+  const SceneTable *scenes_ = nullptr;
+  // Scene levels of the current gear, for the scenes in scenes_known_.
+  std::array<uint8_t, SceneTable::SCENES> current_scenes_{};
+  uint16_t scenes_known_ = 0;
+  // Scenes written by the last SCENES_UPDATE, queried again to confirm.
+  uint16_t scenes_updated_ = 0;
+  // Updates of the groups or scene levels of the current gear so far.
+  uint8_t updates_ = 0;
+
+  std::array<Frame, MAX_FRAMES> frames_{};
+  std::array<uint8_t, MAX_FRAMES> replies_{};
+  std::bitset<MAX_FRAMES> answered_;
+  uint8_t count_ = 0;
+  // Next frame to submit.
+  uint8_t next_ = 0;
+  std::optional<CommandHandle> handle_;
+};
+
+} // namespace libdali
@@ -0,0 +1,164 @@
+#include "status_poller.h"
+#include <algorithm>
+
+namespace libdali {
+
+void StatusPoller::start(
+    const std::bitset<Inventory::SHORT_ADDRESSES> &short_addresses) {
+  this->short_addresses_ = short_addresses;
+  auto now_ms = this->bus_->now_ms();
+  this->last_ms_ = now_ms;
+  for (auto &gear : this->gear_) {
+    gear.interval_ms = this->min_interval_ms_;
+    gear.due_ms = now_ms + this->min_interval_ms_;
+  }
+}
+
+void StatusPoller::set_state(const ScanResult &state) {
+  auto &gear = this->gear_[state.short_address];
+  gear.known = true;
+  gear.present = state.present;
+  gear.status = state.status;
+}
+
+void StatusPoller::discard(uint8_t short_address) {
+  if (this->current_ == short_address) {
+    this->discarded_ = true;
+  }
+}
+
+void StatusPoller::expedite(uint8_t short_address) {
+  this->discard(short_address);
+  auto &gear = this->gear_[short_address % Inventory::SHORT_ADDRESSES];
+  gear.interval_ms = this->min_interval_ms_;
+  gear.due_ms = this->bus_->now_ms();
+}
+
+void StatusPoller::schedule_(Gear &gear, uint32_t now_ms, bool changed) {
+  bool fault = !gear.present || QueryStatusResponse(gear.status).LampFailure;
+  if (changed || fault) {
+    gear.interval_ms = this->min_interval_ms_;
+  } else {
+    gear.interval_ms =
+        std::min(gear.interval_ms * 2, std::max(this->max_interval_ms_,
+                                                this->min_interval_ms_));
+  }
+  gear.due_ms = now_ms + gear.interval_ms;
+}
+
+std::optional<uint8_t> StatusPoller::next_due_(uint32_t now_ms) const {
+  for (size_t i = 0; i < Inventory::SHORT_ADDRESSES; i++) {
+    uint8_t short_address = (this->cursor_ + i) % Inventory::SHORT_ADDRESSES;
+    // Wrap-around safe comparison of the transport milliseconds.
+    if (this->short_addresses_.test(short_address) &&
+        static_cast<int32_t>(now_ms - this->gear_[short_address].due_ms) >= 0) {
+      return short_address;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<ScanResult> StatusPoller::finish_(uint32_t now_ms) {
+  auto short_address = *this->current_;
+  auto &gear = this->gear_[short_address];
+  this->current_.reset();
+
+  ErrorCode::code_t level = this->results_[0];
+  bool failed = level == ErrorCode::OK ? bool(this->results_[1])
+                                        : level != ErrorCode::TIMEOUT;
+  if (this->discarded_ || failed) {
+    // Try again soon.
+    this->schedule_(gear, now_ms, true);
+    return std::nullopt;
+  }
+
+  ScanResult state{.short_address = short_address,
+                   .present = level == ErrorCode::OK,
+                   .level = this->replies_[0],
+                   .status = this->replies_[1]};
+  if (!state.present) {
+    state.level = 0;
+    state.status = 0;
+  }
+  if (state.present && QueryStatusResponse(state.status).FadeReady) {
+    // The level is not final while a fade is running.
+    this->schedule_(gear, now_ms, true);
+    return std::nullopt;
+  }
+  bool changed = !gear.known || state.present != gear.present ||
+                 (state.present &&
+                  (state.status != gear.status ||
+                   state.level != this->inventory_->gear(short_address).level));
+  gear.known = true;
+  gear.present = state.present;
+  gear.status = state.status;
+  this->schedule_(gear, now_ms, changed);
+  if (!changed) {
+    return std::nullopt;
+  }
+  if (state.present) {
+    this->inventory_->set_level(short_address, state.level);
+  }
+  return state;
+}
+
+std::optional<ScanResult> StatusPoller::poll(bool yield) {
+  auto now_ms = this->bus_->now_ms();
+  auto elapsed_ms = now_ms - this->last_ms_;
+  this->last_ms_ = now_ms;
+  // Credit is capped to one poll, idle time does not add up to a burst.
+  this->credit_us_ = static_cast<uint32_t>(std::min<uint64_t>(
+      this->credit_us_ + uint64_t{elapsed_ms} * 10 * this->share_percent_,
+      POLL_BUS_TIME_US));
+
+  if (this->handle_.has_value()) {
+    auto index = this->next_ - 1;
+    auto result = this->bus_->poll(*this->handle_, &this->replies_[index]);
+    if (!result.has_value()) {
+      return std::nullopt;
+    }
+    this->handle_.reset();
+    this->results_[index] = *result;
+    if (index == 0 && *result) {
+      // No level, no status.
+      this->next_ = 2;
+    }
+  }
+
+  if (!this->current_.has_value()) {
+    if (yield || this->share_percent_ == 0 ||
+        this->credit_us_ < POLL_BUS_TIME_US) {
+      return std::nullopt;
+    }
+    auto next = this->next_due_(now_ms);
+    if (!next.has_value()) {
+      return std::nullopt;
+    }
+    this->credit_us_ -= POLL_BUS_TIME_US;
+    this->cursor_ = (*next + 1) % Inventory::SHORT_ADDRESSES;
+    this->current_ = next;
+    this->discarded_ = false;
+    this->results_ = {};
+    this->next_ = 0;
+  }
+
+  if (this->next_ < 2) {
+    if (yield) {
+      return std::nullopt;
+    }
+    auto command = Address::from_short_address(*this->current_).command();
+    auto data =
+        this->next_ == 0 ? QueryActualLevel.command : QueryStatus.command;
+    auto handle = this->bus_->submit(command, data, 1);
+    if (!handle) {
+      // Queue full, retry on the next poll.
+      return std::nullopt;
+    }
+    this->handle_ = *handle;
+    this->next_++;
+    return std::nullopt;
+  }
+  return this->finish_(now_ms);
+}
+
+} // namespace libdali
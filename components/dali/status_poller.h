@@ -0,0 +1,97 @@
+#pragma once
+#include "inventory.h"
+#include "lw14.h"
+#include "startup_scan.h"
+
+namespace libdali {
+
+// Polls level and status of a set of gear in the background, round-robin
+// with LW14Adapter::submit() and poll(), to notice changes made on the line
+// itself like wall switches, lamp failures and power-cycled gear.
+//
+// The poller only uses a share of the bus time and starts no query while the
+// caller has commands waiting. Gear that changed or reports a fault is polled
+// again after the minimum interval, the interval of stable gear doubles up to
+// the maximum.
+class StatusPoller {
+public:
+  static constexpr uint8_t DEFAULT_SHARE_PERCENT = 10;
+  static constexpr uint32_t DEFAULT_MIN_INTERVAL_MS = 5000;
+  static constexpr uint32_t DEFAULT_MAX_INTERVAL_MS = 300000;
+  // Bus time of one poll: QUERY ACTUAL LEVEL and QUERY STATUS, each a forward
+  // frame, the settling time and the backward frame.
+  static constexpr uint32_t POLL_BUS_TIME_US = 2 * dali_te_us(38 + 22 + 22);
+
+  StatusPoller(LW14Adapter *bus, Inventory *inventory)
+      : bus_(bus), inventory_(inventory) {}
+
+  // Share of the bus time used for polling, 0 disables the poller.
+  void set_share_percent(uint8_t percent) { this->share_percent_ = percent; }
+  uint8_t get_share_percent() const { return this->share_percent_; }
+  void set_interval_ms(uint32_t min_ms, uint32_t max_ms) {
+    this->min_interval_ms_ = min_ms;
+    this->max_interval_ms_ = max_ms;
+  }
+
+  // Poll the gear, the first time after the minimum interval.
+  void start(const std::bitset<Inventory::SHORT_ADDRESSES> &short_addresses);
+  // Known state of the gear, e.g. from the StartupScan. Changes are reported
+  // relative to it.
+  void set_state(const ScanResult &state);
+  // A command changed the gear, a poll in progress reads an outdated state.
+  void discard(uint8_t short_address);
+  // The gear changed on the line to a level that is not known, e.g. by a
+  // relative command of another master. Poll it next.
+  void expedite(uint8_t short_address);
+  // Advance without blocking. `yield` holds back new queries while the
+  // caller has commands of its own, also the second query of a gear.
+  // Returns the state of a gear that changed.
+  std::optional<ScanResult> poll(bool yield);
+  // A query is in flight. The queries of a gear are no sequence, commands in
+  // between discard() the replies if they change the gear.
+  bool busy() const { return this->handle_.has_value(); }
+  // Current interval of the gear.
+  uint32_t interval_ms(uint8_t short_address) const {
+    return this->gear_[short_address].interval_ms;
+  }
+
+protected:
+  struct Gear {
+    uint32_t due_ms = 0;
+    uint32_t interval_ms = 0;
+    // Set once the state was reported or polled.
+    bool known = false;
+    bool present = false;
+    uint8_t status = 0;
+  };
+
+  // Gear to poll next, round-robin among the gear that is due.
+  std::optional<uint8_t> next_due_(uint32_t now_ms) const;
+  // Evaluate the replies of the current gear.
+  std::optional<ScanResult> finish_(uint32_t now_ms);
+  void schedule_(Gear &gear, uint32_t now_ms, bool changed);
+
+  LW14Adapter *bus_;
+  Inventory *inventory_;
+  std::bitset<Inventory::SHORT_ADDRESSES> short_addresses_;
+  std::array<Gear, Inventory::SHORT_ADDRESSES> gear_{};
+  uint8_t share_percent_ = DEFAULT_SHARE_PERCENT;
+  uint32_t min_interval_ms_ = DEFAULT_MIN_INTERVAL_MS;
+  uint32_t max_interval_ms_ = DEFAULT_MAX_INTERVAL_MS;
+
+  // Bus time the poller may use, in microseconds.
+  uint32_t credit_us_ = POLL_BUS_TIME_US;
+  uint32_t last_ms_ = 0;
+  uint8_t cursor_ = 0;
+
+  // Gear being polled.
+  std::optional<uint8_t> current_;
+  bool discarded_ = false;
+  // Replies of QUERY ACTUAL LEVEL and QUERY STATUS.
+  std::array<uint8_t, 2> replies_{};
+  std::array<ErrorCode, 2> results_{};
+  uint8_t next_ = 0;
+  std::optional<CommandHandle> handle_;
+};
+
+} // namespace libdali
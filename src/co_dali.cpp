@@ -0,0 +1,234 @@
+#include "co_dali.h"
+
+namespace libdali {
+namespace co {
+
+// Like libdali::WriteShadowed().
+static Task<ErrorCode> write_shadowed(CoBus &bus, std::optional<uint8_t> &reg,
+                                      uint8_t address, uint8_t value) {
+  if (bus.shadow().enabled && reg == value) {
+    co_return ErrorCode::OK;
+  }
+  auto err = co_await bus.command(address, value);
+  if (err) {
+    bus.shadow().invalidate();
+  } else {
+    reg = value;
+  }
+  co_return err;
+}
+
+Task<ErrorCode> DataTransferRegister(CoBus &bus, uint8_t value) {
+  co_return co_await write_shadowed(bus, bus.shadow().dtr0, DA_DTR0, value);
+}
+
+Task<ErrorCode> DataTransferRegister1(CoBus &bus, uint8_t value) {
+  co_return co_await write_shadowed(bus, bus.shadow().dtr1, DA_DTR1, value);
+}
+
+Task<ErrorCode> SearchAddrs(CoBus &bus, uint32_t search_address) {
+  SearchAddr address(search_address);
+  auto &shadow = bus.shadow();
+  auto err = co_await write_shadowed(bus, shadow.search_h, 0xb1, address.h());
+  if (!err) {
+    err = co_await write_shadowed(bus, shadow.search_m, 0xb3, address.m());
+  }
+  if (!err) {
+    err = co_await write_shadowed(bus, shadow.search_l, 0xb5, address.l());
+  }
+  co_return err;
+}
+
+Task<ErrorCode> StoreDTRAsShortAddress(CoBus &bus, Address address) {
+  auto err = co_await bus.command(address.command(), 0x80);
+  if (err) {
+    co_return err;
+  }
+  co_return co_await bus.command(address.command(), 0x80);
+}
+
+Task<ErrorCode> DTR0Command(CoBus &bus, libdali::DTR0Command command,
+                            Address address, uint8_t dtr0) {
+  auto lock = co_await bus.sequence();
+  auto err = co_await DataTransferRegister(bus, dtr0);
+  if (err) {
+    co_return err;
+  }
+  co_return co_await bus.command(address.command(), command.command);
+}
+
+Task<ErrorCode> DTR0ConfigCommand(CoBus &bus,
+                                  libdali::DTR0ConfigCommand command,
+                                  Address address, uint8_t dtr0) {
+  auto lock = co_await bus.sequence();
+  auto err = co_await DataTransferRegister(bus, dtr0);
+  if (err) {
+    co_return err;
+  }
+  err = co_await bus.command(address.command(), command.command);
+  if (err) {
+    co_return err;
+  }
+  co_return co_await bus.command(address.command(), command.command);
+}
+
+// SEARCHADDR and COMPARE, see RandomAddressSearch::compare_().
+static Task<Result<RandomAddressSearch::Answer>> compare(CoBus &bus,
+                                                        uint32_t address) {
+  using Answer = RandomAddressSearch::Answer;
+  auto err = co_await SearchAddrs(bus, address);
+  if (err) {
+    co_return Result<Answer>(err);
+  }
+  uint8_t reply = 0;
+  err = co_await bus.command(0xa9, 0, &reply, 1);
+  if (err == ErrorCode::TIMEOUT) {
+    co_return Result<Answer>(Answer::NO);
+  }
+  if (err == ErrorCode::FRAME_ERROR) {
+    // More than one gear answered at the same time.
+    co_return Result<Answer>(Answer::MULTIPLE);
+  }
+  if (err) {
+    co_return Result<Answer>(err);
+  }
+  co_return Result<Answer>(reply == 0xff ? Answer::YES : Answer::NO);
+}
+
+Task<Result<RandomAddressSearch::Found>> SearchNext(
+    CoBus &bus, RandomAddressSearch &search) {
+  using Found = RandomAddressSearch::Found;
+  search.begin_next();
+  while (auto address = search.compare_address()) {
+    auto answer = co_await compare(bus, *address);
+    if (!answer) {
+      co_return Result<Found>(answer.error());
+    }
+    search.answer(*answer);
+  }
+  co_return Result<Found>(search.found());
+}
+
+Task<Result<bool>> SearchWithdraw(CoBus &bus, RandomAddressSearch &search) {
+  auto found = search.withdraw_address();
+  if (!found.has_value()) {
+    co_return Result<bool>(false);
+  }
+  auto err = co_await SearchAddrs(bus, *found);
+  if (!err) {
+    err = co_await bus.command(0xab, 0x00);
+  }
+  if (err) {
+    co_return Result<bool>(err);
+  }
+  // Withdrawn gear no longer answers COMPARE.
+  auto answer = co_await compare(bus, *found);
+  if (!answer) {
+    co_return Result<bool>(answer.error());
+  }
+  co_return Result<bool>(search.withdrawn(*answer));
+}
+
+// Sends the special command twice, 1ms apart, like Initialise() and
+// Randomise().
+static Task<ErrorCode> twice(CoBus &bus, uint8_t address, uint8_t data) {
+  auto err = co_await bus.command(address, data);
+  if (err) {
+    co_return err;
+  }
+  co_await bus.delay_ms(1);
+  co_return co_await bus.command(address, data);
+}
+
+// Finds the next gear and gives it the first short address not used. False
+// once no gear is left.
+static Task<Result<bool>>
+address_next(CoBus &bus, RandomAddressSearch &search,
+             std::bitset<Inventory::SHORT_ADDRESSES> &used, uint8_t &added) {
+  auto found = co_await SearchNext(bus, search);
+  if (!found) {
+    co_return Result<bool>(found.error());
+  }
+  if (!found->found) {
+    co_return Result<bool>(false);
+  }
+  // Exclude the gear from further COMPARE in this initialisation.
+  auto withdrawn = co_await SearchWithdraw(bus, search);
+  if (!withdrawn) {
+    co_return Result<bool>(withdrawn.error());
+  }
+  if (!*withdrawn) {
+    // The search would find the same gear again.
+    co_return Result<bool>(ErrorCode(ErrorCode::FRAME_ERROR));
+  }
+  uint8_t short_address = 0;
+  while (short_address < Inventory::SHORT_ADDRESSES &&
+         used.test(short_address)) {
+    short_address++;
+  }
+  if (short_address == Inventory::SHORT_ADDRESSES) {
+    // No short address left, the gear stays unaddressed.
+    co_return Result<bool>(true);
+  }
+
+  auto err = co_await SearchAddrs(bus, found->random_address);
+  auto address = Address::from_short_address(short_address);
+  if (!err) {
+    err = co_await bus.command(0xb7, address.command());
+  }
+  uint8_t reply = 0;
+  if (!err) {
+    err = co_await bus.command(0xb9, address.command(), &reply, 1);
+  }
+  if (err == ErrorCode::TIMEOUT || (!err && reply != 0xff)) {
+    // Not verified, the gear stays unaddressed.
+    co_return Result<bool>(true);
+  }
+  if (err) {
+    co_return Result<bool>(err);
+  }
+  used.set(short_address);
+  added++;
+  co_return Result<bool>(true);
+}
+
+Task<Result<uint8_t>>
+AddressNewGear(CoBus &bus, std::bitset<Inventory::SHORT_ADDRESSES> used) {
+  auto lock = co_await bus.sequence();
+  // Only send DTR and SEARCHADDR frames that change the gear registers.
+  RegisterCacheScope cache(bus.adapter());
+
+  // Terminate other potentially running initialise, then let the gear
+  // without short address enter initialisation and pick a random address.
+  auto err = co_await bus.command(0xa1, 0x00);
+  if (!err) {
+    bus.shadow().invalidate_search();
+    err = co_await twice(bus, 0xa5, static_cast<uint8_t>(InitialiseMode::NEW));
+  }
+  if (!err) {
+    err = co_await twice(bus, 0xa7, 0x00);
+  }
+  if (err) {
+    co_return Result<uint8_t>(err);
+  }
+  // Give gears 100ms time to find their random address.
+  co_await bus.delay_ms(100);
+
+  RandomAddressSearch search(bus.adapter());
+  uint8_t added = 0;
+  while (true) {
+    auto next = co_await address_next(bus, search, used, added);
+    if (!next || !*next) {
+      err = next.error();
+      break;
+    }
+  }
+  auto terminate_err = co_await bus.command(0xa1, 0x00);
+  if (err || terminate_err) {
+    co_return Result<uint8_t>(err ? err : terminate_err);
+  }
+  co_return Result<uint8_t>(added);
+}
+
+} // namespace co
+} // namespace libdali
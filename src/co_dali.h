@@ -0,0 +1,72 @@
+#pragma once
+#include "coroutine.h"
+#include "inventory.h"
+#include "search.h"
+
+namespace libdali {
+
+// Coroutine versions of the multi-frame commands of dali.h for a CoBus. They
+// send the same frames as their blocking counterparts. Those that write DTR0,
+// DTR1 or the search address hold the sequence lock of the bus while they
+// run, the single steps below them do not and are meant for use inside a
+// sequence the caller holds.
+namespace co {
+
+// Command 257: DATA TRANSFER REGISTER (DTR)
+Task<ErrorCode> DataTransferRegister(CoBus &bus, uint8_t value);
+// Command 273: DATA TRANSFER REGISTER 1 (DTR1)
+Task<ErrorCode> DataTransferRegister1(CoBus &bus, uint8_t value);
+// Command 264-266: Sets the 24bit search addr.
+Task<ErrorCode> SearchAddrs(CoBus &bus, uint32_t search_address);
+// Command 128: STORE DTR AS SHORT ADDRESS, sent twice.
+Task<ErrorCode> StoreDTRAsShortAddress(CoBus &bus, Address address);
+
+// DTR0 and the command, e.g. co::DTR0Command(bus, SelectDimmingCurve, ...).
+Task<ErrorCode> DTR0Command(CoBus &bus, libdali::DTR0Command command,
+                            Address address, uint8_t dtr0);
+// DTR0 and the configuration command twice, e.g. SetExtendedFadeTime.
+Task<ErrorCode> DTR0ConfigCommand(CoBus &bus,
+                                  libdali::DTR0ConfigCommand command,
+                                  Address address, uint8_t dtr0);
+
+// A value of a memory bank, e.g. co::ReadMemory(bus, MemoryBank0GTIN, ...).
+template <typename T>
+Task<Result<T>> ReadMemory(CoBus &bus, libdali::ReadMemory<T> read,
+                           Address address) {
+  auto lock = co_await bus.sequence();
+  auto err = co_await DataTransferRegister1(bus, read.bank);
+  if (!err) {
+    err = co_await DataTransferRegister(bus, read.location);
+  }
+  if (err) {
+    co_return Result<T>(err);
+  }
+  // READ MEMORY LOCATION increments DTR0 of the addressed gear only.
+  bus.shadow().dtr0.reset();
+  uint8_t data[T::Size];
+  for (size_t i = 0; i < T::Size; i++) {
+    err = co_await bus.command(address.command(), DA_READ_MEMORY_LOCATION,
+                               &data[i], 1);
+    if (err) {
+      co_return Result<T>(err);
+    }
+  }
+  co_return Result<T>(T(data));
+}
+
+// RandomAddressSearch::next() and withdraw(). The gear have to be in
+// initialisation state, see AddressNewGear().
+Task<Result<RandomAddressSearch::Found>> SearchNext(
+    CoBus &bus, RandomAddressSearch &search);
+Task<Result<bool>> SearchWithdraw(CoBus &bus, RandomAddressSearch &search);
+
+// Gives the gear without short address the short addresses not `used` yet,
+// like an incremental Commissioning run with the used addresses known, e.g.
+// from the Inventory. Returns the number of gear addressed. Holds the
+// sequence lock for the whole run, frames of other transactions that do not
+// touch DTR or search addresses go in between.
+Task<Result<uint8_t>>
+AddressNewGear(CoBus &bus, std::bitset<Inventory::SHORT_ADDRESSES> used);
+
+} // namespace co
+} // namespace libdali
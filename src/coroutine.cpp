@@ -0,0 +1,187 @@
+#include "coroutine.h"
+#include <limits>
+
+namespace libdali {
+
+alignas(std::max_align_t) uint8_t
+    FramePool::blocks_[FramePool::BLOCKS][FramePool::BLOCK_SIZE];
+bool FramePool::used_[FramePool::BLOCKS];
+uint32_t FramePool::allocations_ = 0, FramePool::heap_allocations_ = 0;
+
+void *FramePool::allocate(size_t size) {
+  allocations_++;
+  if (size <= BLOCK_SIZE) {
+    for (size_t i = 0; i < BLOCKS; i++) {
+      if (!used_[i]) {
+        used_[i] = true;
+        return blocks_[i];
+      }
+    }
+  }
+  heap_allocations_++;
+  return ::operator new(size);
+}
+
+void FramePool::deallocate(void *frame) {
+  auto p = reinterpret_cast<uintptr_t>(frame);
+  auto first = reinterpret_cast<uintptr_t>(&blocks_[0][0]);
+  if (p >= first && p < first + sizeof(blocks_)) {
+    used_[(p - first) / BLOCK_SIZE] = false;
+    return;
+  }
+  ::operator delete(frame);
+}
+
+SequenceLock::~SequenceLock() {
+  if (this->bus_ != nullptr) {
+    // A waiting transaction takes it in the next poll().
+    this->bus_->locked_ = false;
+  }
+}
+
+void CoBus::queue_(Waiter *waiter) {
+  waiter->queued = true;
+  waiter->next = nullptr;
+  *this->tail_ = waiter;
+  this->tail_ = &waiter->next;
+  if (waiter->kind == Waiter::Kind::SEQUENCE) {
+    this->sequence_waiters_++;
+  }
+}
+
+void CoBus::cancel_(Waiter *waiter) {
+  for (Waiter **link = &this->head_; *link != nullptr;
+       link = &(*link)->next) {
+    if (*link != waiter) {
+      continue;
+    }
+    *link = waiter->next;
+    if (*link == nullptr) {
+      this->tail_ = link;
+    }
+    break;
+  }
+  waiter->queued = false;
+  if (waiter->kind == Waiter::Kind::SEQUENCE) {
+    this->sequence_waiters_--;
+  }
+}
+
+void CoBus::orphan_(std::optional<CommandHandle> command) {
+  if (!command.has_value()) {
+    return;
+  }
+  for (auto &orphan : this->orphans_) {
+    if (!orphan.has_value()) {
+      orphan = command;
+      break;
+    }
+  }
+}
+
+bool CoBus::ready_(Waiter *waiter) {
+  switch (waiter->kind) {
+  case Waiter::Kind::FRAME: {
+    auto *frame = static_cast<Frame *>(waiter);
+    if (!frame->command.has_value()) {
+      auto command = this->bus_->submit(frame->address, frame->data,
+                                        frame->reply_length,
+                                        frame->timeout_ms);
+      if (!command) {
+        // Adapter queue full, submitted once a slot is free.
+        return false;
+      }
+      frame->command = *command;
+      this->submitted_ = true;
+    }
+    auto result = this->bus_->collect(*frame->command, frame->reply);
+    if (!result.has_value()) {
+      return false;
+    }
+    frame->result = *result;
+    return true;
+  }
+  case Waiter::Kind::DELAY: {
+    auto *delay = static_cast<Delay *>(waiter);
+    return this->bus_->now_ms() - delay->since_ms >= delay->ms;
+  }
+  case Waiter::Kind::SEQUENCE:
+    if (this->locked_) {
+      return false;
+    }
+    this->locked_ = true;
+    this->sequence_waiters_--;
+    return true;
+  }
+  return false;
+}
+
+bool CoBus::poll() {
+  bool again;
+  do {
+    // One status read or write per pass, however many frames wait.
+    this->bus_->poll();
+    for (auto &orphan : this->orphans_) {
+      if (orphan.has_value() && this->bus_->collect(*orphan, nullptr)) {
+        orphan.reset();
+      }
+    }
+    this->submitted_ = false;
+    bool resumed = false;
+    Waiter **link = &this->head_;
+    while (*link != nullptr) {
+      auto *waiter = *link;
+      if (!this->ready_(waiter)) {
+        link = &waiter->next;
+        continue;
+      }
+      *link = waiter->next;
+      if (*link == nullptr) {
+        this->tail_ = link;
+      }
+      waiter->queued = false;
+      waiter->handle.resume();
+      resumed = true;
+      // The transaction may have queued new waiters or destroyed others,
+      // start over.
+      link = &this->head_;
+    }
+    // New frames are sent right away.
+    again = resumed || this->submitted_;
+  } while (again);
+  return this->head_ != nullptr;
+}
+
+uint32_t CoBus::poll_delay_us() {
+  auto wait = std::numeric_limits<uint32_t>::max();
+  bool frames = false;
+  for (const auto &orphan : this->orphans_) {
+    frames |= orphan.has_value();
+  }
+  for (auto *waiter = this->head_; waiter != nullptr; waiter = waiter->next) {
+    switch (waiter->kind) {
+    case Waiter::Kind::FRAME:
+      frames = true;
+      break;
+    case Waiter::Kind::DELAY: {
+      auto *delay = static_cast<Delay *>(waiter);
+      auto elapsed = this->bus_->now_ms() - delay->since_ms;
+      auto left_us = elapsed >= delay->ms ? 0 : (delay->ms - elapsed) * 1000;
+      wait = left_us < wait ? left_us : wait;
+      break;
+    }
+    case Waiter::Kind::SEQUENCE:
+      if (!this->locked_) {
+        return 0;
+      }
+      break;
+    }
+  }
+  if (frames) {
+    auto bus_wait = this->bus_->poll_delay_us();
+    wait = bus_wait < wait ? bus_wait : wait;
+  }
+  return wait == std::numeric_limits<uint32_t>::max() ? 0 : wait;
+}
+
+} // namespace libdali
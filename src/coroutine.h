@@ -0,0 +1,277 @@
+#pragma once
+// DALI transactions as C++20 coroutines on top of LW14Adapter::submit() and
+// poll(). A transaction suspends at every frame and resumes when the bus
+// delivered its result, so a single-threaded loop can drive several of them
+// at once:
+//
+//   CoBus bus(&adapter);
+//   auto level = co::ReadMemory(bus, MemoryBank0GTIN, address);
+//   level.start();
+//   while (!level.done()) {
+//     bus.poll();
+//   }
+//
+// The commands live in co_dali.h. Parameters are copied into the coroutine,
+// captures of a coroutine lambda are not, so transactions are functions.
+// Lives with the host tools in src/, esphome builds every source of the
+// component and older ESP toolchains need -fcoroutines.
+#include "lw14.h"
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace libdali {
+
+// Fixed blocks for the frames of Task coroutines, so the transactions of a
+// long-running node do not fragment the heap. Frames larger than a block or
+// beyond the blocks in use come from the heap. Not thread-safe, all tasks
+// run on one loop.
+class FramePool {
+public:
+  static constexpr size_t BLOCKS = 8;
+  static constexpr size_t BLOCK_SIZE = 384;
+
+  static void *allocate(size_t size);
+  static void deallocate(void *frame);
+  // Frames allocated since start, and how many of them came from the heap.
+  static uint32_t allocations() { return allocations_; }
+  static uint32_t heap_allocations() { return heap_allocations_; }
+
+protected:
+  alignas(std::max_align_t) static uint8_t blocks_[BLOCKS][BLOCK_SIZE];
+  static bool used_[BLOCKS];
+  static uint32_t allocations_, heap_allocations_;
+};
+
+// Coroutine returning T. It starts suspended and runs when awaited by another
+// Task, or with start() as the outermost task of a CoBus.
+template <typename T> class [[nodiscard]] Task {
+public:
+  struct promise_type {
+    // T may be a Result, which has no default value.
+    std::optional<T> value;
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct Final {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+          auto next = h.promise().continuation;
+          return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+      };
+      return Final{};
+    }
+    void return_value(T v) { this->value.emplace(std::move(v)); }
+    // Builds for the ESP run without exceptions.
+    void unhandled_exception() { std::terminate(); }
+    static void *operator new(size_t size) {
+      return FramePool::allocate(size);
+    }
+    static void operator delete(void *frame) {
+      FramePool::deallocate(frame);
+    }
+  };
+
+  Task(Task &&o) noexcept : handle_(std::exchange(o.handle_, {})) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (this->handle_) {
+      this->handle_.destroy();
+    }
+  }
+
+  // Run the task until it waits for the first time.
+  void start() {
+    if (!this->started_) {
+      this->started_ = true;
+      this->handle_.resume();
+    }
+  }
+  bool done() const { return this->handle_.done(); }
+  // The returned value, once done().
+  T &result() { return *this->handle_.promise().value; }
+
+  // Awaiting a task runs it, the awaiting coroutine resumes when it is done.
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    this->started_ = true;
+    this->handle_.promise().continuation = awaiting;
+    return this->handle_;
+  }
+  T await_resume() { return std::move(*this->handle_.promise().value); }
+
+protected:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+  bool started_ = false;
+};
+
+class CoBus;
+
+// Held by the transaction that got CoBus::sequence(), released when
+// destroyed.
+class SequenceLock {
+public:
+  explicit SequenceLock(CoBus *bus) : bus_(bus) {}
+  SequenceLock(SequenceLock &&o) noexcept
+      : bus_(std::exchange(o.bus_, nullptr)) {}
+  SequenceLock(const SequenceLock &) = delete;
+  SequenceLock &operator=(const SequenceLock &) = delete;
+  ~SequenceLock();
+
+protected:
+  CoBus *bus_;
+};
+
+// Drives the transactions on an LW14Adapter: the awaitables below queue
+// themselves in the CoBus without allocating, poll() submits their frames
+// and resumes the transactions whose frame completed.
+//
+// Frames of different transactions may interleave. Sequences that rely on
+// state the gear share, like DTR0 followed by the command using it, hold the
+// sequence() lock, which only one transaction gets at a time.
+class CoBus {
+public:
+  explicit CoBus(LW14Adapter *bus) : bus_(bus) {}
+  CoBus(const CoBus &) = delete;
+  CoBus &operator=(const CoBus &) = delete;
+
+  // Something a transaction waits for.
+  struct Waiter {
+    enum class Kind : uint8_t { FRAME, DELAY, SEQUENCE };
+
+    Waiter(CoBus *bus, Kind kind) : bus(bus), kind(kind) {}
+    Waiter(const Waiter &) = delete;
+    Waiter &operator=(const Waiter &) = delete;
+    // A transaction destroyed while it waits leaves the queue. Frame hands
+    // its command to the orphans first.
+    ~Waiter() {
+      if (this->queued) {
+        this->bus->cancel_(this);
+      }
+    }
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+      this->handle = h;
+      this->bus->queue_(this);
+    }
+
+    CoBus *bus;
+    Kind kind;
+    bool queued = false;
+    Waiter *next = nullptr;
+    std::coroutine_handle<> handle;
+  };
+
+  // co_await bus.command(...) sends a frame like DaliCommand() and returns
+  // its ErrorCode, the reply is written to `reply`.
+  struct Frame : Waiter {
+    Frame(CoBus *bus, uint8_t address, uint8_t data, uint8_t *reply,
+          size_t reply_length, uint32_t timeout_ms)
+        : Waiter(bus, Kind::FRAME), address(address), data(data),
+          reply(reply), reply_length(reply_length), timeout_ms(timeout_ms) {}
+    ~Frame() {
+      if (this->queued) {
+        this->bus->cancel_(this);
+        this->bus->orphan_(this->command);
+      }
+    }
+    ErrorCode await_resume() const { return this->result; }
+
+    uint8_t address, data;
+    uint8_t *reply;
+    size_t reply_length;
+    uint32_t timeout_ms;
+    std::optional<CommandHandle> command;
+    ErrorCode result;
+  };
+  struct Delay : Waiter {
+    Delay(CoBus *bus, uint32_t since_ms, uint32_t ms)
+        : Waiter(bus, Kind::DELAY), since_ms(since_ms), ms(ms) {}
+    void await_resume() const {}
+
+    uint32_t since_ms, ms;
+  };
+  struct Sequence : Waiter {
+    explicit Sequence(CoBus *bus) : Waiter(bus, Kind::SEQUENCE) {}
+    // Taken right away if nobody holds or waits for it.
+    bool await_ready() {
+      if (this->bus->locked_ || this->bus->sequence_waiters_ > 0) {
+        return false;
+      }
+      this->bus->locked_ = true;
+      return true;
+    }
+    SequenceLock await_resume() { return SequenceLock(this->bus); }
+  };
+
+  Frame command(uint8_t address, uint8_t data, uint8_t *reply = nullptr,
+                size_t reply_length = 0, uint32_t timeout_ms = 150) {
+    return Frame(this, address, data, reply, reply_length, timeout_ms);
+  }
+  // Resume after `ms` transport milliseconds, the bus stays free meanwhile.
+  Delay delay_ms(uint32_t ms) {
+    return Delay(this, this->bus_->now_ms(), ms);
+  }
+  // Exclusive use of the gear registers until the returned lock is gone.
+  // Not recursive, a transaction holding it must not await it again.
+  Sequence sequence() { return Sequence(this); }
+
+  // Submit the waiting frames and resume the transactions whose frame,
+  // delay or lock is ready. Returns true while transactions wait.
+  bool poll();
+  // Microseconds until poll() can make progress again.
+  uint32_t poll_delay_us();
+  // Start the task and poll until it is done, sleeping with the transport.
+  template <typename T> T &run(Task<T> &task) {
+    task.start();
+    while (!task.done()) {
+      this->poll();
+      if (!task.done()) {
+        if (auto wait = this->poll_delay_us()) {
+          this->bus_->delay_microseconds(wait);
+        }
+      }
+    }
+    return task.result();
+  }
+
+  LW14Adapter *adapter() const { return this->bus_; }
+  ShadowRegisters &shadow() { return this->bus_->shadow; }
+  bool locked() const { return this->locked_; }
+
+protected:
+  friend class SequenceLock;
+
+  void queue_(Waiter *waiter);
+  // Remove a waiter of a destroyed transaction.
+  void cancel_(Waiter *waiter);
+  // Keep polling the command of a destroyed frame until it completes.
+  void orphan_(std::optional<CommandHandle> command);
+  // True if the waiter is done and can be resumed.
+  bool ready_(Waiter *waiter);
+
+  LW14Adapter *bus_;
+  // Waiters in the order they were queued.
+  Waiter *head_ = nullptr;
+  Waiter **tail_ = &this->head_;
+  bool locked_ = false;
+  uint32_t sequence_waiters_ = 0;
+  // A frame was submitted in this pass of poll().
+  bool submitted_ = false;
+  // Frames of destroyed transactions still in the adapter queue, polled
+  // until they complete to free their slot.
+  std::array<std::optional<CommandHandle>, LW14Adapter::QUEUE_SIZE> orphans_;
+};
+
+} // namespace libdali
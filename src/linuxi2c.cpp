@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <iostream>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 #include <string_view>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -34,68 +35,103 @@ std::optional<LinuxI2C *> ConnectLinuxI2C(const char *file, uint8_t address) {
 
   if (ioctl(device, I2C_FUNCS, &funcs) < 0) {
     std::cerr << "ioctl() I2C_FUNCS failed\n";
+    close(device);
     return std::nullopt;
   }
 
-  return std::optional<LinuxI2C *>(new LinuxI2C(device, address));
+  // All transfers go to the same device, select it once.
+  if (ioctl(device, I2C_SLAVE, address) < 0) {
+    std::cerr << "I2C error selecting device: " << __FUNCTION__ << "\n";
+    close(device);
+    return std::nullopt;
+  }
+
+  // Adapters that can't do plain I2C messages, e.g. SMBus only ones, need
+  // separate write and read transfers.
+  bool combined = (funcs & I2C_FUNC_I2C) != 0;
+  return std::optional<LinuxI2C *>(new LinuxI2C(device, address, combined));
 }
 
 LinuxI2C::~LinuxI2C() { close(this->fd_); }
 
 I2CResult LinuxI2C::write_register(uint8_t i2c_register, uint8_t *data,
                                    size_t len) {
-  if (ioctl(this->fd_, I2C_SLAVE, this->address_) >= 0) {
-    std::vector<uint8_t> buf(1);
-    buf[0] = i2c_register;
-    buf.insert(std::next(buf.begin(), 1), data, data + len);
+  if (len > MAX_WRITE_LENGTH) {
+    std::cerr << "I2C error writing " << len << " bytes: " << __FUNCTION__
+              << "\n";
+    return I2CResult::ERROR;
+  }
+  uint8_t buf[1 + MAX_WRITE_LENGTH];
+  buf[0] = i2c_register;
+  for (size_t i = 0; i < len; i++) {
+    buf[1 + i] = data[i];
+  }
 #ifdef DEBUG
-    std::cout << "Write Register len=" << std::dec << len
-              << " size=" << buf.size();
-    println(" {}", buf);
+  std::cout << "Write Register len=" << std::dec << len
+            << " size=" << len + 1;
+  println(" {}", std::vector<uint8_t>(buf, buf + len + 1));
 #endif
-    auto ret = write(this->fd_, buf.data(), buf.size());
-    if (ret != static_cast<int>(buf.size())) {
-      std::cerr << "I2C error writing data: " << ret << " " << __FUNCTION__
-                << "\n";
-      return I2CResult::ERROR;
-    }
-    return I2CResult::OK;
+  auto ret = write(this->fd_, buf, len + 1);
+  if (ret != static_cast<int>(len + 1)) {
+    std::cerr << "I2C error writing data: " << ret << " " << __FUNCTION__
+              << "\n";
+    return I2CResult::ERROR;
   }
-  std::cerr << "I2C error selecting device: " << __FUNCTION__ << "\n";
-  return I2CResult::ERROR;
+  return I2CResult::OK;
 }
 
 I2CResult LinuxI2C::read_register(uint8_t i2c_register, uint8_t *data,
                                   size_t len) {
-  if (ioctl(this->fd_, I2C_SLAVE, this->address_) >= 0) {
-    auto ret = write(this->fd_, &i2c_register, 1);
-    if (ret != 1) {
-      std::cerr << "I2C error selecting read register: "
-                << static_cast<int>(i2c_register) << "\n";
-      return I2CResult::ERROR;
-    }
-
-    usleep(1000);
-
-    ret = read(this->fd_, data, len);
-    if (ret != static_cast<int>(len)) {
-      std::cerr << "I2C error reading from device: " << __FUNCTION__ << "\n";
-      return I2CResult::ERROR;
-    }
+  auto result = this->combined_ ? this->read_combined_(i2c_register, data, len)
+                                : this->read_separate_(i2c_register, data, len);
 #ifdef DEBUG
-    std::vector<uint8_t> buf;
-    buf.insert(buf.begin(), data, data + len);
+  if (result == I2CResult::OK) {
     std::cout << "Read Register " << std::hex << " address=0x"
               << static_cast<int>(this->address_) << " register=0x"
               << static_cast<int>(i2c_register) << " len=" << len;
-    println(" buf: {}", buf);
+    println(" buf: {}", std::vector<uint8_t>(data, data + len));
+  }
 #endif
+  return result;
+}
+
+// Register write and read in one transaction with a repeated start.
+I2CResult LinuxI2C::read_combined_(uint8_t i2c_register, uint8_t *data,
+                                   size_t len) {
+  i2c_msg msgs[2] = {
+      {.addr = this->address_, .flags = 0, .len = 1, .buf = &i2c_register},
+      {.addr = this->address_,
+       .flags = I2C_M_RD,
+       .len = static_cast<uint16_t>(len),
+       .buf = data},
+  };
+  i2c_rdwr_ioctl_data transfer = {.msgs = msgs, .nmsgs = 2};
+  if (ioctl(this->fd_, I2C_RDWR, &transfer) != 2) {
+    std::cerr << "I2C error reading register "
+              << static_cast<int>(i2c_register) << ": " << __FUNCTION__
+              << "\n";
+    return I2CResult::ERROR;
+  }
+  return I2CResult::OK;
+}
+
+I2CResult LinuxI2C::read_separate_(uint8_t i2c_register, uint8_t *data,
+                                   size_t len) {
+  auto ret = write(this->fd_, &i2c_register, 1);
+  if (ret != 1) {
+    std::cerr << "I2C error selecting read register: "
+              << static_cast<int>(i2c_register) << "\n";
+    return I2CResult::ERROR;
+  }
+
+  usleep(1000);
 
-    return I2CResult::OK;
+  ret = read(this->fd_, data, len);
+  if (ret != static_cast<int>(len)) {
+    std::cerr << "I2C error reading from device: " << __FUNCTION__ << "\n";
+    return I2CResult::ERROR;
   }
-  std::cerr << "I2C error selecting device for setting register: "
-            << __FUNCTION__ << "\n";
-  return I2CResult::ERROR;
+  return I2CResult::OK;
 }
 
 void LinuxI2C::delay_microseconds(uint32_t us) { usleep(us); }
@@ -5,7 +5,13 @@ namespace libdali {
 
 class LinuxI2C : public I2CInterface {
 public:
-  LinuxI2C(int fd, uint8_t address) : fd_(fd), address_(address) {};
+  // Longest register write, the LW14 takes two bytes for a DALI frame.
+  static constexpr size_t MAX_WRITE_LENGTH = 8;
+
+  // The slave address has to be selected on `fd` already. With `combined`
+  // register reads are one I2C_RDWR transaction with a repeated start.
+  LinuxI2C(int fd, uint8_t address, bool combined)
+      : fd_(fd), address_(address), combined_(combined) {};
   virtual ~LinuxI2C();
   I2CResult write_register(uint8_t i2c_register, uint8_t *data,
                            size_t len) override;
@@ -13,10 +19,15 @@ public:
                           size_t len) override;
   void delay_microseconds(uint32_t us) override;
   uint32_t millis() override;
+  bool combined() const { return this->combined_; }
 
 private:
+  I2CResult read_combined_(uint8_t i2c_register, uint8_t *data, size_t len);
+  I2CResult read_separate_(uint8_t i2c_register, uint8_t *data, size_t len);
+
   int fd_;
   uint8_t address_;
+  bool combined_;
 };
 
 std::optional<LinuxI2C *> ConnectLinuxI2C(const char *file, uint8_t address);
@@ -1,7 +1,16 @@
 #include "linuxi2c.h"
+#include "commissioning.h"
+#include "i2c_trace.h"
+#include "inventory.h"
+#include "monitor.h"
+#include "retry.h"
+#include <atomic>
 #include <chrono>
+#include <csignal>
 #include <cstdio>
+#include <ctime>
 #include <fcntl.h>
+#include <fstream>
 #include <iostream>
 #include <linux/i2c-dev.h>
 #include <list>
@@ -11,208 +20,179 @@
 
 using namespace libdali;
 
-static int initialise(LW14Adapter *bus);
-static int blink(LW14Adapter *bus, std::list<std::string> &args);
-static int info(LW14Adapter *bus, std::list<std::string> &args);
+static int initialise(RetryBus *bus, std::list<std::string> &args);
+static int blink(BusInterface *bus, std::list<std::string> &args);
+static int info(BusInterface *bus, std::list<std::string> &args);
+static int inventory(BusInterface *bus, std::list<std::string> &args);
+static int stats(LW14Adapter *bus, RetryBus *retry_bus,
+                 std::list<std::string> &args);
+static int monitor(LW14Adapter *bus, std::list<std::string> &args);
+static int run(const std::string &op, LW14Adapter *bus, RetryBus *retry_bus,
+               std::list<std::string> &args);
 
 int main(int argc, char *argv[]) {
   if (argc < 3) {
-    std::cout << argv[0] << " /dev/i2c-... OPERATION\n";
+    std::cout << argv[0] << " /dev/i2c-... [record TRACE] OPERATION\n";
+    std::cout << argv[0] << " replay TRACE OPERATION\n";
+    std::cout << "record writes every I2C transaction to TRACE, replay runs\n";
+    std::cout << "the OPERATION against it at full speed\n";
     std::cout << "OPERATION can be\n";
-    std::cout << "  initialise\n";
+    std::cout << "  initialise [all|new]\n";
+    std::cout << "      all (default) readdresses all gear, new only gear\n";
+    std::cout << "      without short address\n";
     std::cout << "  blink N\n";
     std::cout << "      where N is short address\n";
     std::cout << "  info N\n";
     std::cout << "      where N is short address\n";
+    std::cout << "  inventory [FILE]\n";
+    std::cout << "      list the gear, cached in FILE (dali_inventory.bin)\n";
+    std::cout << "  stats [N]\n";
+    std::cout << "      probe all short addresses N times (1) and print the\n";
+    std::cout << "      bus metrics\n";
+    std::cout << "  monitor [text|binary]\n";
+    std::cout << "      print every frame on the bus until interrupted,\n";
+    std::cout << "      binary writes the records of MonitorFrame::encode()\n";
     return 1;
   }
   std::list<std::string> args(argv + 1, argv + argc);
 
-  auto transport = ConnectLinuxI2C(args.front().c_str(), LW14_DEFAULT_ADDRESS);
-  if (!transport) {
+  I2CInterface *transport;
+  std::optional<ReplayI2C> replay;
+  if (args.front() == "replay") {
+    args.pop_front();
+    std::ifstream in(args.front(), std::ios::binary);
+    replay.emplace(std::vector<uint8_t>(std::istreambuf_iterator<char>(in),
+                                        std::istreambuf_iterator<char>()));
+    if (!replay->valid()) {
+      std::cerr << "no I2C trace in " << args.front() << "\n";
+      return 1;
+    }
+    transport = &*replay;
+  } else if (auto linux_i2c = ConnectLinuxI2C(args.front().c_str(),
+                                              LW14_DEFAULT_ADDRESS)) {
+    transport = *linux_i2c;
+  } else {
     std::cerr << "failed to initialize I2C transport\n";
     return 1;
   }
-
   args.pop_front();
-  auto *bus = new LW14Adapter(*transport);
 
-  auto op = args.front();
-  args.pop_front();
-  if (op == "initialise") {
-    return initialise(bus);
-  } else if (op == "blink") {
-    return blink(bus, args);
-  } else if (op == "info") {
-    return info(bus, args);
-  } else if (op == "off") {
-    Off(bus, Broadcast);
+  std::optional<RecordingI2C> recorder;
+  std::string trace_file;
+  if (args.size() >= 2 && args.front() == "record") {
+    args.pop_front();
+    trace_file = args.front();
+    args.pop_front();
+    transport = &recorder.emplace(transport);
   }
-
-  delete bus;
-}
-
-// Address assignment as found in https://github.com/jorticus/esphome-dali
-static int initialise(LW14Adapter *bus) {
-  // Turn all lights off for Initialise.
-  auto err = Off(bus, Broadcast);
-  if (err) {
-    std::cerr << "Off: " << err << "\n";
+  if (args.empty()) {
+    std::cerr << "no OPERATION\n";
     return 1;
   }
 
-  // Delete all existing short addresses.
-  err = DataTransferRegister(bus, DA_MASK);
-  if (err) {
-    std::cerr << "Load DTR0: " << err << "\n";
-    return 1;
-  }
+  auto *bus = new LW14Adapter(transport);
+  // Glitches of idempotent frames do not abort a whole operation.
+  RetryBus retry_bus(bus);
 
-  err = StoreDTRAsShortAddress(bus, Broadcast);
-  if (err) {
-    std::cerr << "StoreDTRAsShortAddressBroadcast: " << err << "\n";
-    return 1;
+  auto op = args.front();
+  args.pop_front();
+  auto start_cpu = std::clock();
+  int ret = run(op, bus, &retry_bus, args);
+
+  if (recorder.has_value()) {
+    const auto &trace = recorder->trace();
+    std::ofstream out(trace_file, std::ios::binary | std::ios::trunc);
+    if (!out.write(reinterpret_cast<const char *>(trace.data()),
+                   trace.size())) {
+      std::cerr << "Failed to write " << trace_file << "\n";
+      ret = 1;
+    }
   }
-
-  // Terminate other potentially running initialise.
-  err = Terminate(bus);
-  if (err) {
-    std::cerr << "Terminate: " << err << "\n";
-    return 1;
+  if (replay.has_value()) {
+    auto cpu_us = static_cast<uint64_t>(std::clock() - start_cpu) * 1000000 /
+                  CLOCKS_PER_SEC;
+    std::cerr << std::dec << "replayed " << replay->transactions()
+              << " transactions, " << replay->now_us() / 1000
+              << " ms bus time in " << cpu_us << " us CPU time\n";
+    if (replay->diverged()) {
+      std::cerr << "replay diverged at offset " << replay->divergence_offset()
+                << "\n";
+      ret = 1;
+    } else if (!replay->done()) {
+      std::cerr << "trace not replayed completely\n";
+    }
   }
 
-  // Start initialisation, all gear will accept addressing commands for 15min.
-  err = Initialise(bus, InitialiseMode::ALL);
-  if (err) {
-    std::cerr << "Initialise: " << err << "\n";
-    return 1;
-  }
+  delete bus;
+  return ret;
+}
 
-  // Command gears to chose a random address.
-  err = Randomise(bus);
-  if (err) {
-    std::cerr << "Randomise: " << err << "\n";
-    return 1;
+static int run(const std::string &op, LW14Adapter *bus, RetryBus *retry_bus,
+               std::list<std::string> &args) {
+  if (op == "initialise") {
+    return initialise(retry_bus, args);
+  } else if (op == "blink") {
+    return blink(retry_bus, args);
+  } else if (op == "info") {
+    return info(retry_bus, args);
+  } else if (op == "inventory") {
+    return inventory(retry_bus, args);
+  } else if (op == "stats") {
+    return stats(bus, retry_bus, args);
+  } else if (op == "monitor") {
+    return monitor(bus, args);
+  } else if (op == "off") {
+    return Off(retry_bus, Broadcast) ? 1 : 0;
   }
+  std::cerr << "unknown operation " << op << "\n";
+  return 1;
+}
 
-  // Give gears 100ms time to find their random address.
-  bus->delay_microseconds(100000);
-
-  // Start assigning short addresses from 0 on.
-  uint8_t short_address_counter = 0;
-  while (true) {
-    uint32_t addr = 0x000000;
-    // Takes 'addr' for the BRN and starts with bit 2^24 .. 2^0.
-    // Sets the bit and runs Compare.
-    //   If true, there is equipment with smaller address => unset the bit.
-    //   If false (no answer), there is no equipment with smaller address => set
-    //   the bit.
-    for (uint32_t i = 0; i < 24; i++) {
-      uint32_t bit = 1ul << static_cast<uint32_t>(23ul - i);
-      uint32_t search_addr = addr | bit;
-      std::cout << "\rSearching for addr 0b" << std::bitset<24>{search_addr}
-                << "  0x" << std::hex << search_addr << std::flush;
-
-      // True if actual address <= search_address
-      err = SearchAddrs(bus, SearchAddr(search_addr));
-      if (err) {
-        std::cerr << "SearchAddrs: " << err << "\n";
-        return 1;
-      }
-
-      if (auto compare_result = Compare(bus)) {
-        if (*compare_result) {
-          addr &= ~bit; // Clear the bit (already clear)
-        } else {
-          addr |= bit; // Set the bit
-        }
-      } else if (compare_result.error() == ErrorCode::FRAME_ERROR) {
-          // likely means more than one device responded, interpret it as DA_YES.
-          addr &= ~bit; // Clear the bit (already clear)
-      } else {
-        std::cerr << "Compare: " << compare_result.error() << "\n";
-        return 1;
-      }
-    }
-
-    std::cout << "\n";
-
-    // If all bits in BRN-address were set and still no gear is found there
-    // there is no device left.
-    if (addr == 0xFFFFFF) {
-      break;
-    }
-
-    // Need to increment by one to get the actual address
-    addr++;
-    std::cout << "Found address: 0x" << std::hex << addr << "\n";
-
-    // Sanity check: Address should still return true for comparison
-    err = SearchAddrs(bus, SearchAddr(addr));
-    if (err) {
-      std::cerr << "SearchAddrs: " << err << "\n";
-      return 1;
-    }
-    if (auto compare_result = Compare(bus)) {
-      if (!*compare_result) {
-        std::cerr << "Address not matched in sanity check\n";
-        continue;
-      }
-    } else {
-      std::cerr << "Sanity Check Compare: " << compare_result.error() << "\n";
+// Address assignment as found in https://github.com/jorticus/esphome-dali
+static int initialise(RetryBus *bus, std::list<std::string> &args) {
+  auto mode = CommissioningMode::FULL;
+  if (!args.empty()) {
+    if (args.front() == "new") {
+      mode = CommissioningMode::INCREMENTAL;
+    } else if (args.front() != "all") {
+      std::cerr << "unknown initialise mode " << args.front() << "\n";
       return 1;
     }
+    args.pop_front();
+  }
 
-    // Execute withdraw to exclude this device from further COMPARE in the
-    // initialisation.
-    err = SearchAddrs(bus, SearchAddr(addr));
+  if (mode == CommissioningMode::FULL) {
+    // Turn all lights off for Initialise.
+    auto err = Off(bus, Broadcast);
     if (err) {
-      std::cerr << "SearchAddrs: " << err << "\n";
-      return 1;
-    }
-    err = Withdraw(bus);
-    if (err) {
-      std::cerr << "Withdraw:" << err << "\n";
+      std::cerr << "Off: " << err << "\n";
       return 1;
     }
+  }
 
-    // Sanity check: Address should no longer respond to COMPARE.
-    err = SearchAddrs(bus, SearchAddr(addr));
-    if (err) {
-      std::cerr << "SearchAddrs: " << err << "\n";
-      return 1;
-    }
-    if (auto compare_result = Compare(bus)) {
-      if (*compare_result) {
-        std::cerr << "gear did not withdraw (ignoring, continue searching)\n";
-        continue;
-      }
-    } else {
-      std::cerr << compare_result.error() << "\n";
-      return 1;
-    }
+  Commissioning commissioning(bus);
+  auto err = commissioning.run(mode);
+  if (err) {
+    std::cerr << "Initialise: " << err << "\n";
+    return 1;
+  }
 
-    // Program the short address for the found BRN address.
-    err = ProgramShortAddress(bus, short_address_counter);
-    if (err) {
-      std::cerr << "Program short address: " << err << "\n";
-      return 1;
+  for (uint8_t short_address = 0;
+       short_address < Commissioning::SHORT_ADDRESSES; short_address++) {
+    const auto &gear = commissioning.gear(short_address);
+    if (gear.conflict) {
+      std::cerr << "More than one gear with short address " << std::dec
+                << static_cast<int>(short_address) << "\n";
     }
-    std::cout << "Programmed short address: " << std::dec
-              << static_cast<int>(short_address_counter) << "\n";
-
-    auto gear = Address::from_short_address(short_address_counter);
-    if (auto verify_result = VerifyShortAddress(bus, gear)) {
-      if (!*verify_result) {
-        std::cerr << "Verify Short Address: check failed\n";
-        return 1;
-      }
-    } else {
-      std::cerr << "Verify Short Address: " << verify_result.error() << "\n";
-      return 1;
+    if (!gear.added) {
+      continue;
     }
+    std::cout << "Programmed short address " << std::dec
+              << static_cast<int>(short_address) << " for random address 0x"
+              << std::hex << gear.random_address.value_or(0) << "\n";
 
-    if (auto id_number = MemoryBank0GearIdentificationNumber(bus, gear)) {
+    auto address = Address::from_short_address(short_address);
+    if (auto id_number = MemoryBank0GearIdentificationNumber(bus, address)) {
       std::cout << "ID from memory bank0: " << std::dec
                 << static_cast<uint64_t>(*id_number) << "\n";
     } else {
@@ -220,16 +200,24 @@ static int initialise(LW14Adapter *bus) {
                 << id_number.error() << "\n";
       return 1;
     }
-
-    short_address_counter++;
   }
 
-  Terminate(bus);
-
+  std::cout << std::dec << static_cast<int>(commissioning.added())
+            << " gear addressed with " << commissioning.compares()
+            << " compares\n";
+  if (bus->stats().retries) {
+    std::cout << bus->stats().retries << " frames retried, "
+              << bus->stats().recovered << " recovered\n";
+  }
+  if (commissioning.unassigned()) {
+    std::cerr << static_cast<int>(commissioning.unassigned())
+              << " gear left without short address\n";
+    return 1;
+  }
   return 0;
 }
 
-static int blink(LW14Adapter *bus, std::list<std::string> &args) {
+static int blink(BusInterface *bus, std::list<std::string> &args) {
   auto short_address = static_cast<uint8_t>(std::stoi(args.front()));
   args.pop_front();
   auto gear = Address::from_short_address(short_address);
@@ -273,7 +261,7 @@ static int blink(LW14Adapter *bus, std::list<std::string> &args) {
   return 0;
 }
 
-static int info(LW14Adapter *bus, std::list<std::string> &args) {
+static int info(BusInterface *bus, std::list<std::string> &args) {
   auto short_address = static_cast<uint8_t>(std::stoi(args.front()));
   args.pop_front();
 
@@ -294,14 +282,189 @@ static int info(LW14Adapter *bus, std::list<std::string> &args) {
     std::cerr << "QueryActualLevel: " << actual_level.error() << "\n";
   }
 
-  if (auto id_number = MemoryBank0GearIdentificationNumber(bus, address)) {
+  MemoryBank0 bank0;
+  if (auto err = bank0.read(bus, address, 0)) {
+    std::cerr << "MemoryBank0: " << err << "\n";
+    return 1;
+  }
+  if (auto gtin = MemoryBank0GTIN(bank0)) {
+    std::cout << "MemoryBank0GTIN: " << std::dec
+              << static_cast<uint64_t>(*gtin) << "\n";
+  }
+  if (auto version = MemoryBank0FirmwareVersion(bank0)) {
+    auto v = static_cast<uint64_t>(*version);
+    std::cout << "MemoryBank0FirmwareVersion: " << std::dec << (v >> 8) << "."
+              << (v & 0xff) << "\n";
+  }
+  if (auto id_number = MemoryBank0GearIdentificationNumber(bank0)) {
     std::cout << "MemoryBank0GearIdentificationNumber: " << std::dec
               << static_cast<uint64_t>(*id_number) << "\n";
   } else {
-    std::cerr << "MemoryBank0GearIdentificationNumber: " << id_number.error()
-              << "\n";
+    std::cerr << "MemoryBank0GearIdentificationNumber: not accessible\n";
     return 1;
   }
 
   return 0;
 }
+
+static int inventory(BusInterface *bus, std::list<std::string> &args) {
+  std::string file = args.empty() ? "dali_inventory.bin" : args.front();
+
+  Inventory inventory;
+  std::ifstream in(file, std::ios::binary);
+  bool loaded = true;
+  for (uint8_t block = 0; block < Inventory::BLOCKS; block++) {
+    Inventory::Record record;
+    loaded = in.read(reinterpret_cast<char *>(&record), sizeof(record)) &&
+             inventory.load(block, record) && loaded;
+  }
+  if (loaded) {
+    std::cout << "Validating inventory from " << file << "\n";
+  }
+  in.close();
+
+  // Only gear that was replaced or is not known yet is queried completely.
+  RegisterCacheScope cache(bus);
+  std::bitset<Inventory::SHORT_ADDRESSES> all;
+  all.set();
+  if (auto err = inventory.validate(bus, all)) {
+    std::cerr << "Inventory: " << err << "\n";
+    return 1;
+  }
+  std::cout << "Queried " << std::dec << static_cast<int>(inventory.queried())
+            << " gear\n";
+
+  for (uint8_t short_address = 0;
+       short_address < Inventory::SHORT_ADDRESSES; short_address++) {
+    const auto &gear = inventory.gear(short_address);
+    if (!gear.present) {
+      continue;
+    }
+    std::cout << std::dec << static_cast<int>(short_address)
+              << ": id=" << gear.identification_number
+              << " gtin=" << gear.gtin
+              << " gear_type=" << static_cast<int>(gear.gear_type)
+              << " operating_modes=" << static_cast<int>(gear.operating_modes)
+              << " dimming_curve=" << static_cast<int>(gear.dimming_curve)
+              << " level=" << static_cast<int>(gear.level) << "\n";
+  }
+
+  if (inventory.dirty()) {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    for (uint8_t block = 0; block < Inventory::BLOCKS; block++) {
+      auto record = inventory.record(block);
+      if (!out.write(reinterpret_cast<const char *>(&record),
+                     sizeof(record))) {
+        std::cerr << "Failed to write " << file << "\n";
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void print_latency(const char *name, const LatencyHistogram &latency) {
+  std::cout << name << ": count=" << latency.count
+            << " avg_ms=" << latency.average_ms()
+            << " max_ms=" << latency.max_ms << " buckets=";
+  for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+    if (i < LatencyHistogram::BOUNDS_MS.size()) {
+      std::cout << "<=" << LatencyHistogram::BOUNDS_MS[i];
+    } else {
+      std::cout << ">" << LatencyHistogram::BOUNDS_MS.back();
+    }
+    std::cout << ":" << latency.buckets[i]
+              << (i + 1 < LatencyHistogram::BUCKETS ? "," : "\n");
+  }
+}
+
+static int stats(LW14Adapter *bus, RetryBus *retry_bus,
+                 std::list<std::string> &args) {
+  int rounds = args.empty() ? 1 : std::stoi(args.front());
+
+  for (int round = 0; round < rounds; round++) {
+    for (uint8_t short_address = 0;
+         short_address < Inventory::SHORT_ADDRESSES; short_address++) {
+      // Errors end up in the metrics.
+      QueryControlGearPresent(retry_bus,
+                              Address::from_short_address(short_address));
+    }
+  }
+
+  const auto &metrics = bus->metrics();
+  std::cout << std::dec << "commands: " << metrics.commands() << "\n";
+  for (size_t i = 0; i < BusMetrics::ERROR_CODES; i++) {
+    auto code = ErrorCode(static_cast<ErrorCode::code_t>(i));
+    std::cout << "  " << code << ": " << metrics.results[i] << "\n";
+  }
+  print_latency("control", metrics.latency_of(CommandClass::CONTROL));
+  print_latency("query", metrics.latency_of(CommandClass::QUERY));
+  print_latency("special", metrics.latency_of(CommandClass::SPECIAL));
+  std::cout << "queue_full: " << metrics.queue_full << "\n"
+            << "busy_waits: " << metrics.busy_waits << "\n"
+            << "stale_telegrams: " << metrics.stale_telegrams << "\n"
+            << "overruns: " << metrics.overruns << "\n"
+            << "i2c_transactions: " << metrics.i2c_transactions << "\n"
+            << "retries: " << retry_bus->stats().retries
+            << " recovered=" << retry_bus->stats().recovered
+            << " failed=" << retry_bus->stats().failed << "\n";
+  return 0;
+}
+
+static std::atomic<bool> interrupted{false};
+
+static void write_frame(const MonitorFrame &frame, bool binary) {
+  if (binary) {
+    uint8_t record[MonitorFrame::MAX_ENCODED];
+    std::fwrite(record, 1, frame.encode(record), stdout);
+    return;
+  }
+  char line[96];
+  frame.describe(line, sizeof(line));
+  std::printf("%s\n", line);
+}
+
+static int monitor(LW14Adapter *bus, std::list<std::string> &args) {
+  bool binary = false;
+  if (!args.empty()) {
+    if (args.front() == "binary") {
+      binary = true;
+    } else if (args.front() != "text") {
+      std::cerr << "unknown monitor format " << args.front() << "\n";
+      return 1;
+    }
+    args.pop_front();
+  }
+
+  BusMonitor frames;
+  bus->set_monitor(&frames);
+  std::signal(SIGINT, [](int) { interrupted = true; });
+  // Only this thread touches the bus. Writing to a slow terminal or pipe
+  // does not delay reading the telegrams, the ring takes up the backlog.
+  std::thread capture([bus] {
+    while (!interrupted) {
+      bus->poll();
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  });
+
+  MonitorFrame frame;
+  while (!interrupted) {
+    if (!frames.pop(frame)) {
+      std::fflush(stdout);
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    write_frame(frame, binary);
+  }
+  capture.join();
+  while (frames.pop(frame)) {
+    write_frame(frame, binary);
+  }
+  std::fflush(stdout);
+  bus->set_monitor(nullptr);
+
+  std::cerr << std::dec << frames.dropped() << " frames dropped, "
+            << frames.overruns() << " overruns\n";
+  return 0;
+}